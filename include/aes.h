@@ -8,6 +8,18 @@ extern const uint8_t invsbox[256];
 extern const uint8_t rcon[10];
 
 void mix_column(uint8_t col[4]);
+void inv_mix_column(uint8_t col[4]);
+void key_expansion(const uint8_t masterkey[16], uint8_t subkeys[176]);
+void encrypt_faulty(
+  const uint8_t pt[16],
+  const uint8_t subkeys[176],
+  const int round,
+  const int pos,
+  const uint8_t value,
+  uint8_t ct[16]
+);
+/* dispatched to the selected kernels (see kernel.c) */
 void encrypt_aes(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]);
+void decrypt_aes(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]);
 
 #endif /* AES_H_ */
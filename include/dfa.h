@@ -1,20 +1,57 @@
 #ifndef DFA_H_
 #define DFA_H_
 
+#include <stdalign.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdbool.h>
 #include "aes.h"
+#include "kernel.h"
+#include "keysched.h"
 
 #define DFA_ROUND_8 8
 #define DFA_ROUND_9 9
-#define DIFF_MC_MAX 1020
-#define CAND_MAX 2000
-#define PAIRS_MAX 20
-#define KEYS_MAX 65536
+#define DFA_MIXED 89
+/* keys of a round 9 key space enumerated at most (larger ones are factored) */
+#define KEYS_MAX (1 << 22)
+/* initial room of a key set (grown by keyset_reserve) */
+#define KEYSET_INITIAL 65536
+
+#define OUTPUT_TEXT 0
+#define OUTPUT_BINARY 1
+#define OUTPUT_FACTORED 2
+
+#define KEYFILE_VERSION 1
+#define KEYFILE_VERIFIED 1        /* keys checked with a known plaintext */
+#define KEYFILE_HAS_HYPOTHESES 2  /* masks of hypotheses follow the keys */
+#define KEYFILE_BITFLIP 4         /* hypotheses give the bit of a bitflip fault */
+
+#define FACTORED_VERSION 1
+#define FACTORED_RECIPE_K10 1     /* candidates form K10, reverse key expansion gives K0 */
+
+#define CACHE_R8_CANDIDATES 1
+#define CACHE_R9_CANDIDATES 2
+#define CACHE_R8_FILTER 3
+
+/* verification pairs kept (a single full pair already leaves a single key) */
+#define VERIFY_MAX 8
+/* known plaintext bits needed to expect a single matching key (early exit, verified keys) */
+#define VERIFY_UNIQUE_BITS 128
+
+/* 4 columns, or 8 bits of a bitflip at a known position */
+#define R8_HYPOTHESES_MAX 32
+
+#define PIN_NONE 0
+#define PIN_COMPACT 1
+#define PIN_SCATTER 2
 
 #define BYTES_TO_WORD(a) *(uint32_t *)(a)
 #define TAKEBYTE(w,n) (uint8_t)(((w)>>(8*n)) & 255)
 
+/* hypothesis identifier: column of the fault in round 8 and bit of a bitflip fault */
+#define HYPOTHESIS(col,bit) (8*(col) + (bit))
+
 int getopt(int argc, char * const argv[], const char *optstring);
 extern char *optarg;
 extern int optind, opterr, optopt;
@@ -27,58 +64,440 @@ typedef struct Pair {
   int fault_pos;
   int fault_value;
   bool bitflip;
+  int round; /* round of the fault if tagged in the input file (0 otherwise) */
 } pair_t;
 
-typedef struct KnownPt {
-  uint8_t pt[16];
+/**
+ * Inverse sbox of each byte of a correct ciphertext xored with every key byte:
+ * inv[i][k] = invsbox[ct[i] ^ k], computed once for the pairs sharing `ct`.
+ */
+typedef struct CtTables {
+  uint8_t inv[16][256];
+} ct_tables_t;
+
+/**
+ * Pairs sharing the same correct ciphertext (see group_pairs).
+ */
+typedef struct PairGroup {
   uint8_t ct[16];
-  bool is_some;
+  int *members;           /* indices of the pairs, in input order */
+  int len;
+  ct_tables_t tables;
+} pair_group_t;
+
+/**
+ * Plaintext/ciphertext pairs that keys must match: the `pt:`/`ct:` block of
+ * the input and the plaintexts given with ciphertext pairs (`pt=` field,
+ * checked against the correct ciphertext of the pair).
+ * Unknown nibbles of a plaintext (`?`) are masked out: such a partial
+ * plaintext is compared with the decryption of its ciphertext.
+ */
+typedef struct KnownPt {
+  alignas(16) uint8_t pt[VERIFY_MAX][16];
+  alignas(16) uint8_t ct[VERIFY_MAX][16];
+  uint8_t mask[VERIFY_MAX][16];   /* set bits are known bits of the plaintext */
+  bool partial[VERIFY_MAX];
+  int n;
+  int known_bits;                 /* known bits of all the plaintexts */
+  bool is_some;                   /* at least one pair */
 } known_pt_t;
 
+typedef struct KeySet {
+  uint8_t (*keys)[16];    /* hash table of keys */
+  uint64_t *hypotheses;   /* for each slot, mask of hypotheses that produced the key */
+  uint8_t *state;         /* for each slot: empty, being written or ready */
+  uint32_t *order;        /* slots in order of first insertion */
+  size_t capacity;        /* number of slots (power of two) */
+  size_t max_keys;        /* room before the set must be grown (see keyset_reserve) */
+  size_t len;             /* number of distinct keys */
+  size_t inserts;         /* number of insertions (including duplicates) */
+  size_t overflow;        /* number of keys refused because the set is full (see keyset_reserve) */
+} keyset_t;
+
+typedef struct KeyFileHeader {
+  char magic[8];          /* "DFAKEYS" */
+  uint32_t version;
+  uint32_t mode;          /* DFA_ROUND_8, DFA_ROUND_9 or DFA_MIXED */
+  uint64_t input_hash;    /* FNV-1a of the input file */
+  uint64_t nkeys;
+  uint64_t hypotheses;    /* union of hypotheses of all keys */
+  uint32_t flags;
+  uint32_t npairs;
+} keyfile_header_t;
+
+typedef struct HexWriter {
+  FILE *fp;
+  char *buffer;           /* lines formatted before a single fwrite */
+  size_t pos;
+  int err;                /* set if a write failed */
+} hex_writer_t;
+
+typedef struct KeyFile {
+  keyfile_header_t header;
+  const uint8_t (*keys)[16];
+  const uint64_t *hypotheses; /* NULL if absent */
+  void *map;
+  size_t map_len;
+} keyfile_t;
+
+typedef struct Factored {
+  const uint32_t *candidates[4]; /* candidates of each diagonal (see POSITIONS) */
+  int candidates_len[4];
+  uint32_t *storage;      /* copy of the candidates (if not mapped from a file) */
+  void *map;              /* mapping of a factored file */
+  size_t map_len;
+  bool requested;         /* store the key space even if it is small */
+  bool is_some;
+} factored_t;
+
+typedef struct FactoredHeader {
+  char magic[8];          /* "DFAFACT" */
+  uint32_t version;
+  uint32_t recipe;
+  uint32_t mode;
+  uint32_t npairs;
+  uint64_t input_hash;
+  uint64_t nkeys;         /* product of the lengths */
+  uint32_t candidates_len[4];
+  uint8_t positions[4][4];
+} factored_header_t;
+
+typedef struct FactoredIter {
+  const factored_t *factored;
+  uint64_t index;
+  uint64_t end;
+  int idx[4];
+  uint8_t subkey10[16];
+} factored_iter_t;
+
+typedef struct CacheKey {
+  uint8_t ct[16];
+  uint8_t fct[16];
+  int32_t kind;           /* CACHE_R8_CANDIDATES, CACHE_R9_CANDIDATES or CACHE_R8_FILTER */
+  int32_t row8;
+  int32_t col8;
+  int32_t fault_pos;
+  int32_t fault_value;
+  int32_t bitflip;
+  uint64_t extra;         /* hash of the candidates given to the filtering */
+} cache_key_t;
+
+typedef struct ResultEntry {
+  uint64_t ordinal;       /* position in the sequential enumeration */
+  uint8_t key[16];
+} result_entry_t;
+
+typedef struct ResultBuffer {
+  result_entry_t *entries;
+  size_t len;
+  size_t size;
+  uint8_t pad[40];        /* one buffer per cache line (no false sharing) */
+} result_buffer_t;
+
+typedef struct Results {
+  result_buffer_t *buffers; /* one for each thread */
+  int nthreads;
+} results_t;
+
+typedef struct ArenaBlock arena_block_t;
+
+typedef struct Arena {
+  arena_block_t *block;   /* current block (previous ones are chained) */
+  size_t used;            /* bytes allocated in all blocks */
+  size_t peak;            /* largest value of `used` */
+} arena_t;
+
+typedef struct ArenaMark {
+  arena_block_t *block;
+  size_t block_used;
+  size_t used;
+} arena_mark_t;
+
+typedef struct SearchControl {
+  double deadline;        /* wall_time() at which the search stops (0: no time budget) */
+  int stop;               /* set when the deadline is reached */
+  double space;           /* keys before filtering of the key spaces searched (round 8) */
+  keyset_t *streamed;     /* keys already printed on stdout (NULL: no streaming) */
+  keyset_t streamed_set;
+} search_ctl_t;
+
+/**
+ * Hypothesis on the fault of a single ciphertext pair with a fault in round 8:
+ * column of the fault and fault value (-1 if unknown).
+ */
+typedef struct R8Hypothesis {
+  int col8;
+  int fault_value;
+  int id;                       /* identifier of the hypothesis (see HYPOTHESIS) */
+  int candidates_len[4];
+  long nb_cand;
+  uint32_t *candidates[4];      /* valid while the hypothesis is searched */
+  int *done;                    /* coverage of the search (see r8_exhaustive_search) */
+  bool started;
+} r8_hypothesis_t;
+
+typedef struct Tuning {
+  int threads;            /* number of threads (0: OpenMP default) */
+  int chunk;              /* candidates of diagonal 0 given at a time to a thread */
+  int kernel;             /* KERNEL_AUTO: best kernels supported by the CPU */
+} tuning_t;
+
 /* utils */
-int readfile(const char *filename, pair_t pairs[PAIRS_MAX], int *npairs, known_pt_t *known_pt);
+int hex_to_bytes(const char *a, const int alen, uint8_t *b, const int blen);
+int read_pairs(FILE *fp, pair_t **pairs, int *npairs, known_pt_t *known_pt);
+int readfile(const char *filename, pair_t **pairs, int *npairs, known_pt_t *known_pt);
+int select_pairs(pair_t *pairs, const int npairs, const int mode);
 void print_hex(const uint8_t *buffer, const int len);
 void print_pair_info(const pair_t *pair);
 void print_number_candidates_line(const int num, const int col);
 void print_number_candidates(const int candidates_len[4], const long nb_cand);
+void print_hypotheses(FILE *fp, const uint64_t hypotheses, const bool bitflip);
+void print_key_hypotheses(const uint8_t key[16], const uint64_t hypotheses, const bool bitflip);
+
+/* verification with known plaintexts */
+void known_pt_init(known_pt_t *known_pt);
+int known_pt_add(known_pt_t *known_pt, const uint8_t pt[16], const uint8_t mask[16], const uint8_t ct[16]);
+bool known_pt_check(const known_pt_t *known_pt, const uint8_t subkeys[176]);
+bool known_pt_unique(const known_pt_t *known_pt);
+
+/* key set */
+int keyset_init(keyset_t *set, const size_t max_keys);
+void keyset_free(keyset_t *set);
+int keyset_reserve(keyset_t *set, const size_t n);
+int keyset_insert(keyset_t *set, const uint8_t key[16], const int hypothesis);
+size_t keyset_len(const keyset_t *set);
+const uint8_t *keyset_get(const keyset_t *set, const size_t i);
+uint64_t keyset_hypotheses(const keyset_t *set, const size_t i);
+
+/* output */
+uint64_t hash_file(const char *filename);
+int hex_writer_init(hex_writer_t *w, FILE *fp);
+void hex_writer_put(hex_writer_t *w, const uint8_t key[16]);
+int hex_writer_close(hex_writer_t *w);
+int write_keys_text(FILE *fp, const keyset_t *keys);
+int write_keys_binary(const char *filename, const keyset_t *keys, const keyfile_header_t *header);
+int keyfile_open(const char *filename, keyfile_t *kf);
+void keyfile_close(keyfile_t *kf);
+
+/* factored key space */
+int factored_set(
+  factored_t *factored,
+  uint32_t *const candidates[4],
+  const int candidates_len[4]
+);
+void factored_free(factored_t *factored);
+uint64_t factored_size(const factored_t *factored);
+void factored_key(const factored_t *factored, uint64_t index, uint8_t key[16]);
+void factored_iter_init(factored_iter_t *it, const factored_t *factored, uint64_t start, uint64_t end);
+int factored_iter_next(factored_iter_t *it, uint8_t key[16]);
+int write_factored(const char *filename, const factored_t *factored, const factored_header_t *header);
+int factored_open(const char *filename, factored_t *factored, factored_header_t *header);
+
+/* groups of pairs */
+void ct_tables_init(ct_tables_t *tables, const uint8_t ct[16]);
+int group_pairs(
+  const pair_t *pairs,
+  const int npairs,
+  arena_t *arena,
+  pair_group_t **groups,
+  int *group_of
+);
+
+/* cache */
+int cache_init(const char *dir);
+bool cache_enabled(void);
+void cache_key_pair(
+  cache_key_t *key,
+  const int kind,
+  const pair_t *pair,
+  const int row8,
+  const int col8
+);
+void cache_key_candidates(
+  cache_key_t *key,
+  uint32_t *const candidates[4],
+  const int candidates_len[4]
+);
+int cache_load_lists(
+  const cache_key_t *key,
+  arena_t *arena,
+  uint32_t *lists[],
+  int lens[],
+  const int nlists,
+  int *aux
+);
+void cache_store_lists(
+  const cache_key_t *key,
+  uint32_t *const lists[],
+  const int lens[],
+  const int nlists,
+  const int aux
+);
+long cache_load_keys(const cache_key_t *key, uint8_t (**keys)[16]);
+void cache_store_keys(const cache_key_t *key, const uint8_t (*keys)[16], const size_t n);
+
+/* threads */
+int thread_num(void);
+int max_threads(void);
+void results_init(results_t *results);
+void results_free(results_t *results);
+void results_push(results_t *results, const int tid, const uint64_t ordinal, const uint8_t key[16]);
+int results_merge(results_t *results, keyset_t *keys, const int hypothesis);
+void place_diagonal(placed_t *placed, const uint32_t *candidates, const int len, const int diag);
+void place_candidates(
+  uint32_t *const candidates[4],
+  const int candidates_len[4],
+  placed_t *local[4]
+);
+void pin_threads(const int policy);
+int physical_cores(int *ncpus);
+
+/* arena */
+void arena_init(arena_t *arena, const size_t size);
+void arena_free(arena_t *arena);
+void *arena_alloc(arena_t *arena, const size_t size);
+arena_mark_t arena_mark(const arena_t *arena);
+void arena_release(arena_t *arena, const arena_mark_t mark);
+void arena_reset(arena_t *arena);
+
+/* search control */
+double wall_time(void);
+int search_ctl_init(search_ctl_t *ctl, const double budget, const bool stream);
+void search_ctl_free(search_ctl_t *ctl);
+bool search_should_stop(search_ctl_t *ctl);
+void search_stream_key(search_ctl_t *ctl, const uint8_t key[16]);
+
+/* tuning */
+void tune_defaults(tuning_t *tuning);
+int tune_apply(const tuning_t *tuning);
+int tune_load(tuning_t *tuning);
+void tune_save(const tuning_t *tuning);
+void tune_calibrate(tuning_t *tuning);
+void tune_host(tuning_t *tuning);
+
+/* daemon */
+int daemon_run(const char *path, const int njobs, const int threads, const int chunk);
 
 /* dfa */
 int get_diff_mc(
   const int row,
   const int fault_list[255],
   const int fault_len,
-  uint32_t list_diff[DIFF_MC_MAX]
+  uint32_t *list_diff
 );
 int k10_cand_from_diff_mc(
   const pair_t *pair,
   const int col,
-  const uint32_t diff_mc_list[DIFF_MC_MAX],
+  const uint32_t *diff_mc_list,
   const int diff_mc_len,
-  uint32_t candidates[CAND_MAX]
+  const ct_tables_t *tables,
+  arena_t *arena,
+  uint32_t **candidates
 );
 void intersection(uint32_t *list1, int *len1, const uint32_t *list2, const int len2);
-void reverse_key_expansion(const uint8_t subkey10[16], uint8_t subkeys[176]);
-void k9_from_k10(const uint8_t subkey10[16], uint8_t subkey9[16]);
+void intersection_reduce(uint32_t *lists[], int lens[], const int n);
 int exhaustive_search(
-  const uint32_t candidates[4][CAND_MAX],
+  uint32_t *const candidates[4],
   const int candidates_len[4],
   const known_pt_t *known_pt,
-  uint8_t masterkeys[KEYS_MAX][16]
+  const int hypothesis,
+  keyset_t *keys,
+  search_ctl_t *ctl
 );
 
 /* dfa round 9 */
+int find_faulty_column(const pair_t *pair);
+void r9_find_all_candidates(
+  const pair_t *pairs,
+  const int npairs,
+  arena_t *arena,
+  uint32_t *candidates[4],
+  int candidates_len[4]
+);
+int r9_search(
+  uint32_t *const candidates[4],
+  int candidates_len[4],
+  const known_pt_t *known_pt,
+  keyset_t *keys,
+  factored_t *factored,
+  search_ctl_t *ctl
+);
 int r9_key_recovery(
-  const pair_t pairs[PAIRS_MAX],
+  const pair_t *pairs,
   const int npairs,
+  arena_t *arena,
   const known_pt_t *known_pt,
-  uint8_t masterkeys[KEYS_MAX][16]
+  keyset_t *keys,
+  factored_t *factored,
+  search_ctl_t *ctl
 );
 
 /* dfa round 8 */
+int r8_hypotheses(const pair_t *pair, r8_hypothesis_t hyps[R8_HYPOTHESES_MAX]);
+void r8_hypothesis_candidates(
+  const pair_t *pair,
+  const int row8,
+  uint32_t *const known_cand[4],
+  const int known_cand_len[4],
+  arena_t *arena,
+  r8_hypothesis_t *hyp
+);
+int r8_search(
+  const pair_t *pair,
+  const int row8,
+  const int col8,
+  uint32_t *const candidates[4],
+  const int candidates_len[4],
+  const known_pt_t *known_pt,
+  keyset_t *keys
+);
+r8_group_t *r8_filter_groups(
+  const pair_t *pairs,
+  const pair_group_t *groups,
+  const int ngroups,
+  arena_t *arena
+);
 int r8_key_recovery(
-  pair_t pairs[PAIRS_MAX],
+  const pair_t *pairs,
+  const int npairs,
+  arena_t *arena,
+  uint32_t *const known_cand[4],
+  const int known_cand_len[4],
+  const known_pt_t *known_pt,
+  keyset_t *keys,
+  search_ctl_t *ctl
+);
+
+/* estimate of the search with a fault in round 8 */
+int r8_estimate(
+  const pair_t *pairs,
+  const int npairs,
+  arena_t *arena,
+  uint32_t *const known_cand[4],
+  const int known_cand_len[4],
+  const known_pt_t *known_pt
+);
+
+/* post-filter of the keys of a previous run */
+int postfilter_keys(
+  const char *filename,
+  const pair_t *pairs,
+  const int npairs,
+  const int mode,
+  const known_pt_t *known_pt,
+  arena_t *arena,
+  keyset_t *out
+);
+
+/* dfa with faults in round 8 and round 9 */
+int pair_round(const pair_t *pair);
+int mixed_key_recovery(
+  const pair_t *pairs,
   const int npairs,
+  arena_t *arena,
   const known_pt_t *known_pt,
-  uint8_t masterkeys[KEYS_MAX][16]
+  keyset_t *keys,
+  factored_t *factored,
+  search_ctl_t *ctl
 );
 #endif
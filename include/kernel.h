@@ -0,0 +1,149 @@
+#ifndef KERNEL_H_
+#define KERNEL_H_
+
+#include <emmintrin.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "profile.h"
+
+#define KERNEL_AUTO -1
+#define KERNEL_SOFT 0
+#define KERNEL_AESNI 1
+#define KERNEL_VAES 2
+#define KERNEL_COUNT 3
+
+/* candidates prefetched ahead of the one being checked */
+#define PLACED_PREFETCH 16
+
+/**
+ * Candidate of a diagonal placed in the last round key: its four bytes at their
+ * positions (see POSITIONS), the others null, so that a key is the OR of
+ * the candidates of its four diagonals (see place_candidates).
+ */
+typedef union Placed {
+  __m128i v;
+  uint8_t b[16];
+  uint32_t w[4];
+} placed_t;
+
+/**
+ * Fault hypothesis checked by the filtering with a fault in round 8
+ * (see r8_exhaustive_search).
+ */
+typedef struct R8Filter {
+  uint8_t ct[16];
+  uint8_t fct[16];
+  int row8;               /* row of the fault (-1 if unknown) */
+  int col8;               /* column of the fault */
+  int fault_value;        /* -1 if unknown */
+  bool bitflip;
+} r8_filter_t;
+
+/**
+ * Pairs sharing their correct ciphertext, checked together by the filtering
+ * with a fault in round 8 (see r8_group_search): the correct ciphertext is
+ * decrypted once for each key, then each faulty ciphertext until one fails.
+ * The column of the fault of a filter may be unknown (-1): any column is then accepted.
+ */
+typedef struct R8Group {
+  uint8_t ct[16];
+  const r8_filter_t *filters;   /* faulty ciphertexts and their faults (ct unused) */
+  int nfilters;
+} r8_group_t;
+
+/**
+ * Variant of the kernels for a target instruction set.
+ *
+ * - init: preparation of tables (NULL if none), called when the variant is selected;
+ * - encrypt: AES-128 encryption with expanded keys (aligned on 16 bytes);
+ * - decrypt: AES-128 decryption with the same keys (used for partial plaintexts);
+ * - r8_filter: innermost loop of the filtering with a fault in round 8.
+ *   `base` has diagonals 0 to 2 set (diagonal 3 null); each placed candidate
+ *   of diagonal 3 is ORed with it and checked. Indices of candidates that pass
+ *   are put in `survivors` (in increasing order) and their number is returned;
+ * - r8_group_filter: same for all the pairs of a group (survivors pass all filters);
+ * - key_inverse: round keys `round` (9, or 0 for the master keys) of `n` keys
+ *   given by their last round keys (16 bytes each, see keysched.h).
+ */
+typedef struct Kernel {
+  const char *name;
+  bool (*supported)(void);
+  void (*init)(void);
+  void (*encrypt)(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]);
+  void (*decrypt)(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]);
+  int (*r8_filter)(
+    const r8_filter_t *filter,
+    const placed_t *base,
+    const placed_t *cand3,
+    const int len3,
+    int *survivors
+  );
+  int (*r8_group_filter)(
+    const r8_group_t *group,
+    const placed_t *base,
+    const placed_t *cand3,
+    const int len3,
+    int *survivors
+  );
+  void (*key_inverse)(const uint8_t *subkeys10, uint8_t *out, const int n, const int round);
+} kernel_t;
+
+extern const kernel_t KERNEL_SOFT_IMPL;
+extern const kernel_t KERNEL_AESNI_IMPL;
+extern const kernel_t KERNEL_VAES_IMPL;
+
+/* dispatch */
+int kernel_select(const int id);
+int kernel_from_name(const char *name);
+const kernel_t *kernel_current(void);
+
+/**
+ * Difference of states before mix column in round 8 (column `col8`),
+ * checked against the fault: a single non-null byte, on the row of the fault
+ * if known, equal to the fault value if known, or a single bit for a bitflip.
+ */
+static inline bool r8_filter_check(const r8_filter_t *filter, const uint32_t diff) {
+  int row = filter->row8;
+  uint8_t value;
+  static const uint32_t masks[4] = {0xffffff00, 0xffff00ff, 0xff00ffff, 0x00ffffff};
+
+  if (row != -1) {
+    if ((diff & masks[row]) != 0) {
+      return false;
+    }
+  }
+  else {
+    for (row = 0; row < 4 && (diff & masks[row]) != 0; row++);
+    if (row == 4) {
+      return false;
+    }
+  }
+  PROFILE_COUNT(PROF_R8_SINGLE_BYTE, 1);
+
+  value = (uint8_t)(diff >> row*8);
+  if (filter->fault_value != -1) {
+    return value == filter->fault_value;
+  }
+  if (filter->bitflip) {
+    return value != 0 && (value & (value - 1)) == 0;
+  }
+  return true;
+}
+
+/**
+ * Same as r8_filter_check on the column of the fault, or on any column if unknown.
+ */
+static inline bool r8_filter_match(const r8_filter_t *filter, const uint32_t diff[4]) {
+  int col;
+  if (filter->col8 != -1) {
+    return r8_filter_check(filter, diff[filter->col8]);
+  }
+  for (col = 0; col < 4; col++) {
+    if (r8_filter_check(filter, diff[col])) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif /* KERNEL_H_ */
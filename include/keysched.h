@@ -0,0 +1,84 @@
+#ifndef KEYSCHED_H_
+#define KEYSCHED_H_
+
+#include <stdint.h>
+
+/**
+ * Key schedule of AES-128 on 32-bit words (little endian: byte 0 of a word
+ * is its least significant byte), run backwards from the last round key.
+ *
+ * One inverse step gives the round key r - 1 from the round key r = (a, b, c, d):
+ *   d' = d ^ c, c' = c ^ b, b' = b ^ a, a' = a ^ SubWord(RotWord(d')) ^ rcon[r - 1]
+ *
+ * Scalar functions are in keysched.c; the kernels built with AES instructions
+ * use the inline variants below (SubWord with aesenclast on broadcast words,
+ * for two keys at once with VAES).
+ */
+void k9_from_k10(const uint8_t subkey10[16], uint8_t subkey9[16]);
+void reverse_key_expansion(const uint8_t subkey10[16], uint8_t subkeys[176]);
+void key_inverse_words(const uint8_t *subkeys10, uint8_t *out, const int n, const int round);
+
+#if defined(__AES__) && defined(__SSSE3__)
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+/**
+ * One inverse step with AES-NI: RotWord(d') is broadcast to the four columns,
+ * so shift rows does nothing and aesenclast gives SubWord(RotWord(d')) ^ rcon
+ * in each column. The rcon is in a register (`rc`, broadcast to all words),
+ * unlike with aeskeygenassist, so that steps of several keys can be interleaved.
+ */
+static inline __m128i ks_ni_inverse(const __m128i k, const __m128i rc) {
+  const __m128i rot = _mm_setr_epi8(13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12);
+  __m128i t = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+  __m128i s = _mm_aesenclast_si128(_mm_shuffle_epi8(t, rot), rc);
+  return _mm_xor_si128(t, _mm_srli_si128(s, 12));
+}
+
+static inline __m128i ks_ni_k9(const __m128i k10) {
+  return ks_ni_inverse(k10, _mm_set1_epi32(0x36));
+}
+
+static inline __m128i ks_ni_k0(__m128i k) {
+  static const uint8_t RC[10] = {0x36, 0x1b, 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+  int r;
+  for (r = 0; r < 10; r++) {
+    k = ks_ni_inverse(k, _mm_set1_epi32(RC[r]));
+  }
+  return k;
+}
+#endif /* __AES__ && __SSSE3__ */
+
+#if defined(__VAES__) && defined(__AVX2__)
+#include <immintrin.h>
+
+/**
+ * One inverse step for two keys (one in each 128-bit lane):
+ * RotWord(d') is broadcast to the four columns, so shift rows does nothing
+ * and aesenclast gives SubWord(RotWord(d')) ^ rcon in each column.
+ */
+static inline __m256i ks_vaes_inverse(const __m256i k, const uint8_t rc) {
+  const __m256i rot = _mm256_setr_epi8(
+    13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12,
+    13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12
+  );
+  __m256i t = _mm256_xor_si256(k, _mm256_bslli_epi128(k, 4));
+  __m256i s = _mm256_aesenclast_epi128(_mm256_shuffle_epi8(t, rot), _mm256_set1_epi32(rc));
+  return _mm256_xor_si256(t, _mm256_bsrli_epi128(s, 12));
+}
+
+static inline __m256i ks_vaes_k9(const __m256i k10) {
+  return ks_vaes_inverse(k10, 0x36);
+}
+
+static inline __m256i ks_vaes_k0(__m256i k) {
+  static const uint8_t RC[10] = {0x36, 0x1b, 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+  int r;
+  for (r = 0; r < 10; r++) {
+    k = ks_vaes_inverse(k, RC[r]);
+  }
+  return k;
+}
+#endif /* __VAES__ && __AVX2__ */
+
+#endif /* KEYSCHED_H_ */
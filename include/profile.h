@@ -0,0 +1,94 @@
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * Instrumentation of the searches, built with `make PROFILE=1` (DFA_PROFILE).
+ * Otherwise the macros below expand to nothing and cost nothing.
+ *
+ * Counters form the funnel of the searches, per thread:
+ * - candidates generated for the diagonals of the last round key;
+ * - keys decrypted by the filtering with a fault in round 8, those with a single
+ *   non-null byte (on the row of the fault if known), those matching the fault
+ *   (value or bitflip);
+ * - keys enumerated by the exhaustive search;
+ * - reverse key expansions, encryptions of the known plaintext and matches.
+ *
+ * Phases measure the wall time and, if perf_event_open is permitted,
+ * cycles, instructions and cache misses of the thread.
+ */
+#define PROF_CANDIDATES 0
+#define PROF_R8_KEYS 1
+#define PROF_R8_SINGLE_BYTE 2
+#define PROF_R8_FAULT 3
+#define PROF_EXHAUSTIVE_KEYS 4
+#define PROF_KEY_EXPANSION 5
+#define PROF_PT_CHECKED 6
+#define PROF_PT_MATCH 7
+#define PROF_COUNTERS 8
+
+#define PHASE_CANDIDATES 0
+#define PHASE_R8_FILTER 1
+#define PHASE_EXHAUSTIVE 2
+#define PROF_PHASES 3
+
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_CACHE_MISSES 2
+#define PERF_EVENTS 3
+
+#ifdef DFA_PROFILE
+
+typedef struct ProfilePhase {
+  uint64_t calls;
+  uint64_t ns;
+  uint64_t events[PERF_EVENTS];
+  uint64_t start_ns;
+  uint64_t start_events[PERF_EVENTS];
+  int depth;
+} profile_phase_t;
+
+/**
+ * Counters of a thread (registered on first use, never freed).
+ */
+typedef struct ProfileThread {
+  uint64_t counters[PROF_COUNTERS];
+  profile_phase_t phases[PROF_PHASES];
+  int perf_fd;            /* leader of the group of events (-1 if unavailable) */
+  int id;
+  struct ProfileThread *next;
+} profile_thread_t;
+
+extern _Thread_local profile_thread_t *profile_self;
+profile_thread_t *profile_register(void);
+void profile_begin(const int phase);
+void profile_end(const int phase);
+
+static inline void profile_count(const int counter, const uint64_t n) {
+  profile_thread_t *t = profile_self;
+  if (t == NULL) {
+    t = profile_register();
+  }
+  t->counters[counter] += n;
+}
+
+#define PROFILE_COUNT(counter, n) profile_count((counter), (uint64_t)(n))
+#define PROFILE_BEGIN(phase) profile_begin(phase)
+#define PROFILE_END(phase) profile_end(phase)
+
+#else
+
+#define PROFILE_COUNT(counter, n) ((void)0)
+#define PROFILE_BEGIN(phase) ((void)0)
+#define PROFILE_END(phase) ((void)0)
+
+#endif /* DFA_PROFILE */
+
+/* report (does nothing without DFA_PROFILE) */
+int profile_available(void);
+void profile_summary(FILE *fp);
+void profile_json(FILE *fp);
+
+#endif /* PROFILE_H_ */
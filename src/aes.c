@@ -1,4 +1,3 @@
-#include <immintrin.h>
 #include <stdint.h>
 #include "aes.h"
 
@@ -65,19 +64,85 @@ void mix_column(uint8_t a[4]) {
   a[3] = a[3] ^ v ^ t;
 }
 
-void encrypt_aes(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]) {
-  int i;
-  __m128i block = _mm_load_si128((const __m128i *)input);
-  __m128i subkey = _mm_load_si128((const __m128i *)subkeys);
-  block = _mm_xor_si128(block, subkey);
+/**
+ * Inverse of mix_column: the column is first multiplied by (4x^2 + 5)
+ * so that mix column gives the inverse (as InvMixColumns = MixColumns * (4x^2 + 5)).
+ */
+void inv_mix_column(uint8_t a[4]) {
+  uint8_t u, v;
 
-  for (i = 1; i < 10; i++) {
-    subkey = _mm_load_si128((const __m128i *)(subkeys + 16*i));
-    block = _mm_aesenc_si128(block, subkey);
+  u = XTIME(a[0] ^ a[2]);
+  u = XTIME(u);
+  v = XTIME(a[1] ^ a[3]);
+  v = XTIME(v);
+  a[0] ^= u;
+  a[1] ^= v;
+  a[2] ^= u;
+  a[3] ^= v;
+  mix_column(a);
+}
+
+/**
+ * AES-128 key schedule: round keys from the master key.
+ */
+void key_expansion(const uint8_t masterkey[16], uint8_t subkeys[176]) {
+  int i;
+  for (i = 0; i < 16; i++) {
+    subkeys[i] = masterkey[i];
   }
+  for (i = 16; i < 176; i += 4) {
+    if (i % 16 == 0) {
+      subkeys[i] = subkeys[i - 16] ^ sbox[subkeys[i - 3]] ^ rcon[(i >> 4) - 1];
+      subkeys[i + 1] = subkeys[i - 15] ^ sbox[subkeys[i - 2]];
+      subkeys[i + 2] = subkeys[i - 14] ^ sbox[subkeys[i - 1]];
+      subkeys[i + 3] = subkeys[i - 13] ^ sbox[subkeys[i - 4]];
+    }
+    else {
+      subkeys[i] = subkeys[i - 16] ^ subkeys[i - 4];
+      subkeys[i + 1] = subkeys[i - 15] ^ subkeys[i - 3];
+      subkeys[i + 2] = subkeys[i - 14] ^ subkeys[i - 2];
+      subkeys[i + 3] = subkeys[i - 13] ^ subkeys[i - 1];
+    }
+  }
+}
 
-  subkey = _mm_load_si128((const __m128i *)(subkeys + 160));
-  block = _mm_aesenclast_si128(block, subkey);
+/**
+ * AES-128 encryption with a fault xored into byte `pos` of the state
+ * before mix column in round `round` (no fault if `round` is 0).
+ * Straightforward byte version: used to simulate faults (see tools/)
+ * and as the reference of the kernels.
+ */
+void encrypt_faulty(
+  const uint8_t pt[16],
+  const uint8_t subkeys[176],
+  const int round,
+  const int pos,
+  const uint8_t value,
+  uint8_t ct[16]
+) {
+  int i, r;
+  uint8_t s[16], t[16];
 
-  _mm_store_si128((__m128i *)output, block);
+  for (i = 0; i < 16; i++) {
+    s[i] = pt[i] ^ subkeys[i];
+  }
+  for (r = 1; r < 11; r++) {
+    for (i = 0; i < 16; i++) {
+      t[i] = sbox[s[(i + 4*(i % 4)) % 16]];
+    }
+    if (r == round) {
+      t[pos] ^= value;
+    }
+    if (r < 10) {
+      for (i = 0; i < 16; i += 4) {
+        mix_column(t + i);
+      }
+    }
+    for (i = 0; i < 16; i++) {
+      s[i] = t[i] ^ subkeys[16*r + i];
+    }
+  }
+  for (i = 0; i < 16; i++) {
+    ct[i] = s[i];
+  }
 }
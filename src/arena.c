@@ -0,0 +1,118 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "dfa.h"
+
+#define ARENA_ALIGN 64
+#define ARENA_DEFAULT_SIZE (1 << 20)
+#define ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+/**
+ * Block of memory of an arena; blocks are chained from the most recent one.
+ * The data follows the header (aligned on a cache line).
+ */
+struct ArenaBlock {
+  arena_block_t *prev;
+  size_t size;
+  size_t used;
+};
+
+#define BLOCK_HEADER ALIGN_UP(sizeof(arena_block_t))
+
+static arena_block_t *block_new(arena_block_t *prev, const size_t size) {
+  arena_block_t *block = aligned_alloc(ARENA_ALIGN, BLOCK_HEADER + ALIGN_UP(size));
+  if (block == NULL) {
+    fprintf(stderr, "[!] Cannot allocate memory (%zu bytes)\n", size);
+    exit(EXIT_FAILURE);
+  }
+  block->prev = prev;
+  block->size = ALIGN_UP(size);
+  block->used = 0;
+  return block;
+}
+
+/**
+ * Arena with a first block of `size` bytes (a default size if 0).
+ * Buffers are sized from the data and released all at once
+ * (see arena_release and arena_reset) instead of being freed one by one.
+ */
+void arena_init(arena_t *arena, const size_t size) {
+  arena->block = block_new(NULL, size > 0 ? size : ARENA_DEFAULT_SIZE);
+  arena->used = 0;
+  arena->peak = 0;
+}
+
+void arena_free(arena_t *arena) {
+  arena_block_t *block, *prev;
+  for (block = arena->block; block != NULL; block = prev) {
+    prev = block->prev;
+    free(block);
+  }
+  arena->block = NULL;
+}
+
+/**
+ * Allocate `size` bytes aligned on a cache line.
+ * A new block (at least twice as large as the current one) is chained
+ * when the current block is full, so previous allocations do not move.
+ * Safe to call from several threads (e.g., OpenMP tasks).
+ */
+void *arena_alloc(arena_t *arena, const size_t size) {
+  void *ptr;
+  size_t n = ALIGN_UP(size > 0 ? size : 1);
+  size_t new_size;
+
+#ifdef _OPENMP
+#pragma omp critical(arena)
+#endif
+  {
+    if (arena->block->used + n > arena->block->size) {
+      new_size = 2*arena->block->size;
+      if (new_size < n) {
+        new_size = n;
+      }
+      arena->block = block_new(arena->block, new_size);
+    }
+    ptr = (uint8_t *)arena->block + BLOCK_HEADER + arena->block->used;
+    arena->block->used += n;
+    arena->used += n;
+    if (arena->used > arena->peak) {
+      arena->peak = arena->used;
+    }
+  }
+  return ptr;
+}
+
+/**
+ * Current position in the arena, to release later everything allocated after it.
+ */
+arena_mark_t arena_mark(const arena_t *arena) {
+  arena_mark_t mark = {arena->block, arena->block->used, arena->used};
+  return mark;
+}
+
+void arena_release(arena_t *arena, const arena_mark_t mark) {
+  arena_block_t *prev;
+  while (arena->block != mark.block) {
+    prev = arena->block->prev;
+    free(arena->block);
+    arena->block = prev;
+  }
+  arena->block->used = mark.block_used;
+  arena->used = mark.used;
+}
+
+/**
+ * Release everything (e.g., between two jobs).
+ * If several blocks were needed, they are replaced by a single block
+ * as large as the peak usage, so the next job allocates nothing.
+ */
+void arena_reset(arena_t *arena) {
+  size_t peak = arena->peak;
+  if (arena->block->prev != NULL) {
+    arena_free(arena);
+    arena->block = block_new(NULL, peak);
+  }
+  arena->block->used = 0;
+  arena->used = 0;
+}
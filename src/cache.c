@@ -0,0 +1,296 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dfa.h"
+
+#define CACHE_VERSION 1
+
+static const char CACHE_MAGIC[8] = "DFACACH";
+
+/* cache directory (NULL if the cache is disabled) */
+static char *cache_dir = NULL;
+
+/**
+ * Header of a cache entry, followed by the data:
+ * - lists of candidates: `nitems` 32-bit words (lists are concatenated, see `lens`);
+ * - keys: `nitems` 16-byte master keys.
+ * The full cache key is stored to detect collisions of file names.
+ */
+typedef struct CacheHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t nitems;
+  int32_t lens[4];
+  int32_t aux;
+  uint32_t pad;
+  cache_key_t key;
+} cache_header_t;
+
+/**
+ * Enable the cache in directory `dir` (created if needed).
+ */
+int cache_init(const char *dir) {
+  if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    return -1;
+  }
+  free(cache_dir);
+  cache_dir = strdup(dir);
+  return cache_dir == NULL ? -1 : 0;
+}
+
+bool cache_enabled(void) {
+  return cache_dir != NULL;
+}
+
+static uint64_t fnv1a(const void *data, const size_t len, uint64_t h) {
+  size_t i;
+  const uint8_t *p = data;
+  for (i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 0x100000001b3UL;
+  }
+  return h;
+}
+
+/**
+ * Cache key of an analysis of `pair` (kind of analysis and fault hypothesis).
+ */
+void cache_key_pair(
+  cache_key_t *key,
+  const int kind,
+  const pair_t *pair,
+  const int row8,
+  const int col8
+) {
+  memset(key, 0, sizeof(*key));
+  memcpy(key->ct, pair->ct, 16);
+  memcpy(key->fct, pair->fct, 16);
+  key->kind = kind;
+  key->row8 = row8;
+  key->col8 = col8;
+  key->fault_pos = pair->fault_pos;
+  key->fault_value = pair->fault_value;
+  key->bitflip = pair->bitflip;
+}
+
+/**
+ * Add lists of candidates to a cache key
+ * (results of the filtering depend on the candidates that are combined).
+ */
+void cache_key_candidates(
+  cache_key_t *key,
+  uint32_t *const candidates[4],
+  const int candidates_len[4]
+) {
+  int i;
+  uint64_t h = 0xcbf29ce484222325UL;
+  for (i = 0; i < 4; i++) {
+    h = fnv1a(&candidates_len[i], sizeof(int), h);
+    h = fnv1a(candidates[i], candidates_len[i] * sizeof(uint32_t), h);
+  }
+  key->extra = h;
+}
+
+static void cache_path(const cache_key_t *key, char *path, const size_t len) {
+  snprintf(
+    path, len, "%s/%016lx.bin",
+    cache_dir, (unsigned long)fnv1a(key, sizeof(*key), 0xcbf29ce484222325UL)
+  );
+}
+
+/**
+ * Map a cache entry; returns NULL if absent or invalid.
+ */
+static const cache_header_t *cache_map(const cache_key_t *key, size_t *map_len) {
+  int fd;
+  char path[4096];
+  struct stat st;
+  const cache_header_t *hdr;
+
+  if (cache_dir == NULL) {
+    return NULL;
+  }
+  cache_path(key, path, sizeof(path));
+  fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    return NULL;
+  }
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(cache_header_t)) {
+    close(fd);
+    return NULL;
+  }
+  hdr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (hdr == MAP_FAILED) {
+    return NULL;
+  }
+  if (memcmp(hdr->magic, CACHE_MAGIC, 8) != 0 || hdr->version != CACHE_VERSION
+      || memcmp(&hdr->key, key, sizeof(*key)) != 0) {
+    munmap((void *)hdr, st.st_size);
+    return NULL;
+  }
+  *map_len = st.st_size;
+  return hdr;
+}
+
+/**
+ * Write a cache entry atomically (temporary file with a unique name, renamed).
+ */
+static void cache_write(const cache_header_t *hdr, const void *data, const size_t data_len) {
+  FILE *fp;
+  char path[4096];
+  char tmp[4200];
+  int fd, ok;
+
+  cache_path(&hdr->key, path, sizeof(path));
+  /* unique name: workers of the daemon and threads may write the same entry */
+  snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+  fd = mkstemp(tmp);
+  if (fd == -1) {
+    return;
+  }
+  /* mkstemp creates the file readable by its owner only */
+  fchmod(fd, 0644);
+  fp = fdopen(fd, "wb");
+  if (fp == NULL) {
+    close(fd);
+    unlink(tmp);
+    return;
+  }
+  ok = fwrite(hdr, sizeof(*hdr), 1, fp) == 1;
+  if (data_len > 0) {
+    ok = ok && fwrite(data, data_len, 1, fp) == 1;
+  }
+  ok = (fclose(fp) == 0) && ok;
+  if (!ok || rename(tmp, path) != 0) {
+    unlink(tmp);
+  }
+}
+
+/**
+ * Load `nlists` lists of candidates (allocated in `arena`)
+ * and an auxiliary value (e.g. a column).
+ * Returns 0 on a cache hit, -1 otherwise.
+ */
+int cache_load_lists(
+  const cache_key_t *key,
+  arena_t *arena,
+  uint32_t *lists[],
+  int lens[],
+  const int nlists,
+  int *aux
+) {
+  int i;
+  size_t map_len, total = 0;
+  const uint32_t *data;
+  const cache_header_t *hdr = cache_map(key, &map_len);
+
+  if (hdr == NULL) {
+    return -1;
+  }
+  for (i = 0; i < nlists; i++) {
+    if (hdr->lens[i] < 0) {
+      munmap((void *)hdr, map_len);
+      return -1;
+    }
+    total += hdr->lens[i];
+  }
+  if (total != hdr->nitems || sizeof(*hdr) + total * sizeof(uint32_t) > map_len) {
+    munmap((void *)hdr, map_len);
+    return -1;
+  }
+
+  data = (const uint32_t *)(hdr + 1);
+  for (i = 0; i < nlists; i++) {
+    lens[i] = hdr->lens[i];
+    lists[i] = arena_alloc(arena, lens[i] * sizeof(uint32_t));
+    memcpy(lists[i], data, lens[i] * sizeof(uint32_t));
+    data += lens[i];
+  }
+  if (aux != NULL) {
+    *aux = hdr->aux;
+  }
+  munmap((void *)hdr, map_len);
+  return 0;
+}
+
+void cache_store_lists(
+  const cache_key_t *key,
+  uint32_t *const lists[],
+  const int lens[],
+  const int nlists,
+  const int aux
+) {
+  int i;
+  uint32_t *data, *p;
+  cache_header_t hdr = {0};
+
+  if (cache_dir == NULL) {
+    return;
+  }
+  memcpy(hdr.magic, CACHE_MAGIC, 8);
+  hdr.version = CACHE_VERSION;
+  hdr.aux = aux;
+  hdr.key = *key;
+  for (i = 0; i < nlists; i++) {
+    hdr.lens[i] = lens[i];
+    hdr.nitems += lens[i];
+  }
+
+  data = malloc(hdr.nitems * sizeof(uint32_t) + 1);
+  if (data == NULL) {
+    return;
+  }
+  for (p = data, i = 0; i < nlists; i++) {
+    memcpy(p, lists[i], lens[i] * sizeof(uint32_t));
+    p += lens[i];
+  }
+  cache_write(&hdr, data, hdr.nitems * sizeof(uint32_t));
+  free(data);
+}
+
+/**
+ * Load master keys (e.g., keys that passed the filtering with a fault in round 8).
+ * Returns the number of keys (allocated in `*keys`), or -1 on a cache miss.
+ */
+long cache_load_keys(const cache_key_t *key, uint8_t (**keys)[16]) {
+  size_t map_len;
+  long n;
+  const cache_header_t *hdr = cache_map(key, &map_len);
+
+  if (hdr == NULL) {
+    return -1;
+  }
+  if (sizeof(*hdr) + (size_t)hdr->nitems * 16 > map_len) {
+    munmap((void *)hdr, map_len);
+    return -1;
+  }
+  n = hdr->nitems;
+  *keys = malloc(n * 16 + 1);
+  if (*keys == NULL) {
+    munmap((void *)hdr, map_len);
+    return -1;
+  }
+  memcpy(*keys, hdr + 1, n * 16);
+  munmap((void *)hdr, map_len);
+  return n;
+}
+
+void cache_store_keys(const cache_key_t *key, const uint8_t (*keys)[16], const size_t n) {
+  cache_header_t hdr = {0};
+
+  if (cache_dir == NULL) {
+    return;
+  }
+  memcpy(hdr.magic, CACHE_MAGIC, 8);
+  hdr.version = CACHE_VERSION;
+  hdr.nitems = (uint32_t)n;
+  hdr.key = *key;
+  cache_write(&hdr, keys, n * 16);
+}
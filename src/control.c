@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include "dfa.h"
+
+/**
+ * Monotonic wall-clock time in seconds.
+ */
+double wall_time(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + 1e-9 * (double)ts.tv_nsec;
+}
+
+/**
+ * Search control with a time budget of `budget` seconds (none if 0),
+ * starting now. Keys are streamed on stdout if `stream` is set.
+ *
+ * Returns -1 if memory cannot be allocated.
+ */
+int search_ctl_init(search_ctl_t *ctl, const double budget, const bool stream) {
+  ctl->deadline = budget > 0 ? wall_time() + budget : 0;
+  ctl->stop = 0;
+  ctl->space = 0;
+  ctl->streamed = NULL;
+  if (stream) {
+    ctl->streamed = &ctl->streamed_set;
+    if (keyset_init(ctl->streamed, KEYSET_INITIAL) == -1) {
+      ctl->streamed = NULL;
+      return -1;
+    }
+  }
+  return 0;
+}
+
+void search_ctl_free(search_ctl_t *ctl) {
+  if (ctl->streamed != NULL) {
+    keyset_free(ctl->streamed);
+    ctl->streamed = NULL;
+  }
+}
+
+/**
+ * Check whether the search must stop (deadline reached or stop requested).
+ * Cheap enough to be called in the outer loops of the searches.
+ */
+bool search_should_stop(search_ctl_t *ctl) {
+  if (ctl == NULL) {
+    return false;
+  }
+  if (__atomic_load_n(&ctl->stop, __ATOMIC_RELAXED)) {
+    return true;
+  }
+  if (ctl->deadline > 0 && wall_time() >= ctl->deadline) {
+    __atomic_store_n(&ctl->stop, 1, __ATOMIC_RELAXED);
+    return true;
+  }
+  return false;
+}
+
+/**
+ * Print a key on stdout as soon as it is found (each distinct key once).
+ * Keys are rare at this point: the set of printed keys is updated under
+ * a lock, so that it can grow.
+ */
+void search_stream_key(search_ctl_t *ctl, const uint8_t key[16]) {
+  if (ctl == NULL || ctl->streamed == NULL) {
+    return;
+  }
+#ifdef _OPENMP
+#pragma omp critical(stream)
+#endif
+  {
+    if (keyset_reserve(ctl->streamed, 1) == 0 && keyset_insert(ctl->streamed, key, 0) == 1) {
+      print_hex(key, 16);
+      fflush(stdout);
+    }
+  }
+}
@@ -0,0 +1,561 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "dfa.h"
+
+#ifdef _OPENMP
+#include "omp.h"
+#endif
+
+#define DAEMON_QUEUE_MAX 4096       /* jobs waiting to run */
+#define DAEMON_INPUT_MAX (1 << 20)  /* bytes of input data of a job */
+#define DAEMON_LINE_MAX 256
+#define DAEMON_POLL_MS 200          /* check that the client is still connected */
+
+#define JOB_QUEUED 0
+#define JOB_RUNNING 1
+#define JOB_DONE 2
+
+/**
+ * Job submitted by a client: pairs in the input file format
+ * and the response written by the worker that runs it.
+ */
+typedef struct Job {
+  uint64_t id;
+  int mode;
+  int priority;           /* highest first, then in order of submission */
+  bool factored;          /* factored key space requested */
+  int state;
+  bool cancelled;
+  pair_t *pairs;
+  int npairs;
+  known_pt_t known_pt;
+  search_ctl_t ctl;       /* stop set to cancel the job while it runs */
+  char *response;
+  size_t response_len;
+  struct Job *next;
+} job_t;
+
+typedef struct Server {
+  pthread_mutex_t lock;
+  pthread_cond_t queued;      /* signaled when a job is queued */
+  pthread_cond_t finished;    /* broadcast when a job is done or cancelled */
+  job_t *jobs;                /* queued and running jobs, in order of submission */
+  int nqueued;
+  uint64_t next_id;
+  int threads;                /* OpenMP threads of each job */
+  int chunk;
+} server_t;
+
+static server_t server = {
+  PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER,
+  NULL, 0, 1, 1, 1
+};
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void on_signal(int sig) {
+  (void)sig;
+  interrupted = 1;
+}
+
+/**
+ * Queued job to run next (lock held).
+ */
+static job_t *next_job(void) {
+  job_t *job, *best = NULL;
+  for (job = server.jobs; job != NULL; job = job->next) {
+    if (job->state == JOB_QUEUED && (best == NULL || job->priority > best->priority)) {
+      best = job;
+    }
+  }
+  return best;
+}
+
+/**
+ * Run a job and write its response: keys (one per line), or the candidates
+ * of each diagonal for a factored key space (one line for each diagonal).
+ */
+static void run_job(job_t *job, arena_t *arena) {
+  int d, i;
+  keyset_t keys;
+  factored_t factored = {0};
+  FILE *out = open_memstream(&job->response, &job->response_len);
+  double start = wall_time();
+
+  if (out == NULL || keyset_init(&keys, KEYSET_INITIAL) == -1) {
+    fprintf(stderr, "[!] Job %lu: cannot allocate memory\n", (unsigned long)job->id);
+    if (out != NULL) {
+      fprintf(out, "error cannot allocate memory\n");
+      fclose(out);
+    }
+    return;
+  }
+  factored.requested = job->factored;
+
+  fprintf(stderr, "[*] Job %lu started (%d pairs)\n", (unsigned long)job->id, job->npairs);
+  if (job->mode == DFA_ROUND_9) {
+    r9_key_recovery(job->pairs, job->npairs, arena, &job->known_pt, &keys, &factored, &job->ctl);
+  }
+  else if (job->mode == DFA_MIXED) {
+    mixed_key_recovery(job->pairs, job->npairs, arena, &job->known_pt, &keys, &factored, &job->ctl);
+  }
+  else {
+    r8_key_recovery(job->pairs, job->npairs, arena, NULL, NULL, &job->known_pt, &keys, &job->ctl);
+  }
+
+  if (job->ctl.stop) {
+    fprintf(out, "cancelled %lu\n", (unsigned long)job->id);
+  }
+  else {
+    if (factored.is_some) {
+      fprintf(out, "factored %lu\n", (unsigned long)factored_size(&factored));
+      for (d = 0; d < 4; d++) {
+        fprintf(out, "%d", factored.candidates_len[d]);
+        for (i = 0; i < factored.candidates_len[d]; i++) {
+          fprintf(out, " %08x", factored.candidates[d][i]);
+        }
+        fprintf(out, "\n");
+      }
+    }
+    else {
+      fprintf(out, "keys %zu\n", keyset_len(&keys));
+      write_keys_text(out, &keys);
+    }
+    fprintf(out, "done %lu\n", (unsigned long)job->id);
+  }
+  fclose(out);
+  fprintf(
+    stderr, "[*] Job %lu %s in %.3f s\n",
+    (unsigned long)job->id, job->ctl.stop ? "cancelled" : "done", wall_time() - start
+  );
+
+  factored_free(&factored);
+  keyset_free(&keys);
+}
+
+/**
+ * Worker: runs one job at a time with its own OpenMP team, which stays warm
+ * between jobs (as the tables of the kernels, built once).
+ * The arena is reset between jobs, so it is sized after the first ones.
+ */
+static void *worker_main(void *arg) {
+  job_t *job;
+  arena_t arena;
+
+  (void)arg;
+#ifdef _OPENMP
+  omp_set_num_threads(server.threads);
+  omp_set_schedule(omp_sched_dynamic, server.chunk);
+#endif
+  arena_init(&arena, 0);
+  for (;;) {
+    pthread_mutex_lock(&server.lock);
+    while ((job = next_job()) == NULL) {
+      pthread_cond_wait(&server.queued, &server.lock);
+    }
+    job->state = JOB_RUNNING;
+    server.nqueued--;
+    pthread_mutex_unlock(&server.lock);
+
+    run_job(job, &arena);
+    arena_reset(&arena);
+
+    pthread_mutex_lock(&server.lock);
+    job->state = JOB_DONE;
+    pthread_cond_broadcast(&server.finished);
+    pthread_mutex_unlock(&server.lock);
+  }
+  return NULL;
+}
+
+/**
+ * Cancel a job (lock held): a queued job is removed from the queue,
+ * a running job is stopped at its next check of the search control.
+ */
+static void cancel_job(job_t *job) {
+  if (job->state == JOB_QUEUED) {
+    job->state = JOB_DONE;
+    job->cancelled = true;
+    server.nqueued--;
+    pthread_cond_broadcast(&server.finished);
+  }
+  else if (job->state == JOB_RUNNING) {
+    job->cancelled = true;
+    __atomic_store_n(&job->ctl.stop, 1, __ATOMIC_RELAXED);
+  }
+}
+
+static bool client_gone(const int fd) {
+  char c;
+  struct pollfd pfd = {fd, POLLIN, 0};
+  if (poll(&pfd, 1, 0) <= 0) {
+    return false;
+  }
+  return (pfd.revents & (POLLHUP | POLLERR)) != 0
+    || recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+}
+
+/**
+ * Read the input data of a job, up to a line "end".
+ * Returns NULL if the connection is closed before, or as soon as the data
+ * is larger than DAEMON_INPUT_MAX (without waiting for the end).
+ */
+static char *read_input(FILE *in, size_t *len) {
+  char line[DAEMON_LINE_MAX];
+  char *data = NULL;
+  FILE *buf = open_memstream(&data, len);
+
+  if (buf == NULL) {
+    return NULL;
+  }
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (strcmp(line, "end\n") == 0 || strcmp(line, "end\r\n") == 0) {
+      fclose(buf);
+      return data;
+    }
+    fputs(line, buf);
+    /* the size is updated by fflush: stop as soon as the limit is passed */
+    if (fflush(buf) != 0 || *len > DAEMON_INPUT_MAX) {
+      break;
+    }
+  }
+  fclose(buf);
+  free(data);
+  return NULL;
+}
+
+/**
+ * Command "job <8|9|89> [priority=<n>] [factored]" followed by the input data
+ * and a line "end". The response starts with "queued <id>" then, when the job
+ * is done, the result followed by "done <id>" (or "cancelled <id>", or "error ...").
+ * The job is cancelled if the client disconnects before the end.
+ */
+static void handle_job(const int fd, FILE *in, FILE *out, char *line) {
+  char *tok, *saveptr;
+  char *data;
+  size_t len;
+  int err;
+  job_t *job, **prev;
+  FILE *fp;
+  struct timespec deadline;
+
+  job = calloc(1, sizeof(*job));
+  if (job == NULL) {
+    fprintf(out, "error cannot allocate memory\n");
+    return;
+  }
+  job->mode = -1;
+  strtok_r(line, " \r\n", &saveptr);
+  while ((tok = strtok_r(NULL, " \r\n", &saveptr)) != NULL) {
+    if (strcmp(tok, "8") == 0) {
+      job->mode = DFA_ROUND_8;
+    }
+    else if (strcmp(tok, "9") == 0) {
+      job->mode = DFA_ROUND_9;
+    }
+    else if (strcmp(tok, "89") == 0) {
+      job->mode = DFA_MIXED;
+    }
+    else if (strncmp(tok, "priority=", 9) == 0) {
+      job->priority = atoi(tok + 9);
+    }
+    else if (strcmp(tok, "factored") == 0) {
+      job->factored = true;
+    }
+    else {
+      job->mode = -2;
+    }
+  }
+
+  data = read_input(in, &len);
+  if (data == NULL) {
+    fprintf(out, "error input data missing or too large\n");
+    /* the rest of the data is not read: the connection ends here */
+    shutdown(fd, SHUT_RD);
+    free(job);
+    return;
+  }
+  if (job->mode < 0) {
+    fprintf(out, "error usage: job <8|9|89> [priority=<n>] [factored]\n");
+    free(data);
+    free(job);
+    return;
+  }
+  fp = fmemopen(data, len > 0 ? len : 1, "r");
+  err = fp == NULL ? -1 : read_pairs(fp, &job->pairs, &job->npairs, &job->known_pt);
+  if (fp != NULL) {
+    fclose(fp);
+  }
+  free(data);
+  if (err != 0 || job->npairs == 0) {
+    fprintf(out, "error %s\n", err != 0 ? "malformed input" : "no ciphertext pair");
+    if (err == 0) {
+      free(job->pairs);
+    }
+    free(job);
+    return;
+  }
+  job->npairs = select_pairs(job->pairs, job->npairs, job->mode);
+  if (job->npairs == 0) {
+    fprintf(out, "error no ciphertext pair for this round\n");
+    free(job->pairs);
+    free(job);
+    return;
+  }
+  if (search_ctl_init(&job->ctl, 0, false) != 0) {
+    fprintf(out, "error cannot allocate memory\n");
+    free(job->pairs);
+    free(job);
+    return;
+  }
+
+  /* queue the job */
+  pthread_mutex_lock(&server.lock);
+  if (server.nqueued >= DAEMON_QUEUE_MAX) {
+    pthread_mutex_unlock(&server.lock);
+    fprintf(out, "error queue full\n");
+    free(job->pairs);
+    free(job);
+    return;
+  }
+  job->id = server.next_id++;
+  for (prev = &server.jobs; *prev != NULL; prev = &(*prev)->next);
+  *prev = job;
+  server.nqueued++;
+  pthread_cond_signal(&server.queued);
+  pthread_mutex_unlock(&server.lock);
+  fprintf(stderr, "[*] Job %lu queued (priority %d)\n", (unsigned long)job->id, job->priority);
+  fprintf(out, "queued %lu\n", (unsigned long)job->id);
+  fflush(out);
+
+  /* wait for the job */
+  pthread_mutex_lock(&server.lock);
+  while (job->state != JOB_DONE) {
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += DAEMON_POLL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&server.finished, &server.lock, &deadline);
+    if (job->state != JOB_DONE && !job->cancelled && client_gone(fd)) {
+      fprintf(stderr, "[*] Job %lu: client disconnected\n", (unsigned long)job->id);
+      cancel_job(job);
+    }
+  }
+  for (prev = &server.jobs; *prev != job; prev = &(*prev)->next);
+  *prev = job->next;
+  pthread_mutex_unlock(&server.lock);
+
+  if (job->response != NULL) {
+    fwrite(job->response, 1, job->response_len, out);
+  }
+  else {
+    fprintf(out, "cancelled %lu\n", (unsigned long)job->id);
+  }
+  free(job->response);
+  search_ctl_free(&job->ctl);
+  free(job->pairs);
+  free(job);
+}
+
+/**
+ * Command "cancel <id>".
+ */
+static void handle_cancel(FILE *out, const char *line) {
+  job_t *job;
+  uint64_t id = strtoull(line + 7, NULL, 10);
+
+  pthread_mutex_lock(&server.lock);
+  for (job = server.jobs; job != NULL && job->id != id; job = job->next);
+  if (job != NULL && job->state != JOB_DONE) {
+    cancel_job(job);
+    fprintf(stderr, "[*] Job %lu cancelled\n", (unsigned long)id);
+    fprintf(out, "cancelled %lu\n", (unsigned long)id);
+  }
+  else {
+    fprintf(out, "error unknown job %lu\n", (unsigned long)id);
+  }
+  pthread_mutex_unlock(&server.lock);
+}
+
+/**
+ * Command "status": one line for each queued or running job, then "end".
+ */
+static void handle_status(FILE *out) {
+  job_t *job;
+  static const char *STATES[3] = {"queued", "running", "done"};
+
+  pthread_mutex_lock(&server.lock);
+  for (job = server.jobs; job != NULL; job = job->next) {
+    fprintf(
+      out, "job %lu %s priority=%d pairs=%d\n",
+      (unsigned long)job->id, STATES[job->state], job->priority, job->npairs
+    );
+  }
+  pthread_mutex_unlock(&server.lock);
+  fprintf(out, "end\n");
+}
+
+/**
+ * Connection of a client: commands are read line by line.
+ */
+static void *client_main(void *arg) {
+  int fd = (int)(intptr_t)arg;
+  int fd_out = dup(fd);
+  char line[DAEMON_LINE_MAX];
+  FILE *in = fdopen(fd, "r");
+  FILE *out = fd_out == -1 ? NULL : fdopen(fd_out, "w");
+
+  if (in == NULL || out == NULL) {
+    if (in != NULL) {
+      fclose(in);
+    }
+    else {
+      close(fd);
+    }
+    if (out != NULL) {
+      fclose(out);
+    }
+    else if (fd_out != -1) {
+      close(fd_out);
+    }
+    return NULL;
+  }
+
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (strncmp(line, "job", 3) == 0 && (line[3] == ' ' || line[3] == '\n' || line[3] == '\r')) {
+      handle_job(fd, in, out, line);
+    }
+    else if (strncmp(line, "cancel ", 7) == 0) {
+      handle_cancel(out, line);
+    }
+    else if (strncmp(line, "status", 6) == 0) {
+      handle_status(out);
+    }
+    else if (strncmp(line, "quit", 4) == 0) {
+      break;
+    }
+    else {
+      fprintf(out, "error unknown command (job, cancel, status or quit)\n");
+    }
+    if (fflush(out) != 0) {
+      break;
+    }
+  }
+  fclose(out);
+  fclose(in);
+  return NULL;
+}
+
+/**
+ * Listen on a Unix domain socket (created with the permissions of the user).
+ * Fails if another daemon already listens on it; a stale socket file is replaced.
+ */
+static int listen_socket(const char *path) {
+  int fd;
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "[!] Socket path too long\n");
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+    fprintf(stderr, "[!] A daemon is already listening on '%s'\n", path);
+    close(fd);
+    return -1;
+  }
+  close(fd);
+  unlink(path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(fd, 64) != 0) {
+    fprintf(stderr, "[!] Cannot listen on '%s': %s\n", path, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Run as a daemon on the Unix domain socket `path`: jobs (see handle_job)
+ * are queued by priority and run by `njobs` workers at most at once,
+ * each with `threads` OpenMP threads in total shared between the workers.
+ * Returns when interrupted (SIGINT or SIGTERM), or -1 on error.
+ */
+int daemon_run(const char *path, const int njobs, const int threads, const int chunk) {
+  int i, fd, client;
+  pthread_t tid;
+  pthread_attr_t attr;
+  struct sigaction sa;
+
+  fd = listen_socket(path);
+  if (fd == -1) {
+    return -1;
+  }
+
+  /* accept is interrupted by the signals (no SA_RESTART) */
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_signal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN);
+
+  server.threads = threads / njobs > 0 ? threads / njobs : 1;
+  server.chunk = chunk;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (i = 0; i < njobs; i++) {
+    if (pthread_create(&tid, &attr, worker_main, NULL) != 0) {
+      fprintf(stderr, "[!] Cannot create worker threads\n");
+      close(fd);
+      unlink(path);
+      return -1;
+    }
+  }
+  fprintf(
+    stderr, "[*] Listening on '%s' (%d jobs at once, %d threads each)\n",
+    path, njobs, server.threads
+  );
+
+  while (!interrupted) {
+    client = accept(fd, NULL, NULL);
+    if (client == -1) {
+      if (errno != EINTR) {
+        fprintf(stderr, "[!] Cannot accept connection: %s\n", strerror(errno));
+      }
+      continue;
+    }
+    if (pthread_create(&tid, &attr, client_main, (void *)(intptr_t)client) != 0) {
+      close(client);
+    }
+  }
+
+  fprintf(stderr, "[*] Daemon stopped\n");
+  pthread_attr_destroy(&attr);
+  close(fd);
+  unlink(path);
+  return 0;
+}
@@ -1,4 +1,6 @@
+#include <stdalign.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 #include "dfa.h"
 
@@ -28,7 +30,7 @@ const int POSITIONS[4][4] = {
  * - row: position of the fault value (in [0, 3] or -1 if unknown)
  * - fault_list: list of fault values (up to 255 different faults)
  * - fault_len: length of the previous list
- * - list_diff: delta-set (length is <= 255*4)
+ * - list_diff: delta-set (length is fault_len, or 4*fault_len if row is -1)
  *
  * output: length of the delta-set
  */
@@ -36,7 +38,7 @@ int get_diff_mc(
   const int row,
   const int fault_list[255],
   const int fault_len,
-  uint32_t list_diff[DIFF_MC_MAX]
+  uint32_t *list_diff
 ) {
   int i, pos;
   int list_diff_len = 0;
@@ -63,12 +65,20 @@ int get_diff_mc(
 /**
  * Calculate candidates of a diagonal for last round key with the delta-set.
  *
+ * For each of the four bytes, values of the key byte are first sorted
+ * by the difference they produce after inverse sbox (256 evaluations).
+ * The number of candidates is then known exactly before they are enumerated:
+ * the list is allocated in `arena` with this size.
+ *
  * inputs:
  * - pair: ciphertext pair
  * - col: column where the difference in round 9 is analyzed
  *        (see POSITIONS for the impacted diagonal in the ciphertext)
  * - diff_mc_list: the delta-set
  * - diff_mc_len: length of the delta-set
+ * - tables: tables of the correct ciphertext shared by its group of pairs
+ *           (see group_pairs), or NULL to compute them here
+ * - arena: where the list of candidates is allocated
  * - candidates: list of candidates for the corresponding diagonal of last round key
  *
  * output: number of candidates for the last round key diagonal
@@ -76,52 +86,83 @@ int get_diff_mc(
 int k10_cand_from_diff_mc(
   const pair_t *pair,
   const int col,
-  const uint32_t diff_mc_list[DIFF_MC_MAX],
+  const uint32_t *diff_mc_list,
   const int diff_mc_len,
-  uint32_t candidates[CAND_MAX]
+  const ct_tables_t *tables,
+  arena_t *arena,
+  uint32_t **candidates
 ) {
-  int i, k0, k1, k2, k3;
+  int b, i, k, i0, i1, i2, i3;
   int cand_len = 0;
-  uint8_t diff, good[4], faulty[4];
+  size_t total = 0;
+  uint8_t d[4], faulty;
+  uint8_t good[256];      /* invsbox[ct ^ k] */
+  const uint8_t *inv;
+  uint8_t diff[256];      /* difference after inverse sbox for each key byte */
+  uint8_t keys[4][256];   /* key bytes grouped by difference (in increasing order) */
+  int start[4][257];      /* keys[b][start[b][diff]] to keys[b][start[b][diff + 1] - 1] */
+  int hist[4][256];
+
+  PROFILE_BEGIN(PHASE_CANDIDATES);
+  for (b = 0; b < 4; b++) {
+    if (tables != NULL) {
+      inv = tables->inv[POSITIONS[col][b]];
+    }
+    else {
+      for (k = 0; k < 256; k++) {
+        good[k] = invsbox[pair->ct[POSITIONS[col][b]] ^ (uint8_t)k];
+      }
+      inv = good;
+    }
+    faulty = pair->fct[POSITIONS[col][b]];
+    memset(hist[b], 0, sizeof(hist[b]));
+    for (k = 0; k < 256; k++) {
+      diff[k] = inv[k] ^ invsbox[faulty ^ (uint8_t)k];
+      hist[b][diff[k]]++;
+    }
+    start[b][0] = 0;
+    for (k = 0; k < 256; k++) {
+      start[b][k + 1] = start[b][k] + hist[b][k];
+    }
+    for (k = 0; k < 256; k++) {
+      keys[b][start[b][diff[k]]++] = (uint8_t)k;
+    }
+    /* restore the start of each group */
+    for (k = 0; k < 256; k++) {
+      start[b][k] -= hist[b][k];
+    }
+  }
 
-  /* copy the 4 bytes of ct and fct that differ */
-  for (i = 0; i < 4; i++) {
-    good[i] = pair->ct[POSITIONS[col][i]];
-    faulty[i] = pair->fct[POSITIONS[col][i]];
+  /* exact number of candidates */
+  for (i = 0; i < diff_mc_len; i++) {
+    total += (size_t)hist[0][TAKEBYTE(diff_mc_list[i], 0)]
+      * hist[1][TAKEBYTE(diff_mc_list[i], 1)]
+      * hist[2][TAKEBYTE(diff_mc_list[i], 2)]
+      * hist[3][TAKEBYTE(diff_mc_list[i], 3)];
   }
+  *candidates = arena_alloc(arena, total * sizeof(uint32_t));
 
   /* construct list of quadruplets candidates: */
-  /* for each MC difference possible, find which (k0, k1, k2, k3) corresponds */
+  /* for each MC difference possible, combine key bytes giving this difference */
   for (i = 0; i < diff_mc_len; i++) {
-    for (k0 = 0; k0 < 256; k0++) {
-      diff = invsbox[good[0] ^ (uint8_t)k0] ^ invsbox[faulty[0] ^ (uint8_t)k0];
-      if (diff != TAKEBYTE(diff_mc_list[i], 0)) {
-        continue;
-      }
-      for (k1 = 0; k1 < 256; k1++) {
-        diff = invsbox[good[1] ^ (uint8_t)k1] ^ invsbox[faulty[1] ^ (uint8_t)k1];
-        if (diff != TAKEBYTE(diff_mc_list[i], 1)) {
-          continue;
-        }
-        for (k2 = 0; k2 < 256; k2++) {
-          diff = invsbox[good[2] ^ (uint8_t)k2] ^ invsbox[faulty[2] ^ (uint8_t)k2];
-          if (diff != TAKEBYTE(diff_mc_list[i], 2)) {
-            continue;
-          }
-          for (k3 = 0; k3 < 256; k3++) {
-            diff = invsbox[good[3] ^ (uint8_t)k3] ^ invsbox[faulty[3] ^ (uint8_t)k3];
-            if (diff != TAKEBYTE(diff_mc_list[i], 3)) {
-              continue;
-            }
-            candidates[cand_len++] = ((uint32_t)k3 << 24)
-              | ((uint32_t)k2 << 16)
-              | ((uint32_t)k1 << 8)
-              | (uint32_t)k0;
-          } /* end for k3 */
-        } /* end for k2 */
-      } /* end for k1 */
-    } /* end for k0 */
+    for (b = 0; b < 4; b++) {
+      d[b] = TAKEBYTE(diff_mc_list[i], b);
+    }
+    for (i0 = start[0][d[0]]; i0 < start[0][d[0]] + hist[0][d[0]]; i0++) {
+      for (i1 = start[1][d[1]]; i1 < start[1][d[1]] + hist[1][d[1]]; i1++) {
+        for (i2 = start[2][d[2]]; i2 < start[2][d[2]] + hist[2][d[2]]; i2++) {
+          for (i3 = start[3][d[3]]; i3 < start[3][d[3]] + hist[3][d[3]]; i3++) {
+            (*candidates)[cand_len++] = ((uint32_t)keys[3][i3] << 24)
+              | ((uint32_t)keys[2][i2] << 16)
+              | ((uint32_t)keys[1][i1] << 8)
+              | (uint32_t)keys[0][i0];
+          } /* end for i3 */
+        } /* end for i2 */
+      } /* end for i1 */
+    } /* end for i0 */
   } /* end for i */
+  PROFILE_COUNT(PROF_CANDIDATES, cand_len);
+  PROFILE_END(PHASE_CANDIDATES);
 
   return cand_len;
 }
@@ -145,46 +186,17 @@ void intersection(uint32_t *list1, int *len1, const uint32_t *list2, const int l
 }
 
 /**
- * Reconstruct the AES round keys from the last one
+ * Intersection of `n` lists, folded sequentially into the first one,
+ * which shrinks after each step (the loop stops once it is empty).
+ * Callers run one reduction per diagonal or column in parallel.
  */
-void reverse_key_expansion(const uint8_t subkey10[16], uint8_t subkeys[176]) {
+void intersection_reduce(uint32_t *lists[], int lens[], const int n) {
   int i;
-  for (i = 160; i < 176; i++) {
-    subkeys[i] = subkey10[i - 160];
-  }
-  for (i = 156; i >= 0; i -= 4) {
-    if (i % 16 == 0) {
-      subkeys[i] = subkeys[i + 16] ^ sbox[subkeys[i + 13]] ^ rcon[i >> 4];
-      subkeys[i + 1] = subkeys[i + 17] ^ sbox[subkeys[i + 14]];
-      subkeys[i + 2] = subkeys[i + 18] ^ sbox[subkeys[i + 15]];
-      subkeys[i + 3] = subkeys[i + 19] ^ sbox[subkeys[i + 12]];
-    }
-    else {
-      subkeys[i] = subkeys[i + 16] ^ subkeys[i + 12];
-      subkeys[i + 1] = subkeys[i + 17] ^ subkeys[i + 13];
-      subkeys[i + 2] = subkeys[i + 18] ^ subkeys[i + 14];
-      subkeys[i + 3] = subkeys[i + 19] ^ subkeys[i + 15];
-    }
+  for (i = 1; i < n && lens[0] > 0; i++) {
+    intersection(lists[0], &lens[0], lists[i], lens[i]);
   }
 }
 
-/**
- * Reconstruct the penultimate round key from the last one
- */
-void k9_from_k10(const uint8_t subkey10[16], uint8_t subkey9[16]) {
-  int i;
-  for (i = 12; i > 0; i -= 4) {
-    subkey9[i] = subkey10[i] ^ subkey10[i - 4];
-    subkey9[i + 1] = subkey10[i + 1] ^ subkey10[i - 3];
-    subkey9[i + 2] = subkey10[i + 2] ^ subkey10[i - 2];
-    subkey9[i + 3] = subkey10[i + 3] ^ subkey10[i - 1];
-  }
-  subkey9[0] = subkey10[0] ^ sbox[subkey9[13]] ^ rcon[9];
-  subkey9[1] = subkey10[1] ^ sbox[subkey9[14]];
-  subkey9[2] = subkey10[2] ^ sbox[subkey9[15]];
-  subkey9[3] = subkey10[3] ^ sbox[subkey9[12]];
-}
-
 /**
  * Run an exhaustive search of the last round key when the analysis is done.
  * If a known plaintext is provided, then the key is tested with an AES encryption.
@@ -193,78 +205,105 @@ void k9_from_k10(const uint8_t subkey10[16], uint8_t subkey9[16]) {
  * is small (e.g., two ciphertext pairs for each diagonal if the fault occurred in round 9,
  * or two ciphertext pairs if the fault occurred in round 8).
  *
- * This functions returns the number of keys.
+ * Keys are added to the set `keys` (duplicates are merged).
+ * The search stops early if requested through `ctl` (may be NULL).
+ * This functions returns the number of new distinct keys.
  */
 int exhaustive_search(
-  const uint32_t candidates[4][CAND_MAX],
+  uint32_t *const candidates[4],
   const int candidates_len[4],
   const known_pt_t *known_pt,
-  uint8_t masterkeys[KEYS_MAX][16]
+  const int hypothesis,
+  keyset_t *keys,
+  search_ctl_t *ctl
 ) {
-  int i, j, k, l;
-  uint8_t subkey10[16];
-  uint8_t subkeys[176];
-  uint8_t ctcmp[16];
   int found = 0;
-  int nkeys = 0;
+  int nkeys;
+  /* stop at the first key only if no other one can match the plaintexts */
+  const bool unique = known_pt_unique(known_pt);
+  results_t results;
+
+  results_init(&results);
 
 #ifdef _OPENMP
-#pragma omp parallel for private(subkey10,subkeys,ctcmp,j,k,l) shared(found,nkeys)
+#pragma omp parallel shared(found)
 #endif
-  for (i = 0; i < candidates_len[0]; i++) {
-    if (found) {
-      /* abort search for each thread */
-      continue;
+  {
+    int i, j, k, l;
+    int tid = thread_num();
+    uint64_t ordinal;
+    __m128i k01, k012;
+    placed_t subkey10;
+    alignas(16) uint8_t subkeys[176];
+    /* last round keys of the last diagonal and their master keys (without known plaintext) */
+    uint8_t *batch10 = NULL;
+    uint8_t *batch0 = NULL;
+    const kernel_t *kernel = kernel_current();
+    /* placed candidates, on the NUMA node of the thread */
+    placed_t *cand[4];
+    place_candidates(candidates, candidates_len, cand);
+    if (!known_pt->is_some) {
+      batch10 = malloc(32 * (size_t)candidates_len[3] + 1);
+      if (batch10 == NULL) {
+        fprintf(stderr, "[!] Cannot allocate candidates\n");
+        exit(EXIT_FAILURE);
+      }
+      batch0 = batch10 + 16 * (size_t)candidates_len[3];
     }
-    subkey10[0]  = TAKEBYTE(candidates[0][i], 0);
-    subkey10[13] = TAKEBYTE(candidates[0][i], 1);
-    subkey10[10] = TAKEBYTE(candidates[0][i], 2);
-    subkey10[7]  = TAKEBYTE(candidates[0][i], 3);
+    PROFILE_BEGIN(PHASE_EXHAUSTIVE);
 
-    for (j = 0; j < candidates_len[1]; j++) {
-      subkey10[4]  = TAKEBYTE(candidates[1][j], 0);
-      subkey10[1]  = TAKEBYTE(candidates[1][j], 1);
-      subkey10[14] = TAKEBYTE(candidates[1][j], 2);
-      subkey10[11] = TAKEBYTE(candidates[1][j], 3);
+#ifdef _OPENMP
+#pragma omp for schedule(runtime)
+#endif
+    for (i = 0; i < candidates_len[0]; i++) {
+      if (found || search_should_stop(ctl)) {
+        /* abort search for each thread */
+        continue;
+      }
+      for (j = 0; j < candidates_len[1]; j++) {
+        k01 = _mm_or_si128(cand[0][i].v, cand[1][j].v);
 
-      for (k = 0; k < candidates_len[2]; k++) {
-        subkey10[8]  = TAKEBYTE(candidates[2][k], 0);
-        subkey10[5]  = TAKEBYTE(candidates[2][k], 1);
-        subkey10[2]  = TAKEBYTE(candidates[2][k], 2);
-        subkey10[15] = TAKEBYTE(candidates[2][k], 3);
+        for (k = 0; k < candidates_len[2]; k++) {
+          k012 = _mm_or_si128(k01, cand[2][k].v);
 
-        for (l = 0; l < candidates_len[3]; l++) {
-          subkey10[12] = TAKEBYTE(candidates[3][l], 0);
-          subkey10[9]  = TAKEBYTE(candidates[3][l], 1);
-          subkey10[6]  = TAKEBYTE(candidates[3][l], 2);
-          subkey10[3]  = TAKEBYTE(candidates[3][l], 3);
+          PROFILE_COUNT(PROF_EXHAUSTIVE_KEYS, candidates_len[3]);
+          PROFILE_COUNT(PROF_KEY_EXPANSION, candidates_len[3]);
+          ordinal = (((uint64_t)i*candidates_len[1] + j)*candidates_len[2] + k)*candidates_len[3];
 
-          reverse_key_expansion(subkey10, subkeys);
-          if (known_pt->is_some) {
-            encrypt_aes(known_pt->pt, ctcmp, subkeys);
-            if (memcmp(known_pt->ct, ctcmp, 16) == 0) {
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-              {
-                memcpy(masterkeys[nkeys], subkeys, 16);
-                found = 1;
-                nkeys = 1;
-              }
+          /* without known plaintext, only master keys are needed: derived in a batch */
+          if (!known_pt->is_some) {
+            for (l = 0; l < candidates_len[3]; l++) {
+              __builtin_prefetch(&cand[3][l + PLACED_PREFETCH]);
+              _mm_storeu_si128((__m128i *)(batch10 + 16*l), _mm_or_si128(k012, cand[3][l].v));
             }
-          }
-          else {
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-            {
-              memcpy(masterkeys[nkeys], subkeys, 16);
-              nkeys++;
+            kernel->key_inverse(batch10, batch0, candidates_len[3], 0);
+            for (l = 0; l < candidates_len[3]; l++) {
+              results_push(&results, tid, ordinal + l, batch0 + 16*l);
             }
+            continue;
           }
-        } /* end for l */
-      } /* end for k */
-    } /* end for j */
-  } /* end for i */
+
+          for (l = 0; l < candidates_len[3]; l++) {
+            __builtin_prefetch(&cand[3][l + PLACED_PREFETCH]);
+            subkey10.v = _mm_or_si128(k012, cand[3][l].v);
+            reverse_key_expansion(subkey10.b, subkeys);
+            PROFILE_COUNT(PROF_PT_CHECKED, 1);
+            if (known_pt_check(known_pt, subkeys)) {
+              PROFILE_COUNT(PROF_PT_MATCH, 1);
+              results_push(&results, tid, ordinal + l, subkeys);
+              found = unique;
+            }
+          } /* end for l */
+        } /* end for k */
+      } /* end for j */
+    } /* end for i */
+    PROFILE_END(PHASE_EXHAUSTIVE);
+    free(cand[0]);
+    free(batch10);
+  }
+
+  /* merge per-thread buffers in the order of the sequential search */
+  nkeys = results_merge(&results, keys, hypothesis);
+  results_free(&results);
   return nkeys;
 }
@@ -1,36 +1,14 @@
 #include <stdalign.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
-#include <wmmintrin.h>
 #include "dfa.h"
 
 #ifdef _OPENMP
 #include "omp.h"
 #endif
 
-/**
- * Table look-up to find if a byte contains a single bit.
- */
-static uint8_t BITFLIP[256] = {
-  0, 1, 1, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0,
-  1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-};
-
 /**
  * Calculate the delta-set for a specific column in round 9.
  *
@@ -45,6 +23,7 @@ static uint8_t BITFLIP[256] = {
  * - col9: column of round 9, useful only to know which row is affected
  *         when the fault position in round 8 is known
  * - diff_col: output of mix column of the specific fault in round 8 if known
+ * - arena: where the delta-set is allocated
  * - diff_mc_list: the delta-set
  *
  * output: length of the delta-set
@@ -53,7 +32,8 @@ static int r8_get_diff_mc(
   const int col8,
   const int col9,
   const uint32_t diff_col,
-  uint32_t diff_mc_list[DIFF_MC_MAX]
+  arena_t *arena,
+  uint32_t **diff_mc_list
 ) {
   int i, c1, c2, diff, len;
   int fault_list[255];
@@ -86,17 +66,22 @@ static int r8_get_diff_mc(
   }
 
   /* construct the delta-set */
-  len = get_diff_mc(row9, fault_list, fault_list_len, diff_mc_list);
+  *diff_mc_list = arena_alloc(arena, (row9 == -1 ? 4 : 1) * fault_list_len * sizeof(uint32_t));
+  len = get_diff_mc(row9, fault_list, fault_list_len, *diff_mc_list);
 
   return len;
 }
 
 /**
  * Calculate candidates for a ciphertext pair.
+ * The four diagonals are processed as OpenMP tasks.
+ * Results are loaded from the cache if the same pair and hypothesis were already analyzed.
  *
  * inputs:
  * - pair: ciphertext pair
  * - row8 and col8: position of the fault in round 8 if known
+ * - tables: tables of the correct ciphertext (see group_pairs), may be NULL
+ * - arena: where the delta-sets and the lists are allocated
  * - candidates: lists of candidates for each diagonal of the last round key
  * - candidates_len: lengths of each list of candidates
  */
@@ -104,13 +89,21 @@ static void r8_find_candidates(
   const pair_t *pair,
   const int row8,
   const int col8,
-  uint32_t candidates[4][CAND_MAX],
+  const ct_tables_t *tables,
+  arena_t *arena,
+  uint32_t *candidates[4],
   int candidates_len[4]
 ) {
   uint8_t tmp[4] = {0, 0, 0, 0};
-  int col9, len;
-  uint32_t diff_mc_list[DIFF_MC_MAX];
+  int col9;
   uint32_t diff_col = 0;
+  cache_key_t key;
+
+  /* results from a previous run */
+  cache_key_pair(&key, CACHE_R8_CANDIDATES, pair, row8, col8);
+  if (cache_load_lists(&key, arena, candidates, candidates_len, 4, NULL) == 0) {
+    return;
+  }
 
   /* fault position and value known (used to reduce the delta-set) */
   if (row8 != -1 && col8 != -1 && pair->fault_value != -1) {
@@ -119,10 +112,41 @@ static void r8_find_candidates(
     diff_col = BYTES_TO_WORD(tmp);
   }
 
-  /* get delta-set for each column in round 9, then get candidates for corresponding diagonals */
+  /* get delta-set for each column in round 9, then get candidates for corresponding diagonals
+   * (one task for each diagonal when called in a parallel region) */
+#ifdef _OPENMP
+#pragma omp taskloop grainsize(1) firstprivate(diff_col)
+#endif
   for (col9 = 0; col9 < 4; col9++) {
-    len = r8_get_diff_mc(col8, col9, diff_col, diff_mc_list);
-    candidates_len[col9] = k10_cand_from_diff_mc(pair, col9, diff_mc_list, len, candidates[col9]);
+    uint32_t *diff_mc_list;
+    int len = r8_get_diff_mc(col8, col9, diff_col, arena, &diff_mc_list);
+    candidates_len[col9] = k10_cand_from_diff_mc(
+      pair, col9, diff_mc_list, len, tables, arena, &candidates[col9]
+    );
+  }
+
+  cache_store_lists(&key, candidates, candidates_len, 4, 0);
+}
+
+/**
+ * Reduce candidates with candidates obtained independently
+ * (e.g., from ciphertext pairs with a fault in round 9).
+ * Diagonals where the length of `known_cand` is -1 are left unchanged.
+ */
+static void r8_restrict_candidates(
+  uint32_t *const candidates[4],
+  int candidates_len[4],
+  uint32_t *const known_cand[4],
+  const int known_cand_len[4]
+) {
+  int i;
+  if (known_cand == NULL) {
+    return;
+  }
+  for (i = 0; i < 4; i++) {
+    if (known_cand_len[i] != -1) {
+      intersection(candidates[i], &candidates_len[i], known_cand[i], known_cand_len[i]);
+    }
   }
 }
 
@@ -143,193 +167,350 @@ static void r8_find_candidates(
  * shoud be very close to one.
  *
  * If a known plaintext/ciphertext is known, the key will be tested with an encryption.
+ * Surviving keys are added to `keys` with the identifier `hypothesis`,
+ * and the number of new distinct keys is returned.
+ *
+ * The innermost loop (candidates of diagonal 3) is run by the kernels
+ * selected for the CPU (see kernel.c). Candidates of diagonal 0 are
+ * distributed with the OpenMP runtime schedule (dynamic, see tune.c),
+ * so the part searched when stopped at a deadline stays a prefix.
+ *
+ * With a search control `ctl` (may be NULL), keys are streamed as they are found
+ * (if `stream` is set) and the search stops at the deadline or when stopped
+ * through `ctl` (e.g., a cancelled job of the daemon); this is checked before each
+ * candidate of diagonal 1, and `done[i]` (if not NULL) receives the number of
+ * candidates of diagonal 1 fully searched with the candidate i of diagonal 0.
  */
 static int r8_exhaustive_search(
   const pair_t *pair,
   const int row8,
   const int col8,
-  const uint32_t candidates[4][CAND_MAX],
+  uint32_t *const candidates[4],
   const int candidates_len[4],
   const known_pt_t *known_pt,
-  uint8_t masterkeys[][16]
+  const int hypothesis,
+  keyset_t *keys,
+  search_ctl_t *ctl,
+  const bool stream,
+  int *done
 ) {
-  int i, j, k, l, ii;
+  int i, j, k, l, s, n, tid;
   int found = 0;
-  int nkeys = 0;
-  int row = row8;
-  alignas(16) uint32_t diff32[4];
-  uint32_t masks[4] = {0xffffff00, 0xffff00ff, 0xff00ffff, 0x00ffffff};
-  uint8_t subkey10[16];
-  alignas(16) uint8_t subkey9[16];
-  uint8_t subkeys[176];
-  alignas(16) uint8_t cttmp[16];
-  alignas(16) uint8_t fcttmp[16];
-  alignas(16) uint8_t ctcmp[16];
+  int nkeys;
+  /* stop at the first key only if no other one can match the plaintexts */
+  const bool unique = known_pt_unique(known_pt);
+  int *survivors;
+  uint64_t ordinal;
+  __m128i k01;
+  placed_t base, subkey10;
+  alignas(16) uint8_t subkeys[176];
+  placed_t *cand[4];
+  results_t results;
+  r8_filter_t filter;
+  const kernel_t *kernel = kernel_current();
+
+  memcpy(filter.ct, pair->ct, 16);
+  memcpy(filter.fct, pair->fct, 16);
+  filter.row8 = row8;
+  filter.col8 = col8;
+  filter.fault_value = pair->fault_value;
+  filter.bitflip = pair->bitflip;
+
+  results_init(&results);
 
 #ifdef _OPENMP
-#pragma omp parallel for firstprivate(row,masks) private(j,k,l,ii,subkey10,subkey9,subkeys,cttmp,fcttmp,ctcmp,diff32) shared(found,nkeys)
+#pragma omp parallel private(i,j,k,l,s,n,tid,ordinal,cand,survivors,k01,base,subkey10,subkeys) \
+  shared(found)
 #endif
-  for (i = 0; i < candidates_len[0]; i++) {
-    if (found) {
-      /* abort search for each threads */
-      continue;
+  {
+    tid = thread_num();
+    /* placed candidates, on the NUMA node of the thread */
+    place_candidates(candidates, candidates_len, cand);
+    survivors = malloc(candidates_len[3] * sizeof(int) + 1);
+    if (survivors == NULL) {
+      fprintf(stderr, "[!] Cannot allocate candidates\n");
+      exit(EXIT_FAILURE);
     }
-    subkey10[0]  = TAKEBYTE(candidates[0][i], 0);
-    subkey10[13] = TAKEBYTE(candidates[0][i], 1);
-    subkey10[10] = TAKEBYTE(candidates[0][i], 2);
-    subkey10[7]  = TAKEBYTE(candidates[0][i], 3);
-
-    for (j = 0; j < candidates_len[1]; j++) {
-      subkey10[4]  = TAKEBYTE(candidates[1][j], 0);
-      subkey10[1]  = TAKEBYTE(candidates[1][j], 1);
-      subkey10[14] = TAKEBYTE(candidates[1][j], 2);
-      subkey10[11] = TAKEBYTE(candidates[1][j], 3);
-
-      for (k = 0; k < candidates_len[2]; k++) {
-        subkey10[8]  = TAKEBYTE(candidates[2][k], 0);
-        subkey10[5]  = TAKEBYTE(candidates[2][k], 1);
-        subkey10[2]  = TAKEBYTE(candidates[2][k], 2);
-        subkey10[15] = TAKEBYTE(candidates[2][k], 3);
-
-        for (l = 0; l < candidates_len[3]; l++) {
-          subkey10[12] = TAKEBYTE(candidates[3][l], 0);
-          subkey10[9]  = TAKEBYTE(candidates[3][l], 1);
-          subkey10[6]  = TAKEBYTE(candidates[3][l], 2);
-          subkey10[3]  = TAKEBYTE(candidates[3][l], 3);
-
-          k9_from_k10(subkey10, subkey9);
-
-          /* xor last round key (optimized as vpxor by the compiler) */
-          for (ii = 0; ii < 16; ii++) {
-            cttmp[ii]  = pair->ct[ii]  ^ subkey10[ii];
-            fcttmp[ii] = pair->fct[ii] ^ subkey10[ii];
-          }
+    PROFILE_BEGIN(PHASE_R8_FILTER);
 
-          /* decrypt last round */
-          __m128i k = _mm_load_si128((const __m128i *)subkey9);
-          k = _mm_aesimc_si128(k);
-          __m128i x = _mm_load_si128((const __m128i *)cttmp);
-          __m128i y = _mm_load_si128((const __m128i *)fcttmp);
-          x = _mm_aesdec_si128(x, k);
-          y = _mm_aesdec_si128(y, k);
-
-          /* decrypt round 9 */
-          x = _mm_aesdec_si128(x, k);
-          y = _mm_aesdec_si128(y, k);
-
-          /* xor of states of ciphertext pair before mix column in round 8 */
-          x = _mm_xor_si128(x, y);
-          _mm_store_si128((__m128i *)diff32, x);
-
-          /* first filter: the column must have a single non-null byte */
-          /* case fault position known */
-          if (row8 != -1) {
-            if ((diff32[col8] & masks[row8]) != 0) {
-              continue;
-            }
-          }
-          /* case fault position unknown */
-          else {
-            if ((diff32[col8] & masks[0]) == 0) {
-              row = 0;
-            }
-            else if ((diff32[col8] & masks[1]) == 0) {
-              row = 1;
-            }
-            else if ((diff32[col8] & masks[2]) == 0) {
-              row = 2;
-            }
-            else if ((diff32[col8] & masks[3]) == 0) {
-              row = 3;
-            }
-            else {
-              continue;
-            }
-          }
+#ifdef _OPENMP
+#pragma omp for schedule(runtime)
+#endif
+    for (i = 0; i < candidates_len[0]; i++) {
+      if (found || search_should_stop(ctl)) {
+        /* abort search for each threads */
+        continue;
+      }
+      for (j = 0; j < candidates_len[1]; j++) {
+        if (j > 0 && search_should_stop(ctl)) {
+          break;
+        }
+        k01 = _mm_or_si128(cand[0][i].v, cand[1][j].v);
 
-          /* second filter: the non-null byte must correspond to the fault (if known) */
-          if (pair->fault_value != -1) {
-            if (((int)(diff32[col8] >> row*8) & 0xff) != pair->fault_value) {
-              continue;
-            }
-          }
-          else if (pair->bitflip == true) {
-            if (BITFLIP[(diff32[col8] >> row*8) & 0xff] == 0) {
-              continue;
-            }
-          }
+        for (k = 0; k < candidates_len[2]; k++) {
+          base.v = _mm_or_si128(k01, cand[2][k].v);
+
+          /* decryption of rounds 10 and 9, then filters (see kernel.h) */
+          n = kernel->r8_filter(&filter, &base, cand[3], candidates_len[3], survivors);
+          PROFILE_COUNT(PROF_R8_KEYS, candidates_len[3]);
+          PROFILE_COUNT(PROF_R8_FAULT, n);
+          PROFILE_COUNT(PROF_KEY_EXPANSION, n);
 
           /* very few candidates expected to reach this place */
-          reverse_key_expansion(subkey10, subkeys);
-          if (known_pt->is_some) {
-            encrypt_aes(known_pt->pt, ctcmp, subkeys);
-            if (memcmp(known_pt->ct, ctcmp, 16) == 0) {
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-              {
-                memcpy(masterkeys[nkeys], subkeys, 16);
-                found = 1;
-                nkeys = 1;
+          for (s = 0; s < n; s++) {
+            l = survivors[s];
+            subkey10.v = _mm_or_si128(base.v, cand[3][l].v);
+            ordinal = (((uint64_t)i*candidates_len[1] + j)*candidates_len[2] + k)*candidates_len[3] + l;
+            if (known_pt->is_some) {
+              reverse_key_expansion(subkey10.b, subkeys);
+              PROFILE_COUNT(PROF_PT_CHECKED, 1);
+              if (known_pt_check(known_pt, subkeys)) {
+                PROFILE_COUNT(PROF_PT_MATCH, 1);
+                results_push(&results, tid, ordinal, subkeys);
+                if (stream) {
+                  search_stream_key(ctl, subkeys);
+                }
+                found = unique;
               }
             }
-          }
-          else {
-#ifdef _OPENMP
-#pragma omp critical
-#endif
-            {
-              memcpy(masterkeys[nkeys], subkeys, 16);
-              nkeys++;
+            else {
+              /* master key only */
+              kernel->key_inverse(subkey10.b, subkeys, 1, 0);
+              results_push(&results, tid, ordinal, subkeys);
+              if (stream) {
+                search_stream_key(ctl, subkeys);
+              }
             }
           }
-        } /* end for l */
-      } /* end for k */
-    } /* end for j */
-  } /* end for i */
+        } /* end for k */
+        if (done != NULL) {
+          done[i] = j + 1;
+        }
+      } /* end for j */
+    } /* end for i */
+    PROFILE_END(PHASE_R8_FILTER);
+    free(cand[0]);
+    free(survivors);
+  }
+
+  /* merge per-thread buffers in the order of the sequential search */
+  nkeys = results_merge(&results, keys, hypothesis);
+  results_free(&results);
 
   return nkeys;
 }
 
 /**
- * Main function for key recovery with a single ciphertext pair
- * with a fault in round 8.
- *
- * Run the analysis to find candidates for each diagonal, then run
- * an exhaustive search with filtering, with or without a known plaintext.
+ * Filtering with a fault in round 8 on given candidates
+ * (fault in column `col8`, on row `row8` if known), e.g. for calibration.
  */
-static int r8_key_recovery_single_ct(
+int r8_search(
   const pair_t *pair,
   const int row8,
   const int col8,
+  uint32_t *const candidates[4],
+  const int candidates_len[4],
   const known_pt_t *known_pt,
-  uint8_t masterkeys[][16]
+  keyset_t *keys
 ) {
-  int i;
-  int candidates_len[4];
+  return r8_exhaustive_search(
+    pair, row8, col8, candidates, candidates_len, known_pt, HYPOTHESIS(col8, 0), keys, NULL, false, NULL
+  );
+}
+
+/**
+ * Filtering with the cache enabled: keys that pass the filtering
+ * (before any plaintext validation) are saved, so a later run on the same
+ * pair and hypothesis (e.g., with a known plaintext added) only checks them.
+ * A search stopped at the deadline is not saved.
+ */
+static int r8_cached_search(
+  const pair_t *pair,
+  const int row8,
+  const int col8,
+  uint32_t *const candidates[4],
+  const int candidates_len[4],
+  const known_pt_t *known_pt,
+  const int hypothesis,
+  keyset_t *keys,
+  search_ctl_t *ctl,
+  int *done
+) {
+  long i, n;
   int nkeys = 0;
-  long nb_cand;
-  uint32_t candidates[4][CAND_MAX];
+  uint8_t (*survivors)[16] = NULL;
+  alignas(16) uint8_t subkeys[176];
+  known_pt_t no_pt = {.is_some = false};
+  keyset_t filtered;
+  cache_key_t key;
+
+  cache_key_pair(&key, CACHE_R8_FILTER, pair, row8, col8);
+  cache_key_candidates(&key, candidates, candidates_len);
+  n = cache_load_keys(&key, &survivors);
+
+  if (n >= 0) {
+    fprintf(stderr, "[*] Filtering results loaded from cache (%ld keys)\n", n);
+    for (i = 0; done != NULL && i < candidates_len[0]; i++) {
+      done[i] = candidates_len[1];
+    }
+  }
+  else {
+    /* all keys consistent with the fault, without plaintext */
+    if (keyset_init(&filtered, KEYSET_INITIAL) == -1) {
+      fprintf(stderr, "[!] Cannot allocate the key set\n");
+      exit(EXIT_FAILURE);
+    }
+    /* keys are only streamed after the plaintext validation */
+    r8_exhaustive_search(
+      pair, row8, col8, candidates, candidates_len, &no_pt, hypothesis, &filtered, ctl, false, done
+    );
+    n = (long)keyset_len(&filtered);
+    survivors = malloc(n * 16 + 1);
+    if (survivors == NULL) {
+      fprintf(stderr, "[!] Cannot allocate keys\n");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < n; i++) {
+      memcpy(survivors[i], keyset_get(&filtered, i), 16);
+    }
+    if (filtered.overflow == 0 && !(ctl != NULL && ctl->stop)) {
+      cache_store_keys(&key, (const uint8_t (*)[16])survivors, n);
+    }
+    keyset_free(&filtered);
+  }
 
-  /* get candidates for each diagonal of last round key */
-  r8_find_candidates(pair, row8, col8, candidates, candidates_len);
-  nb_cand = 1;
+  if (keyset_reserve(keys, n) == -1) {
+    fprintf(stderr, "[!] Cannot grow the key set\n");
+  }
+  for (i = 0; i < n; i++) {
+    if (known_pt->is_some) {
+      key_expansion(survivors[i], subkeys);
+      if (!known_pt_check(known_pt, subkeys)) {
+        continue;
+      }
+    }
+    nkeys += keyset_insert(keys, survivors[i], hypothesis) == 1;
+    search_stream_key(ctl, survivors[i]);
+  }
+  free(survivors);
+  return nkeys;
+}
+
+/**
+ * Hypotheses on the fault of a single ciphertext pair with a fault in round 8
+ * (at most R8_HYPOTHESES_MAX): each column if the position is unknown,
+ * and each bit if the fault is a bitflip at a known position.
+ * Returns the number of hypotheses.
+ */
+int r8_hypotheses(const pair_t *pair, r8_hypothesis_t hyps[R8_HYPOTHESES_MAX]) {
+  int bit, col8;
+  int col8_start = 0;
+  int col8_end = 4;
+  int nhyp = 0;
+
+  if (pair->fault_pos >= 0 && pair->fault_pos < 16) {
+    col8_start = pair->fault_pos / 4;
+    col8_end = col8_start + 1;
+  }
+
+  memset(hyps, 0, R8_HYPOTHESES_MAX * sizeof(*hyps));
+  /* if fault is a bitflip (position known), the analysis is run 8 times
+   * with each bitflip possible considered as a fault value:
+   * should reduce by half compared to an unknown fault value
+   */
+  for(col8 = col8_start; col8 < col8_end; col8++) {
+    if (pair->bitflip == true && pair->fault_pos != -1) {
+      for (bit = 0; bit < 8; bit++) {
+        hyps[nhyp].col8 = col8;
+        hyps[nhyp].fault_value = 1 << bit;
+        hyps[nhyp].id = HYPOTHESIS(col8, bit);
+        nhyp++;
+      }
+    }
+    else {
+      hyps[nhyp].col8 = col8;
+      hyps[nhyp].fault_value = pair->fault_value;
+      hyps[nhyp].id = HYPOTHESIS(col8, 0);
+      nhyp++;
+    }
+  }
+  return nhyp;
+}
+
+/**
+ * Get candidates for each diagonal of last round key under a hypothesis
+ * (allocated in `arena`).
+ */
+void r8_hypothesis_candidates(
+  const pair_t *pair,
+  const int row8,
+  uint32_t *const known_cand[4],
+  const int known_cand_len[4],
+  arena_t *arena,
+  r8_hypothesis_t *hyp
+) {
+  int i;
+  pair_t hpair = *pair;
+
+  hpair.fault_value = hyp->fault_value;
+#ifdef _OPENMP
+#pragma omp parallel
+#pragma omp single
+#endif
+  r8_find_candidates(&hpair, row8, hyp->col8, NULL, arena, hyp->candidates, hyp->candidates_len);
+  r8_restrict_candidates(hyp->candidates, hyp->candidates_len, known_cand, known_cand_len);
+  hyp->nb_cand = 1;
   for (i = 0; i < 4; i++) {
-    nb_cand *= (long)candidates_len[i];
+    hyp->nb_cand *= (long)hyp->candidates_len[i];
   }
+}
+
+/**
+ * Hypotheses with a known fault value first, then smallest products of candidates
+ * first: those are searched the fastest and give the fewest keys.
+ */
+static int cmp_hypotheses(const void *a, const void *b) {
+  const r8_hypothesis_t *x = a;
+  const r8_hypothesis_t *y = b;
+  if ((x->fault_value == -1) != (y->fault_value == -1)) {
+    return x->fault_value == -1 ? 1 : -1;
+  }
+  if (x->nb_cand != y->nb_cand) {
+    return x->nb_cand < y->nb_cand ? -1 : 1;
+  }
+  return x->id - y->id;
+}
+
+/**
+ * Main function for key recovery with a single ciphertext pair
+ * with a fault in round 8 (under hypothesis `hyp`, candidates already computed).
+ *
+ * Run an exhaustive search with filtering, with or without a known plaintext.
+ */
+static int r8_key_recovery_single_ct(
+  const pair_t *pair,
+  const int row8,
+  r8_hypothesis_t *hyp,
+  const known_pt_t *known_pt,
+  keyset_t *keys,
+  search_ctl_t *ctl
+) {
+  int nkeys = 0;
+  pair_t hpair = *pair;
 
-  if (pair->fault_value != -1) {
+  hpair.fault_value = hyp->fault_value;
+  if (hyp->fault_value != -1) {
     fprintf(
       stderr,
       "[*] Hypothesis: fault in column %d and fault is '0x%02x'\n",
-      col8, pair->fault_value
+      hyp->col8, hyp->fault_value
     );
   }
   else {
-    fprintf(stderr, "[*] Hypothesis: fault in column %d and fault is unknown\n", col8);
+    fprintf(stderr, "[*] Hypothesis: fault in column %d and fault is unknown\n", hyp->col8);
   }
 
-  print_number_candidates(candidates_len, nb_cand);
+  print_number_candidates(hyp->candidates_len, hyp->nb_cand);
   if (known_pt->is_some) {
     fprintf(stderr, "[*] Filtering (followed by known plaintext validation)\n");
   }
@@ -338,9 +519,17 @@ static int r8_key_recovery_single_ct(
   }
 
   /* final search */
-  if (nb_cand > 0) {
+  hyp->started = true;
+  if (hyp->nb_cand > 0 && cache_enabled()) {
+    nkeys = r8_cached_search(
+      &hpair, row8, hyp->col8, hyp->candidates, hyp->candidates_len,
+      known_pt, hyp->id, keys, ctl, hyp->done
+    );
+  }
+  else if (hyp->nb_cand > 0) {
     nkeys = r8_exhaustive_search(
-      pair, row8, col8, candidates, candidates_len, known_pt, &masterkeys[nkeys]
+      &hpair, row8, hyp->col8, hyp->candidates, hyp->candidates_len,
+      known_pt, hyp->id, keys, ctl, true, hyp->done
     );
   }
 
@@ -349,60 +538,352 @@ static int r8_key_recovery_single_ct(
   return nkeys;
 }
 
+/**
+ * Print the candidates i of diagonal 0 such that `done[i]` is (or is not, if `negate`)
+ * equal to `value`, as ranges of indices.
+ */
+static void print_ranges(const char *what, const int *done, const int len, const int value, const bool negate) {
+  int i, start;
+  bool first = true;
+
+  for (i = 0; i < len; i++) {
+    if ((done[i] == value) == negate) {
+      continue;
+    }
+    start = i;
+    while (i + 1 < len && (done[i + 1] == value) != negate) {
+      i++;
+    }
+    if (first) {
+      fprintf(stderr, "[*]     %s:", what);
+      first = false;
+    }
+    if (start == i) {
+      fprintf(stderr, " %d", start);
+    }
+    else {
+      fprintf(stderr, " %d-%d", start, i);
+    }
+  }
+  if (!first) {
+    fprintf(stderr, "\n");
+  }
+}
+
+/**
+ * Report which parts of the key space of each hypothesis have been searched
+ * (search stopped at the deadline).
+ *
+ * The space of a hypothesis is split in slabs, one for each candidate i of diagonal 0;
+ * a slab is searched in order of the candidates of diagonal 1, so each slab
+ * is complete, partial (first candidates of diagonal 1) or not searched.
+ */
+static void r8_print_coverage(const r8_hypothesis_t *hyps, const int nhyp) {
+  int h, i;
+  long searched, slab;
+  const r8_hypothesis_t *hyp;
+
+  fprintf(stderr, "[*] Coverage of the key space:\n");
+  for (h = 0; h < nhyp; h++) {
+    hyp = &hyps[h];
+    if (hyp->fault_value != -1) {
+      fprintf(stderr, "[*]   column %d, fault '0x%02x': ", hyp->col8, hyp->fault_value);
+    }
+    else {
+      fprintf(stderr, "[*]   column %d, fault unknown: ", hyp->col8);
+    }
+
+    if (hyp->nb_cand < 0) {
+      fprintf(stderr, "not searched (candidates not computed)\n");
+      continue;
+    }
+    searched = 0;
+    slab = (long)hyp->candidates_len[2] * hyp->candidates_len[3];
+    for (i = 0; hyp->started && i < hyp->candidates_len[0]; i++) {
+      searched += hyp->done[i] * slab;
+    }
+    if (hyp->nb_cand == 0 || searched == hyp->nb_cand) {
+      fprintf(stderr, "complete (%ld keys)\n", hyp->nb_cand);
+      continue;
+    }
+    if (searched == 0) {
+      fprintf(stderr, "not searched (%ld keys)\n", hyp->nb_cand);
+      continue;
+    }
+    fprintf(
+      stderr, "%ld of %ld keys searched (%.1f%%)\n",
+      searched, hyp->nb_cand, 100.0 * (double)searched / (double)hyp->nb_cand
+    );
+
+    print_ranges("complete slabs", hyp->done, hyp->candidates_len[0], hyp->candidates_len[1], false);
+    for (i = 0; i < hyp->candidates_len[0]; i++) {
+      if (hyp->done[i] > 0 && hyp->done[i] < hyp->candidates_len[1]) {
+        fprintf(
+          stderr, "[*]     partial slab %d: candidates 0-%d of %d of diagonal 1\n",
+          i, hyp->done[i] - 1, hyp->candidates_len[1]
+        );
+      }
+    }
+    print_ranges("slabs not searched", hyp->done, hyp->candidates_len[0], 0, false);
+  }
+}
+
+/**
+ * Filtering with a fault in round 8 for several ciphertext pairs, once their
+ * candidates have been intersected: each key must pass the filter of every pair.
+ *
+ * Pairs are checked group by group (pairs sharing their correct ciphertext,
+ * see r8_group_t), so the correct ciphertext of a group is decrypted once per key.
+ * Keys that pass the first group are checked by the next ones, and so on
+ * (very few keys pass a group). The surviving keys are tested with the known
+ * plaintext if any, as with exhaustive_search.
+ */
+static int r8_group_search(
+  uint32_t *const candidates[4],
+  const int candidates_len[4],
+  const r8_group_t *groups,
+  const int ngroups,
+  const known_pt_t *known_pt,
+  keyset_t *keys,
+  search_ctl_t *ctl
+) {
+  int found = 0;
+  int nkeys;
+  const bool unique = known_pt_unique(known_pt);
+  results_t results;
+  const kernel_t *kernel = kernel_current();
+
+  results_init(&results);
+
+#ifdef _OPENMP
+#pragma omp parallel shared(found)
+#endif
+  {
+    int i, j, k, g, s, n, m;
+    int tid = thread_num();
+    uint64_t ordinal;
+    __m128i k01;
+    placed_t base, subkey10;
+    alignas(16) uint8_t subkeys[176];
+    placed_t *cand[4];
+    int *survivors, *next;
+    placed_t *remaining;
+
+    place_candidates(candidates, candidates_len, cand);
+    survivors = malloc(candidates_len[3] * sizeof(int) + 1);
+    next = malloc(candidates_len[3] * sizeof(int) + 1);
+    remaining = malloc(candidates_len[3] * sizeof(placed_t) + 1);
+    if (survivors == NULL || next == NULL || remaining == NULL) {
+      fprintf(stderr, "[!] Cannot allocate candidates\n");
+      exit(EXIT_FAILURE);
+    }
+    PROFILE_BEGIN(PHASE_R8_FILTER);
+
+#ifdef _OPENMP
+#pragma omp for schedule(runtime)
+#endif
+    for (i = 0; i < candidates_len[0]; i++) {
+      if (found || search_should_stop(ctl)) {
+        continue;
+      }
+      for (j = 0; j < candidates_len[1]; j++) {
+        k01 = _mm_or_si128(cand[0][i].v, cand[1][j].v);
+
+        for (k = 0; k < candidates_len[2]; k++) {
+          base.v = _mm_or_si128(k01, cand[2][k].v);
+
+          n = kernel->r8_group_filter(&groups[0], &base, cand[3], candidates_len[3], survivors);
+          PROFILE_COUNT(PROF_R8_KEYS, candidates_len[3]);
+
+          /* survivors of the previous groups, checked by the next ones */
+          for (g = 1; g < ngroups && n > 0; g++) {
+            for (s = 0; s < n; s++) {
+              remaining[s] = cand[3][survivors[s]];
+            }
+            m = kernel->r8_group_filter(&groups[g], &base, remaining, n, next);
+            PROFILE_COUNT(PROF_R8_KEYS, n);
+            for (s = 0; s < m; s++) {
+              next[s] = survivors[next[s]];
+            }
+            memcpy(survivors, next, m * sizeof(int));
+            n = m;
+          }
+          PROFILE_COUNT(PROF_R8_FAULT, n);
+          PROFILE_COUNT(PROF_KEY_EXPANSION, n);
+
+          for (s = 0; s < n; s++) {
+            subkey10.v = _mm_or_si128(base.v, cand[3][survivors[s]].v);
+            ordinal = (((uint64_t)i*candidates_len[1] + j)*candidates_len[2] + k)*candidates_len[3]
+              + survivors[s];
+            if (known_pt->is_some) {
+              reverse_key_expansion(subkey10.b, subkeys);
+              PROFILE_COUNT(PROF_PT_CHECKED, 1);
+              if (known_pt_check(known_pt, subkeys)) {
+                PROFILE_COUNT(PROF_PT_MATCH, 1);
+                results_push(&results, tid, ordinal, subkeys);
+                found = unique;
+              }
+            }
+            else {
+              kernel->key_inverse(subkey10.b, subkeys, 1, 0);
+              results_push(&results, tid, ordinal, subkeys);
+            }
+          }
+        } /* end for k */
+      } /* end for j */
+    } /* end for i */
+    PROFILE_END(PHASE_R8_FILTER);
+    free(cand[0]);
+    free(survivors);
+    free(next);
+    free(remaining);
+  }
+
+  /* merge per-thread buffers in the order of the sequential search */
+  nkeys = results_merge(&results, keys, HYPOTHESIS(0, 0));
+  results_free(&results);
+  return nkeys;
+}
+
+/**
+ * Filters of the pairs with a fault in round 8, by group of correct ciphertext
+ * (see group_pairs), allocated in `arena`. The fault is given by its position
+ * if known, otherwise any column is accepted.
+ */
+r8_group_t *r8_filter_groups(
+  const pair_t *pairs,
+  const pair_group_t *groups,
+  const int ngroups,
+  arena_t *arena
+) {
+  int g, j, i;
+  int npairs = 0;
+  r8_group_t *filter_groups = arena_alloc(arena, ngroups * sizeof(r8_group_t));
+  r8_filter_t *filters;
+
+  for (g = 0; g < ngroups; g++) {
+    npairs += groups[g].len;
+  }
+  filters = arena_alloc(arena, npairs * sizeof(r8_filter_t));
+  for (g = 0; g < ngroups; g++) {
+    memcpy(filter_groups[g].ct, groups[g].ct, 16);
+    filter_groups[g].filters = filters;
+    filter_groups[g].nfilters = groups[g].len;
+    for (j = 0; j < groups[g].len; j++) {
+      i = groups[g].members[j];
+      memcpy(filters->ct, pairs[i].ct, 16);
+      memcpy(filters->fct, pairs[i].fct, 16);
+      filters->row8 = -1;
+      filters->col8 = -1;
+      if (pairs[i].fault_pos >= 0 && pairs[i].fault_pos < 16) {
+        filters->row8 = pairs[i].fault_pos % 4;
+        filters->col8 = pairs[i].fault_pos / 4;
+      }
+      filters->fault_value = pairs[i].fault_value;
+      filters->bitflip = pairs[i].bitflip;
+      filters++;
+    }
+  }
+  return filter_groups;
+}
+
 /*
- * In case of several ciphertext pairs, we only do intersections of candidates
- * followed by an exhaustive search common with round 9.
+ * In case of several ciphertext pairs, we do intersections of candidates
+ * followed by the filtering of all pairs (see r8_group_search).
+ * Candidates of all pairs and diagonals are computed as parallel tasks
+ * (pairs sharing their correct ciphertext share its tables),
+ * then reduced with parallel intersections.
  */
 static int r8_key_recovery_multiple_ct(
-  const pair_t pairs[PAIRS_MAX],
+  const pair_t *pairs,
   const int npairs,
+  arena_t *arena,
+  uint32_t *const known_cand[4],
+  const int known_cand_len[4],
   const known_pt_t *known_pt,
-  uint8_t masterkeys[KEYS_MAX][16]
+  keyset_t *keys,
+  search_ctl_t *ctl
 ) {
-  int i, j;
-  int cand_tmp_len[4], candidates_len[4];
-  int row8 = -1;
-  int col8 = -1;
+  int i, j, ngroups;
+  int candidates_len[4];
   int nkeys = 0;
   long int nb_cand;
-  uint32_t candidates[4][CAND_MAX];
-  uint32_t cand_tmp[4][CAND_MAX];
-
-  /* first we get candidates for a faulty ciphertext */
-  if (pairs[0].fault_pos >= 0 && pairs[0].fault_pos < 16) {
-    row8 = pairs[0].fault_pos % 4;
-    col8 = pairs[0].fault_pos / 4;
+  uint32_t *candidates[4];
+  int *group_of = arena_alloc(arena, npairs * sizeof(int));
+  pair_group_t *groups;
+  r8_group_t *filter_groups;
+  uint32_t *(*cand_all)[4] = arena_alloc(arena, npairs * sizeof(*cand_all));
+  int (*cand_all_len)[4] = arena_alloc(arena, npairs * sizeof(*cand_all_len));
+  uint32_t **lists = arena_alloc(arena, 4 * npairs * sizeof(*lists));
+  int *lens = arena_alloc(arena, 4 * npairs * sizeof(*lens));
+
+  ngroups = group_pairs(pairs, npairs, arena, &groups, group_of);
+  if (ngroups < npairs) {
+    fprintf(stderr, "[*] %d pairs, %d distinct correct ciphertexts\n", npairs, ngroups);
   }
 
-  r8_find_candidates(&pairs[0], row8, col8, candidates, candidates_len);
-
-  /* we reduce the candidates with other pairs (ct,fct) */
-  for (i = 1; i < npairs; i++) {
-    row8 = -1;
-    col8 = -1;
-
-    if (pairs[i].fault_pos >= 0 && pairs[i].fault_pos < 16) {
-      row8 = pairs[i].fault_pos % 4;
-      col8 = pairs[i].fault_pos / 4;
+#ifdef _OPENMP
+#pragma omp parallel
+#pragma omp single
+#endif
+  {
+    /* candidates for each pair (ct,fct) and each diagonal, as independent tasks */
+    for (i = 0; i < npairs; i++) {
+#ifdef _OPENMP
+#pragma omp task firstprivate(i)
+#endif
+      {
+        int row8 = -1;
+        int col8 = -1;
+        if (pairs[i].fault_pos >= 0 && pairs[i].fault_pos < 16) {
+          row8 = pairs[i].fault_pos % 4;
+          col8 = pairs[i].fault_pos / 4;
+        }
+        r8_find_candidates(
+          &pairs[i], row8, col8, &groups[group_of[i]].tables, arena, cand_all[i], cand_all_len[i]
+        );
+      }
     }
+#ifdef _OPENMP
+#pragma omp taskwait
+#endif
 
-    r8_find_candidates(&pairs[i], row8, col8, cand_tmp, cand_tmp_len);
-
-    /* intersection with previous candidates */
+    /* intersection of candidates of all pairs, for each diagonal */
     for (j = 0; j < 4; j++) {
-      intersection(candidates[j], &candidates_len[j], cand_tmp[j], cand_tmp_len[j]);
+#ifdef _OPENMP
+#pragma omp task firstprivate(j)
+#endif
+      {
+        int p;
+        for (p = 0; p < npairs; p++) {
+          lists[j*npairs + p] = cand_all[p][j];
+          lens[j*npairs + p] = cand_all_len[p][j];
+        }
+        intersection_reduce(&lists[j*npairs], &lens[j*npairs], npairs);
+      }
     }
   }
 
+  for (j = 0; j < 4; j++) {
+    candidates[j] = lists[j*npairs];
+    candidates_len[j] = lens[j*npairs];
+  }
+  r8_restrict_candidates(candidates, candidates_len, known_cand, known_cand_len);
+
   nb_cand = 1;
   for (i = 0; i < 4; i++) {
     nb_cand *= (long int)candidates_len[i];
   }
 
   print_number_candidates(candidates_len, nb_cand);
+  if (ctl != NULL) {
+    ctl->space += (double)nb_cand;
+  }
+
+  filter_groups = r8_filter_groups(pairs, groups, ngroups, arena);
 
   if (nb_cand > 0) {
-    nkeys = exhaustive_search(candidates, candidates_len, known_pt, masterkeys);
+    nkeys = r8_group_search(candidates, candidates_len, filter_groups, ngroups, known_pt, keys, ctl);
   }
   return nkeys;
 }
@@ -421,23 +902,45 @@ static int r8_key_recovery_multiple_ct(
  * The last one should give a result very fast.
  * For the other cases, it depends of the number of cores available,
  * but it can be less than a minute for an unknown position and value.
+ *
+ * If `known_cand` is not NULL, candidates of each diagonal are first reduced
+ * to those lists (a length of -1 means nothing is known for the diagonal).
+ *
+ * With a time budget (see `ctl`), hypotheses are searched best first
+ * (see cmp_hypotheses), keys are printed as soon as they are found,
+ * and the parts of the key space searched before the deadline are reported.
+ *
+ * Candidates of a hypothesis are allocated in `arena`, which is released
+ * once the hypothesis has been searched (with a time budget, candidates of
+ * all hypotheses are kept until the end of the search).
  */
 int r8_key_recovery(
-  pair_t pairs[PAIRS_MAX],
+  const pair_t *pairs,
   const int npairs,
+  arena_t *arena,
+  uint32_t *const known_cand[4],
+  const int known_cand_len[4],
   const known_pt_t *known_pt,
-  uint8_t masterkeys[KEYS_MAX][16]
+  keyset_t *keys,
+  search_ctl_t *ctl
 ) {
-  pair_t *pair;
-  int bit, col8;
+  const pair_t *pair;
+  int h, nhyp, ngen;
   int row8 = -1;
-  int col8_start = 0;
-  int col8_end = 4;
   int nkeys = 0;
+  bool budget = ctl != NULL && ctl->deadline > 0;
+  r8_hypothesis_t *hyps;
+  arena_mark_t mark;
 
   /* processing multiple ciphertext pairs */
   if (npairs > 1) {
-    return r8_key_recovery_multiple_ct(pairs, npairs, known_pt, masterkeys);
+    if (budget) {
+      fprintf(stderr, "[!] Time budget ignored with several ciphertext pairs\n");
+    }
+    /* the search can still be cancelled */
+    return r8_key_recovery_multiple_ct(
+      pairs, npairs, arena, known_cand, known_cand_len, known_pt, keys, budget ? NULL : ctl
+    );
   }
 
   /* processing a single ciphertext pair */
@@ -445,36 +948,60 @@ int r8_key_recovery(
   fprintf(stderr, "[*] Processing a single ciphertext pair:\n");
   print_pair_info(pair);
 
-  /* get column where the fault occurred if known */
+  /* get row where the fault occurred if known */
   if (pair->fault_pos >= 0 && pair->fault_pos < 16) {
     row8 = pair->fault_pos % 4;
-    col8_start = pair->fault_pos / 4;
-    col8_end = col8_start + 1;
   }
 
-  /* if fault is a bitflip (position known), the analysis is run 8 times
-   * with each bitflip possible considered as a fault value:
-   * should reduce by half compared to an unknown fault value
-   */
-  for(col8 = col8_start; col8 < col8_end; col8++) {
-    /* if fault is a bitflip, run analysis for the 8 bitflips possible */
-    if (pair->bitflip == true && pair->fault_pos != -1) {
-      for (bit = 1; bit < 256; bit <<= 1) {
-        pair->fault_value = bit;
-        nkeys += r8_key_recovery_single_ct(pair, row8, col8, known_pt, &masterkeys[nkeys]);
-        if (known_pt->is_some && nkeys == 1) {
-          goto found;
-        }
-      }
+  hyps = arena_alloc(arena, R8_HYPOTHESES_MAX * sizeof(*hyps));
+  nhyp = r8_hypotheses(pair, hyps);
+  ngen = nhyp;
+
+  /* with a time budget, candidates of all hypotheses are computed first
+   * and kept to order the hypotheses; those not computed before the
+   * deadline are left out of the search (nb_cand of -1) */
+  if (budget) {
+    for (h = 0; h < nhyp && !search_should_stop(ctl); h++) {
+      r8_hypothesis_candidates(pair, row8, known_cand, known_cand_len, arena, &hyps[h]);
+    }
+    ngen = h;
+    for (; h < nhyp; h++) {
+      hyps[h].nb_cand = -1;
+    }
+    qsort(hyps, ngen, sizeof(*hyps), cmp_hypotheses);
+    for (h = 0; h < ngen; h++) {
+      hyps[h].done = arena_alloc(arena, hyps[h].candidates_len[0] * sizeof(int));
+      memset(hyps[h].done, 0, hyps[h].candidates_len[0] * sizeof(int));
+    }
+  }
+
+  for (h = 0; h < ngen; h++) {
+    if (search_should_stop(ctl)) {
+      break;
+    }
+    mark = arena_mark(arena);
+    if (!budget) {
+      r8_hypothesis_candidates(pair, row8, known_cand, known_cand_len, arena, &hyps[h]);
+    }
+    if (ctl != NULL) {
+      ctl->space += (double)hyps[h].nb_cand;
+    }
+    nkeys += r8_key_recovery_single_ct(pair, row8, &hyps[h], known_pt, keys, ctl);
+    arena_release(arena, mark);
+    if (known_pt_unique(known_pt) && nkeys == 1) {
+      break;
+    }
+  }
+
+  if (budget && !(known_pt_unique(known_pt) && nkeys == 1)) {
+    if (ctl->stop) {
+      fprintf(stderr, "[!] Time budget exhausted, search stopped\n");
+      r8_print_coverage(hyps, nhyp);
     }
     else {
-      nkeys += r8_key_recovery_single_ct(pair, row8, col8, known_pt, &masterkeys[nkeys]);
-      if (known_pt->is_some && nkeys == 1) {
-        goto found;
-      }
+      fprintf(stderr, "[*] Search completed within the time budget\n");
     }
   }
 
-found:
   return nkeys;
 }
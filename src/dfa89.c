@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "dfa.h"
+
+/**
+ * Round of the fault for a ciphertext pair: the tag from the input file
+ * if present, otherwise it is deduced from the difference between
+ * ciphertexts (a single diagonal for round 9, all bytes for round 8).
+ */
+int pair_round(const pair_t *pair) {
+  if (pair->round == DFA_ROUND_8 || pair->round == DFA_ROUND_9) {
+    return pair->round;
+  }
+  if (find_faulty_column(pair) != -1) {
+    return DFA_ROUND_9;
+  }
+  return DFA_ROUND_8;
+}
+
+/**
+ * Key recovery with ciphertext pairs from faults in round 8 and round 9.
+ *
+ * Pairs with a fault in round 9 give candidates for the diagonals they
+ * cover; those lists are used to reduce the candidates of each hypothesis
+ * made with the pairs with a fault in round 8, before the filtering.
+ * Conversely, the filtering with the fault in round 8 reduces the product
+ * of candidates given by the pairs with a fault in round 9.
+ *
+ * Without any pair with a fault in round 8, this is the same as `r9_key_recovery`
+ * (the key space can be stored in `factored`).
+ * The search control `ctl` applies to the filtering with the fault in round 8.
+ */
+int mixed_key_recovery(
+  const pair_t *pairs,
+  const int npairs,
+  arena_t *arena,
+  const known_pt_t *known_pt,
+  keyset_t *keys,
+  factored_t *factored,
+  search_ctl_t *ctl
+) {
+  int i;
+  int n8 = 0;
+  int n9 = 0;
+  int candidates_len[4];
+  uint32_t *candidates[4];
+  pair_t *pairs8 = arena_alloc(arena, npairs * sizeof(pair_t));
+  pair_t *pairs9 = arena_alloc(arena, npairs * sizeof(pair_t));
+
+  /* split pairs according to the round of the fault */
+  for (i = 0; i < npairs; i++) {
+    if (pair_round(&pairs[i]) == DFA_ROUND_9) {
+      pairs9[n9++] = pairs[i];
+    }
+    else {
+      pairs8[n8++] = pairs[i];
+    }
+  }
+  fprintf(
+    stderr,
+    "[*] Mixed analysis: %d pair(s) with fault in round 8, %d pair(s) with fault in round 9\n",
+    n8, n9
+  );
+
+  /* candidates for diagonals covered by faults in round 9 */
+  r9_find_all_candidates(pairs9, n9, arena, candidates, candidates_len);
+
+  if (n8 == 0) {
+    return r9_search(candidates, candidates_len, known_pt, keys, factored, ctl);
+  }
+
+  for (i = 0; i < 4; i++) {
+    if (candidates_len[i] == -1) {
+      fprintf(stderr, "[*] Diagonal %d: no reduction from faults in round 9\n", i);
+    }
+  }
+  return r8_key_recovery(pairs8, n8, arena, candidates, candidates_len, known_pt, keys, ctl);
+}
@@ -1,12 +1,15 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include "dfa.h"
 
 /**
  * Find which column the fault occurred.
+ * Returns -1 if the ciphertexts do not differ on a single diagonal
+ * (i.e., the pair cannot come from a fault in round 9).
  */
-static int find_faulty_column(const pair_t *pair) {
+int find_faulty_column(const pair_t *pair) {
   int i;
   int column = -1;
   int ctr = 0;
@@ -38,7 +41,7 @@ static int find_faulty_column(const pair_t *pair) {
 }
 
 /**
- * Calculate the delta-set for one ciphertext pair.
+ * Calculate the delta-set for one ciphertext pair (allocated in `arena`).
  * It is expected that the pair differs only in a diagonal.
  *
  * Returns the length of the delta-set (0 if the ciphertext pair
@@ -46,7 +49,8 @@ static int find_faulty_column(const pair_t *pair) {
  */
 static int r9_get_diff_mc(
   const pair_t *pair,
-  uint32_t diff_mc_list[DIFF_MC_MAX],
+  arena_t *arena,
+  uint32_t **diff_mc_list,
   int *col
 ) {
   int i, fault_len, len;
@@ -92,86 +96,160 @@ static int r9_get_diff_mc(
   }
 
   /* construct the delta-set */
-  len = get_diff_mc(row, fault_list, fault_len, diff_mc_list);
+  *diff_mc_list = arena_alloc(arena, (row == -1 ? 4 : 1) * fault_len * sizeof(uint32_t));
+  len = get_diff_mc(row, fault_list, fault_len, *diff_mc_list);
 
   return len;
 }
 
 /**
- * Calculate candidates for a ciphertext pair
- * and get column where the fault occurred.
+ * Calculate candidates for a ciphertext pair (allocated in `arena`)
+ * and get column where the fault occurred
+ * (loaded from the cache if this pair was already analyzed).
+ * `tables` are those of its correct ciphertext (may be NULL).
  *
  * Returns the number of candidates.
  */
 static int r9_find_candidates(
   const pair_t *pair,
-  uint32_t candidates[CAND_MAX],
+  const ct_tables_t *tables,
+  arena_t *arena,
+  uint32_t **candidates,
   int *col
 ) {
-  uint32_t diff_mc_list[DIFF_MC_MAX];
-  int candidates_len;
+  uint32_t *diff_mc_list;
+  int candidates_len = 0;
   int diff_mc_len;
+  cache_key_t key;
 
-  /* get delta-set */
-  diff_mc_len = r9_get_diff_mc(pair, diff_mc_list, col);
-  if (diff_mc_len == 0) {
-    return 0;
+  /* results from a previous run */
+  cache_key_pair(&key, CACHE_R9_CANDIDATES, pair, -1, -1);
+  if (cache_load_lists(&key, arena, candidates, &candidates_len, 1, col) == 0) {
+    return candidates_len;
   }
 
+  /* get delta-set */
+  diff_mc_len = r9_get_diff_mc(pair, arena, &diff_mc_list, col);
+
   /* find candidates for 4 bytes of K10 */
-  candidates_len = k10_cand_from_diff_mc(pair, *col, diff_mc_list, diff_mc_len, candidates);
+  *candidates = NULL;
+  if (diff_mc_len > 0) {
+    candidates_len = k10_cand_from_diff_mc(
+      pair, *col, diff_mc_list, diff_mc_len, tables, arena, candidates
+    );
+  }
 
+  cache_store_lists(&key, candidates, &candidates_len, 1, *col);
   return candidates_len;
 }
 
 /**
- * The main function for the key recovery with faults in round 9.
- * Each ciphertext pair is processed and candidates for each diagonal are reduced
- * if several pairs are available for each diagonal.
+ * Process all ciphertext pairs with a fault in round 9: candidates of
+ * each diagonal are reduced if several pairs are available for it.
  *
- * It ends with an exhaustive search for the last round key.
- * If two pairs are provided for each diagonal,
- * then one or two candidates are expected for this search.
+ * Candidates of all pairs are computed as parallel tasks (pairs sharing
+ * their correct ciphertext share its tables), then intersections are
+ * reduced in parallel for each diagonal.
  *
- * If a known plaintext/ciphertext is provided, the key will be checked.
- * Otherwise, if two keys or more are found, they will be written to `masterkeys`.
+ * The length of a diagonal without any pair is set to -1.
+ * Lists are allocated in `arena` (candidates point into it).
  */
-int r9_key_recovery(
-  const pair_t pairs[PAIRS_MAX],
+void r9_find_all_candidates(
+  const pair_t *pairs,
   const int npairs,
-  const known_pt_t *known_pt,
-  uint8_t masterkeys[KEYS_MAX][16]
+  arena_t *arena,
+  uint32_t *candidates[4],
+  int candidates_len[4]
 ) {
-  int i, j, column, cand_tmp_len;
-  int candidates_len[4] = {-1, -1, -1, -1};
-  int nkeys = 0;
-  long nb_cand;
-  uint32_t candidates[4][CAND_MAX];
-  uint32_t cand_tmp[CAND_MAX];
+  int i, col, ngroups;
+  int n[4] = {0, 0, 0, 0};
+  int *column = arena_alloc(arena, npairs * sizeof(int));
+  int *group_of = arena_alloc(arena, npairs * sizeof(int));
+  pair_group_t *groups;
+  int *cand_all_len = arena_alloc(arena, npairs * sizeof(int));
+  int *lens[4];
+  uint32_t **cand_all = arena_alloc(arena, npairs * sizeof(uint32_t *));
+  uint32_t **lists[4];
+
+  for (col = 0; col < 4; col++) {
+    lists[col] = arena_alloc(arena, npairs * sizeof(uint32_t *));
+    lens[col] = arena_alloc(arena, npairs * sizeof(int));
+  }
+
+  ngroups = group_pairs(pairs, npairs, arena, &groups, group_of);
+  if (ngroups < npairs) {
+    fprintf(stderr, "[*] %d pairs, %d distinct correct ciphertexts\n", npairs, ngroups);
+  }
+
+  /* candidates for each pair (independent tasks) */
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+  for (i = 0; i < npairs; i++) {
+    cand_all_len[i] = r9_find_candidates(
+      &pairs[i], &groups[group_of[i]].tables, arena, &cand_all[i], &column[i]
+    );
+  }
 
-  /* process all ciphertext pairs */
   for (i = 0; i < npairs; i++) {
     fprintf(stderr, "[*] Processing ciphertext pair %d out of %d:\n", i + 1, npairs);
     print_pair_info(&pairs[i]);
-    cand_tmp_len = r9_find_candidates(&pairs[i], cand_tmp, &column);
-    if (cand_tmp_len == 0) {
+    if (cand_all_len[i] == 0) {
       fprintf(stderr, "[!] This pair is ignored (incompatible)\n");
       continue;
     }
+    print_number_candidates_line(cand_all_len[i], column[i]);
+    col = column[i];
+    lists[col][n[col]] = cand_all[i];
+    lens[col][n[col]] = cand_all_len[i];
+    n[col]++;
+  }
+
+  /* intersection of candidates of pairs with fault in the same column */
+#ifdef _OPENMP
+#pragma omp parallel
+#pragma omp single
+#endif
+  for (col = 0; col < 4; col++) {
+#ifdef _OPENMP
+#pragma omp task firstprivate(col)
+#endif
+    intersection_reduce(lists[col], lens[col], n[col]);
+  }
 
-    /* first pair with fault in "column" */
-    if (candidates_len[column] == -1) {
-      for (j = 0; j < cand_tmp_len; j++) {
-        candidates[column][j] = cand_tmp[j];
+  for (col = 0; col < 4; col++) {
+    candidates[col] = NULL;
+    candidates_len[col] = -1;
+    if (n[col] > 0) {
+      candidates_len[col] = lens[col][0];
+      candidates[col] = lists[col][0];
+      if (n[col] > 1) {
+        fprintf(stderr, "[*] Intersection of %d pairs with fault in column %d:\n", n[col], col);
+        print_number_candidates_line(candidates_len[col], col);
       }
-      candidates_len[column] = cand_tmp_len;
     }
-    /* intersection with previous candidates for this column */
-    else {
-      intersection(candidates[column], &candidates_len[column], cand_tmp, cand_tmp_len);
-    }
-    print_number_candidates_line(candidates_len[column], column);
   }
+}
+
+/**
+ * Final search once candidates for all diagonals are known
+ * (lengths set to -1 are reported as missing).
+ *
+ * Without known plaintext, the key space is stored in `factored` (if not NULL)
+ * instead of being enumerated when this is requested or when there are
+ * too many keys to save.
+ */
+int r9_search(
+  uint32_t *const candidates[4],
+  int candidates_len[4],
+  const known_pt_t *known_pt,
+  keyset_t *keys,
+  factored_t *factored,
+  search_ctl_t *ctl
+) {
+  int i;
+  int nkeys = 0;
+  long nb_cand;
 
   /* calculate the number of candidates for the last round key*/
   for (i = 0; i < 4; i++) {
@@ -188,6 +266,12 @@ int r9_key_recovery(
 
   /* final search */
   if (nb_cand > 0) {
+    if (!known_pt->is_some && factored != NULL && (factored->requested || nb_cand > KEYS_MAX)) {
+      if (factored_set(factored, candidates, candidates_len) == 0) {
+        fprintf(stderr, "[*] Key space stored in factored form (%ld keys)\n", nb_cand);
+        return 0;
+      }
+    }
     if (!known_pt->is_some && nb_cand > KEYS_MAX) {
       fprintf(
         stderr,
@@ -200,7 +284,36 @@ int r9_key_recovery(
     if (known_pt->is_some) {
       fprintf(stderr, "[*] Filtering with known plaintext\n");
     }
-    nkeys = exhaustive_search(candidates, candidates_len, known_pt, masterkeys);
+    nkeys = exhaustive_search(candidates, candidates_len, known_pt, HYPOTHESIS(0, 0), keys, ctl);
   }
   return nkeys;
 }
+
+/**
+ * The main function for the key recovery with faults in round 9.
+ * Each ciphertext pair is processed and candidates for each diagonal are reduced
+ * if several pairs are available for each diagonal.
+ *
+ * It ends with an exhaustive search for the last round key.
+ * If two pairs are provided for each diagonal,
+ * then one or two candidates are expected for this search.
+ *
+ * If a known plaintext/ciphertext is provided, the key will be checked.
+ * Otherwise, if two keys or more are found, they will be added to `keys`
+ * (or stored in `factored`, see `r9_search`).
+ */
+int r9_key_recovery(
+  const pair_t *pairs,
+  const int npairs,
+  arena_t *arena,
+  const known_pt_t *known_pt,
+  keyset_t *keys,
+  factored_t *factored,
+  search_ctl_t *ctl
+) {
+  int candidates_len[4];
+  uint32_t *candidates[4];
+
+  r9_find_all_candidates(pairs, npairs, arena, candidates, candidates_len);
+  return r9_search(candidates, candidates_len, known_pt, keys, factored, ctl);
+}
@@ -0,0 +1,366 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+
+#define ESTIMATE_SAMPLES (1 << 15)    /* random keys sampled for each hypothesis */
+#define ESTIMATE_BATCHES 8
+#define T95_BATCHES 2.365             /* Student quantile (7 degrees of freedom) */
+#define ESTIMATE_TIMING 0.002         /* seconds spent timing the kernels */
+#define ESTIMATE_BATCH 4096           /* candidates timed at once */
+
+/* expected number of candidates for a diagonal given by an extra fault
+ * at a known position with an unknown value (255 differences, about
+ * one candidate each), in round 9 (one diagonal) or round 8 (all diagonals) */
+#define EXTRA_FAULT_CANDIDATES 255.0
+
+/**
+ * Estimate with its 95% interval.
+ */
+typedef struct Estimate {
+  double p;
+  double lo;
+  double hi;
+} estimate_t;
+
+/**
+ * Undo the last round and round 9 (byte by byte): state at the output of round 8,
+ * up to the round key 8 which is the same for both ciphertexts of a pair.
+ */
+static void r8_output(const uint8_t ct[16], const uint8_t subkey10[16], const uint8_t subkey9[16], uint8_t out[16]) {
+  int r, c;
+  uint8_t s[16];
+
+  for (c = 0; c < 4; c++) {
+    for (r = 0; r < 4; r++) {
+      s[r + 4*((c + r) & 3)] = invsbox[ct[r + 4*c] ^ subkey10[r + 4*c]] ^ subkey9[r + 4*((c + r) & 3)];
+    }
+  }
+  for (c = 0; c < 4; c++) {
+    inv_mix_column(s + 4*c);
+  }
+  for (c = 0; c < 4; c++) {
+    for (r = 0; r < 4; r++) {
+      out[r + 4*((c + r) & 3)] = invsbox[s[r + 4*c]];
+    }
+  }
+}
+
+/**
+ * Difference of the states at the output of round 8 (column `col8`)
+ * for a candidate of the last round key. The filtering checks that it is
+ * the mix column of a single byte (see r8_filter_check).
+ */
+static void r8_diff(const r8_filter_t *filter, const uint8_t subkey10[16], uint8_t diff[4]) {
+  int r;
+  uint8_t subkey9[16], x[16], y[16];
+
+  k9_from_k10(subkey10, subkey9);
+  r8_output(filter->ct, subkey10, subkey9, x);
+  r8_output(filter->fct, subkey10, subkey9, y);
+  for (r = 0; r < 4; r++) {
+    diff[r] = x[4*filter->col8 + r] ^ y[4*filter->col8 + r];
+  }
+}
+
+static uint64_t xorshift(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void set_diagonal(uint8_t subkey10[16], const int diag, const uint32_t cand) {
+  int b;
+  for (b = 0; b < 4; b++) {
+    subkey10[POSITIONS[diag][b]] = TAKEBYTE(cand, b);
+  }
+}
+
+/**
+ * Estimated proportion of keys that pass the filtering under a hypothesis,
+ * with its 95% interval.
+ *
+ * A key passes if the difference at the output of round 8 is the mix column
+ * of a fault allowed by the hypothesis (row, value). Keys that pass are far
+ * too rare (2^-24 to 2^-32) to be met by sampling, but each byte of the
+ * difference depends on a different column of round 9: bytes are independent,
+ * and the proportion is the sum, over the faults allowed, of the products
+ * of the frequencies of each byte (histograms of the samples).
+ * Candidates are built from the fault, so those frequencies are far from
+ * uniform (e.g., 1/127 instead of 1/256 with a known fault value).
+ * The interval comes from the spread of the estimates of ESTIMATE_BATCHES batches.
+ */
+static estimate_t r8_sample_filter(const r8_filter_t *filter, r8_hypothesis_t *hyp, uint64_t *state) {
+  int i, b, r, v, d;
+  int nfaults = 0;
+  uint8_t subkey10[16];
+  uint8_t diff[4];
+  uint8_t (*faults)[4];
+  uint32_t (*hist)[256];
+  double p, term, sum = 0, sum2 = 0, t;
+  estimate_t result;
+  const int batch = ESTIMATE_SAMPLES / ESTIMATE_BATCHES;
+
+  /* differences allowed: mix column of each fault value on each row */
+  faults = malloc(4 * 255 * sizeof(*faults));
+  hist = malloc(4 * sizeof(*hist));
+  if (faults == NULL || hist == NULL) {
+    fprintf(stderr, "[!] Cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  for (r = 0; r < 4; r++) {
+    if (filter->row8 != -1 && r != filter->row8) {
+      continue;
+    }
+    for (v = 1; v < 256; v++) {
+      if ((filter->fault_value != -1 && v != filter->fault_value)
+          || (filter->fault_value == -1 && filter->bitflip && (v & (v - 1)) != 0)) {
+        continue;
+      }
+      memset(faults[nfaults], 0, 4);
+      faults[nfaults][r] = (uint8_t)v;
+      mix_column(faults[nfaults]);
+      nfaults++;
+    }
+  }
+
+  for (b = 0; b < ESTIMATE_BATCHES; b++) {
+    memset(hist, 0, 4 * sizeof(*hist));
+    for (i = 0; i < batch; i++) {
+      for (d = 0; d < 4; d++) {
+        set_diagonal(subkey10, d, hyp->candidates[d][xorshift(state) % hyp->candidates_len[d]]);
+      }
+      r8_diff(filter, subkey10, diff);
+      for (r = 0; r < 4; r++) {
+        hist[r][diff[r]]++;
+      }
+    }
+    p = 0;
+    for (i = 0; i < nfaults; i++) {
+      term = 1;
+      for (r = 0; r < 4; r++) {
+        term *= (double)hist[r][faults[i][r]] / batch;
+      }
+      p += term;
+    }
+    sum += p;
+    sum2 += p * p;
+  }
+  free(faults);
+  free(hist);
+
+  result.p = sum / ESTIMATE_BATCHES;
+  t = T95_BATCHES * sqrt(fmax(sum2 / ESTIMATE_BATCHES - result.p * result.p, 0) / (ESTIMATE_BATCHES - 1));
+  result.lo = result.p - t > 0 ? result.p - t : 0;
+  result.hi = result.p + t;
+  return result;
+}
+
+/**
+ * Time of the filtering for one key with the selected kernels (one thread),
+ * with its 95% interval over batches of candidates.
+ */
+static estimate_t r8_time_filter(const r8_filter_t *filter, r8_hypothesis_t *hyp, uint64_t *state) {
+  int d, n, nbatch = 0;
+  int *survivors;
+  long done;
+  placed_t base;
+  placed_t *cand3;
+  double t, rate, sum = 0, sum2 = 0, start;
+  estimate_t result;
+  const kernel_t *kernel = kernel_current();
+
+  survivors = malloc(hyp->candidates_len[3] * sizeof(int));
+  cand3 = malloc(hyp->candidates_len[3] * sizeof(placed_t));
+  if (survivors == NULL || cand3 == NULL) {
+    fprintf(stderr, "[!] Cannot allocate memory\n");
+    exit(EXIT_FAILURE);
+  }
+  place_diagonal(cand3, hyp->candidates[3], hyp->candidates_len[3], 3);
+  memset(&base, 0, sizeof(base));
+  /* first batch not counted (cold caches) */
+  start = wall_time();
+  while (nbatch < 9 || wall_time() - start < ESTIMATE_TIMING) {
+    t = wall_time();
+    for (done = 0; done < ESTIMATE_BATCH; done += hyp->candidates_len[3]) {
+      for (d = 0; d < 3; d++) {
+        set_diagonal(base.b, d, hyp->candidates[d][xorshift(state) % hyp->candidates_len[d]]);
+      }
+      n = kernel->r8_filter(filter, &base, cand3, hyp->candidates_len[3], survivors);
+      (void)n;
+    }
+    rate = (wall_time() - t) / done;
+    if (nbatch++ > 0) {
+      sum += rate;
+      sum2 += rate * rate;
+    }
+  }
+  free(survivors);
+  free(cand3);
+  nbatch--;
+
+  result.p = sum / nbatch;
+  t = 1.96 * sqrt(fmax(sum2 / nbatch - result.p * result.p, 0) / (nbatch - 1));
+  result.lo = result.p - t > 0 ? result.p - t : 0;
+  result.hi = result.p + t;
+  return result;
+}
+
+/**
+ * Expected number of candidates of a diagonal (`len` now) once intersected
+ * with the candidates given by an extra fault: the right candidate stays,
+ * each other one remains with probability EXTRA_FAULT_CANDIDATES / 2^32.
+ */
+static double shrink(const int len) {
+  return len == 0 ? 0 : 1 + (len - 1) * (EXTRA_FAULT_CANDIDATES / 4294967296.0);
+}
+
+static void print_seconds(const char *what, const estimate_t t) {
+  fprintf(stderr, "[*] %s: %.3g s (95%% interval: %.3g to %.3g s)\n", what, t.p, t.lo, t.hi);
+}
+
+/**
+ * Estimate of the search of a single ciphertext pair with a fault in round 8,
+ * without running it: for each hypothesis, the keys that pass the filtering
+ * are estimated from random samples of the candidates, and the runtime
+ * from the kernels timed on a few batches of candidates.
+ * Then, the key space that would remain with an extra fault (a fault in round 9
+ * in each column, or a fault in round 8) is given, best first.
+ *
+ * Returns -1 if the data does not fit (several pairs).
+ */
+int r8_estimate(
+  const pair_t *pairs,
+  const int npairs,
+  arena_t *arena,
+  uint32_t *const known_cand[4],
+  const int known_cand_len[4],
+  const known_pt_t *known_pt
+) {
+  int h, d, i, j, nhyp, tmp;
+  int row8 = -1;
+  int threads = max_threads();
+  double product, space, best;
+  double extra[5];
+  int order[5];
+  uint64_t state = 0x9e3779b97f4a7c15UL;
+  estimate_t pass, rate = {0, 0, 0};
+  estimate_t survivors = {0, 0, 0};
+  estimate_t runtime;
+  r8_filter_t filter;
+  r8_hypothesis_t *hyps;
+  arena_mark_t mark;
+  const pair_t *pair = &pairs[0];
+  double total = 0;
+  double start = wall_time();
+
+  if (npairs != 1) {
+    return -1;
+  }
+  fprintf(stderr, "[*] Estimating the search of a single ciphertext pair:\n");
+  print_pair_info(pair);
+  if (pair->fault_pos >= 0 && pair->fault_pos < 16) {
+    row8 = pair->fault_pos % 4;
+  }
+
+  hyps = arena_alloc(arena, R8_HYPOTHESES_MAX * sizeof(*hyps));
+  nhyp = r8_hypotheses(pair, hyps);
+  for (i = 0; i < 5; i++) {
+    extra[i] = 0;
+  }
+
+  for (h = 0; h < nhyp; h++) {
+    mark = arena_mark(arena);
+    r8_hypothesis_candidates(pair, row8, known_cand, known_cand_len, arena, &hyps[h]);
+    memcpy(filter.ct, pair->ct, 16);
+    memcpy(filter.fct, pair->fct, 16);
+    filter.row8 = row8;
+    filter.col8 = hyps[h].col8;
+    filter.fault_value = hyps[h].fault_value;
+    filter.bitflip = pair->bitflip;
+
+    if (hyps[h].nb_cand > 0) {
+      pass = r8_sample_filter(&filter, &hyps[h], &state);
+      /* the kernels run at the same speed for all hypotheses */
+      if (rate.p == 0) {
+        rate = r8_time_filter(&filter, &hyps[h], &state);
+      }
+      if (hyps[h].fault_value != -1) {
+        fprintf(stderr, "[*] Column %d, fault '0x%02x': ", hyps[h].col8, hyps[h].fault_value);
+      }
+      else {
+        fprintf(stderr, "[*] Column %d, fault unknown: ", hyps[h].col8);
+      }
+      fprintf(
+        stderr, "2^%.1f keys, %.3g wrong keys pass the filtering (95%% interval: %.3g to %.3g)\n",
+        log2((double)hyps[h].nb_cand), pass.p * hyps[h].nb_cand,
+        pass.lo * hyps[h].nb_cand, pass.hi * hyps[h].nb_cand
+      );
+      total += (double)hyps[h].nb_cand;
+      survivors.p += pass.p * hyps[h].nb_cand;
+      survivors.lo += pass.lo * hyps[h].nb_cand;
+      survivors.hi += pass.hi * hyps[h].nb_cand;
+
+      /* key space with an extra fault in round 9 (column d) or in round 8 */
+      product = 1;
+      for (d = 0; d < 4; d++) {
+        product *= shrink(hyps[h].candidates_len[d]);
+      }
+      extra[4] += product;
+      for (d = 0; d < 4; d++) {
+        extra[d] += (double)hyps[h].nb_cand / hyps[h].candidates_len[d] * shrink(hyps[h].candidates_len[d]);
+      }
+    }
+    arena_release(arena, mark);
+  }
+
+  if (total == 0) {
+    fprintf(stderr, "[*] No key candidates: check your data\n");
+    return 0;
+  }
+  fprintf(
+    stderr,
+    "[*] Keys to filter: 2^%.1f, keys after filtering (with the right one): %.3g (95%% interval: %.3g to %.3g)\n",
+    log2(total), 1 + survivors.p, 1 + survivors.lo, 1 + survivors.hi
+  );
+  if (known_pt->is_some) {
+    fprintf(stderr, "[*] With the known plaintext, a single key should remain\n");
+  }
+  runtime.p = total * rate.p / threads;
+  runtime.lo = total * rate.lo / threads;
+  runtime.hi = total * rate.hi / threads;
+  fprintf(stderr, "[*] Filtering: %.3g ns per key (kernels %s)\n", 1e9 * rate.p, kernel_current()->name);
+  print_seconds(threads > 1 ? "Runtime (threads scaling linearly)" : "Runtime", runtime);
+
+  /* extra faults, smallest remaining key space first */
+  for (i = 0; i < 5; i++) {
+    order[i] = i;
+  }
+  for (i = 1; i < 5; i++) {
+    for (j = i; j > 0 && extra[order[j]] < extra[order[j - 1]]; j--) {
+      tmp = order[j];
+      order[j] = order[j - 1];
+      order[j - 1] = tmp;
+    }
+  }
+  best = extra[order[0]];
+  fprintf(stderr, "[*] Key space with an extra fault (position known), best first:\n");
+  for (i = 0; i < 5; i++) {
+    space = extra[order[i]];
+    if (order[i] == 4) {
+      fprintf(stderr, "    - round 8, any position: ");
+    }
+    else {
+      fprintf(
+        stderr, "    - round 9, position %d to %d (diagonal %d): ",
+        4*order[i], 4*order[i] + 3, order[i]
+      );
+    }
+    fprintf(stderr, "%.3g keys to search (~%.3g s)%s\n", space, space * rate.p / threads, space == best ? " <-" : "");
+  }
+  fprintf(stderr, "[*] Estimated in %.1f ms\n", 1e3 * (wall_time() - start));
+  return 0;
+}
@@ -0,0 +1,241 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dfa.h"
+
+static const char FACTORED_MAGIC[8] = "DFAFACT";
+
+/**
+ * Store the lists of candidates of each diagonal instead of enumerating
+ * their product: a key space of 2^24 keys or more only takes a few kilobytes.
+ */
+int factored_set(
+  factored_t *factored,
+  uint32_t *const candidates[4],
+  const int candidates_len[4]
+) {
+  int i;
+  size_t total = 0;
+  uint32_t *storage;
+
+  for (i = 0; i < 4; i++) {
+    total += candidates_len[i];
+  }
+  storage = malloc(total * sizeof(uint32_t) + 1);
+  if (storage == NULL) {
+    return -1;
+  }
+
+  factored_free(factored);
+  factored->storage = storage;
+  for (i = 0; i < 4; i++) {
+    memcpy(storage, candidates[i], candidates_len[i] * sizeof(uint32_t));
+    factored->candidates[i] = storage;
+    factored->candidates_len[i] = candidates_len[i];
+    storage += candidates_len[i];
+  }
+  factored->is_some = true;
+  return 0;
+}
+
+void factored_free(factored_t *factored) {
+  free(factored->storage);
+  if (factored->map != NULL) {
+    munmap(factored->map, factored->map_len);
+  }
+  factored->storage = NULL;
+  factored->map = NULL;
+  factored->is_some = false;
+}
+
+/**
+ * Number of keys in the factored key space.
+ */
+uint64_t factored_size(const factored_t *factored) {
+  int i;
+  uint64_t size = 1;
+  for (i = 0; i < 4; i++) {
+    size *= (uint64_t)factored->candidates_len[i];
+  }
+  return size;
+}
+
+/**
+ * Place the candidate `cand` of diagonal `diag` in the last round key.
+ */
+static void set_diagonal(uint8_t subkey10[16], const int diag, const uint32_t cand) {
+  int i;
+  for (i = 0; i < 4; i++) {
+    subkey10[POSITIONS[diag][i]] = TAKEBYTE(cand, i);
+  }
+}
+
+/**
+ * Master key with index `index` in the key space.
+ * Indices follow the order of `exhaustive_search` (the last diagonal varies first).
+ */
+void factored_key(const factored_t *factored, uint64_t index, uint8_t key[16]) {
+  int diag, idx;
+  uint8_t subkey10[16];
+
+  for (diag = 3; diag >= 0; diag--) {
+    idx = (int)(index % (uint64_t)factored->candidates_len[diag]);
+    index /= (uint64_t)factored->candidates_len[diag];
+    set_diagonal(subkey10, diag, factored->candidates[diag][idx]);
+  }
+  kernel_current()->key_inverse(subkey10, key, 1, 0);
+}
+
+/**
+ * Iterator over keys with indices in [start, end).
+ */
+void factored_iter_init(factored_iter_t *it, const factored_t *factored, uint64_t start, uint64_t end) {
+  int diag;
+  uint64_t index = start;
+  uint64_t size = factored_size(factored);
+
+  it->factored = factored;
+  it->index = start < size ? start : size;
+  it->end = end < size ? end : size;
+  for (diag = 3; diag >= 0 && size > 0; diag--) {
+    it->idx[diag] = (int)(index % (uint64_t)factored->candidates_len[diag]);
+    index /= (uint64_t)factored->candidates_len[diag];
+    set_diagonal(it->subkey10, diag, factored->candidates[diag][it->idx[diag]]);
+  }
+}
+
+/**
+ * Get the next key; only diagonals whose candidate changed are updated.
+ * Returns 0 when the iteration is over.
+ */
+int factored_iter_next(factored_iter_t *it, uint8_t key[16]) {
+  int diag;
+  const factored_t *f = it->factored;
+
+  if (it->index >= it->end) {
+    return 0;
+  }
+  kernel_current()->key_inverse(it->subkey10, key, 1, 0);
+
+  /* increment indices (mixed radix) */
+  it->index++;
+  for (diag = 3; diag >= 0; diag--) {
+    if (++it->idx[diag] < f->candidates_len[diag]) {
+      set_diagonal(it->subkey10, diag, f->candidates[diag][it->idx[diag]]);
+      break;
+    }
+    it->idx[diag] = 0;
+    set_diagonal(it->subkey10, diag, f->candidates[diag][0]);
+  }
+  return 1;
+}
+
+/**
+ * Write the factored key space:
+ * - header (see factored_header_t), including the positions of the bytes
+ *   of each diagonal in the last round key;
+ * - the four lists of candidates (32-bit words, byte i at position POSITIONS[diag][i]).
+ *
+ * A key is recovered by placing one candidate of each list in the last round key,
+ * then reversing the key schedule.
+ */
+int write_factored(const char *filename, const factored_t *factored, const factored_header_t *header) {
+  FILE *fp;
+  int i, j;
+  factored_header_t hdr = *header;
+
+  memcpy(hdr.magic, FACTORED_MAGIC, 8);
+  hdr.version = FACTORED_VERSION;
+  hdr.recipe = FACTORED_RECIPE_K10;
+  hdr.nkeys = factored_size(factored);
+  for (i = 0; i < 4; i++) {
+    hdr.candidates_len[i] = (uint32_t)factored->candidates_len[i];
+    for (j = 0; j < 4; j++) {
+      hdr.positions[i][j] = (uint8_t)POSITIONS[i][j];
+    }
+  }
+
+  fp = fopen(filename, "wb");
+  if (fp == NULL) {
+    return -1;
+  }
+  if (fwrite(&hdr, sizeof(hdr), 1, fp) != 1) {
+    fclose(fp);
+    return -1;
+  }
+  for (i = 0; i < 4; i++) {
+    if (fwrite(factored->candidates[i], sizeof(uint32_t), hdr.candidates_len[i], fp)
+        != hdr.candidates_len[i]) {
+      fclose(fp);
+      return -1;
+    }
+  }
+  fclose(fp);
+  return 0;
+}
+
+/**
+ * Map a factored key space in memory.
+ * Returns -1 if the file cannot be read or is not a factored key space.
+ */
+int factored_open(const char *filename, factored_t *factored, factored_header_t *header) {
+  int fd, i, j;
+  struct stat st;
+  size_t expected;
+  const uint8_t *map;
+  const uint32_t *lists;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return -1;
+  }
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(factored_header_t)) {
+    close(fd);
+    return -1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+
+  memcpy(header, map, sizeof(*header));
+  memset(factored, 0, sizeof(*factored));
+  factored->map = (void *)map;
+  factored->map_len = st.st_size;
+  if (memcmp(header->magic, FACTORED_MAGIC, 8) != 0 || header->version != FACTORED_VERSION
+      || header->recipe != FACTORED_RECIPE_K10) {
+    factored_free(factored);
+    return -1;
+  }
+
+  /* only the byte ordering of this implementation is supported */
+  expected = sizeof(*header);
+  for (i = 0; i < 4; i++) {
+    for (j = 0; j < 4; j++) {
+      if (header->positions[i][j] != POSITIONS[i][j]) {
+        factored_free(factored);
+        return -1;
+      }
+    }
+    expected += header->candidates_len[i] * sizeof(uint32_t);
+  }
+  if (expected > factored->map_len) {
+    factored_free(factored);
+    return -1;
+  }
+
+  lists = (const uint32_t *)(map + sizeof(*header));
+  for (i = 0; i < 4; i++) {
+    factored->candidates[i] = lists;
+    factored->candidates_len[i] = (int)header->candidates_len[i];
+    lists += header->candidates_len[i];
+  }
+  factored->is_some = true;
+  return 0;
+}
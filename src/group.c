@@ -0,0 +1,70 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+
+void ct_tables_init(ct_tables_t *tables, const uint8_t ct[16]) {
+  int i, k;
+  for (i = 0; i < 16; i++) {
+    for (k = 0; k < 256; k++) {
+      tables->inv[i][k] = invsbox[ct[i] ^ (uint8_t)k];
+    }
+  }
+}
+
+/**
+ * Group pairs by correct ciphertext (e.g., many faults injected on the same plaintext):
+ * the tables of the correct ciphertext are computed once for each group.
+ *
+ * Groups are allocated in `arena`, in order of first appearance of their ciphertext,
+ * and `group_of[i]` (if not NULL) receives the group of pair i.
+ * Returns the number of groups.
+ */
+int group_pairs(
+  const pair_t *pairs,
+  const int npairs,
+  arena_t *arena,
+  pair_group_t **groups,
+  int *group_of
+) {
+  int i, g;
+  int ngroups = 0;
+  int *of = arena_alloc(arena, npairs * sizeof(int));
+  int *count = arena_alloc(arena, npairs * sizeof(int));
+  pair_group_t *gr;
+
+  /* input files have at most a few hundreds of pairs: quadratic matching is enough */
+  memset(count, 0, npairs * sizeof(int));
+  for (i = 0; i < npairs; i++) {
+    for (g = 0; g < i && memcmp(pairs[g].ct, pairs[i].ct, 16) != 0; g++);
+    if (g == i) {
+      of[i] = ngroups++;
+    }
+    else {
+      of[i] = of[g];
+    }
+  }
+
+  gr = arena_alloc(arena, ngroups * sizeof(pair_group_t));
+  for (g = 0; g < ngroups; g++) {
+    gr[g].len = 0;
+  }
+  for (i = 0; i < npairs; i++) {
+    gr[of[i]].len++;
+  }
+  for (i = 0; i < npairs; i++) {
+    g = of[i];
+    if (count[g] == 0) {
+      gr[g].members = arena_alloc(arena, gr[g].len * sizeof(int));
+      memcpy(gr[g].ct, pairs[i].ct, 16);
+      ct_tables_init(&gr[g].tables, pairs[i].ct);
+    }
+    gr[g].members[count[g]++] = i;
+    if (group_of != NULL) {
+      group_of[i] = g;
+    }
+  }
+
+  *groups = gr;
+  return ngroups;
+}
@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "dfa.h"
+
+/* variants in order of preference (last is best) */
+static const kernel_t *KERNELS[KERNEL_COUNT] = {
+  &KERNEL_SOFT_IMPL,
+  &KERNEL_AESNI_IMPL,
+  &KERNEL_VAES_IMPL
+};
+
+static const kernel_t *current = NULL;
+static void (*current_encrypt)(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]);
+static void (*current_decrypt)(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]);
+
+/**
+ * Select the kernels `id` (KERNEL_SOFT, KERNEL_AESNI or KERNEL_VAES),
+ * or the best variant supported by the CPU with KERNEL_AUTO.
+ * Returns the selected variant, or -1 if `id` is not supported.
+ */
+int kernel_select(const int id) {
+  int i = id;
+
+  if (id == KERNEL_AUTO) {
+    for (i = KERNEL_COUNT - 1; i > 0 && !KERNELS[i]->supported(); i--);
+  }
+  else if (id < 0 || id >= KERNEL_COUNT || !KERNELS[id]->supported()) {
+    return -1;
+  }
+
+  if (KERNELS[i]->init != NULL) {
+    KERNELS[i]->init();
+  }
+  /* a variant without its own encryption uses the one of the previous variant */
+  current_encrypt = KERNELS[i]->encrypt != NULL ? KERNELS[i]->encrypt : KERNELS[i - 1]->encrypt;
+  current_decrypt = KERNELS[i]->decrypt != NULL ? KERNELS[i]->decrypt : KERNELS[i - 1]->decrypt;
+  current = KERNELS[i];
+  return i;
+}
+
+/**
+ * Identifier of a variant from its name ("auto" gives KERNEL_AUTO), -2 if unknown.
+ */
+int kernel_from_name(const char *name) {
+  int i;
+  if (strcmp(name, "auto") == 0) {
+    return KERNEL_AUTO;
+  }
+  for (i = 0; i < KERNEL_COUNT; i++) {
+    if (strcmp(name, KERNELS[i]->name) == 0) {
+      return i;
+    }
+  }
+  return -2;
+}
+
+const kernel_t *kernel_current(void) {
+  if (current == NULL) {
+    kernel_select(KERNEL_AUTO);
+  }
+  return current;
+}
+
+void encrypt_aes(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]) {
+  if (current == NULL) {
+    kernel_select(KERNEL_AUTO);
+  }
+  current_encrypt(input, output, subkeys);
+}
+
+void decrypt_aes(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]) {
+  if (current == NULL) {
+    kernel_select(KERNEL_AUTO);
+  }
+  current_decrypt(input, output, subkeys);
+}
@@ -0,0 +1,169 @@
+#include <stdalign.h>
+#include <stdint.h>
+#include <string.h>
+#include <wmmintrin.h>
+#include "dfa.h"
+
+/* keys whose schedules are inverted together (independent chains of aesenclast) */
+#define KEY_INVERSE_LANES 8
+
+/**
+ * Kernels with AES-NI instructions (this file is compiled with -maes -mssse3).
+ */
+static bool aesni_supported(void) {
+  return __builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3");
+}
+
+static void aesni_encrypt(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]) {
+  int i;
+  __m128i block = _mm_load_si128((const __m128i *)input);
+  __m128i subkey = _mm_load_si128((const __m128i *)subkeys);
+  block = _mm_xor_si128(block, subkey);
+
+  for (i = 1; i < 10; i++) {
+    subkey = _mm_load_si128((const __m128i *)(subkeys + 16*i));
+    block = _mm_aesenc_si128(block, subkey);
+  }
+
+  subkey = _mm_load_si128((const __m128i *)(subkeys + 160));
+  block = _mm_aesenclast_si128(block, subkey);
+
+  _mm_store_si128((__m128i *)output, block);
+}
+
+/**
+ * Equivalent inverse cipher: the round keys 1 to 9 go through inverse mix column.
+ */
+static void aesni_decrypt(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]) {
+  int i;
+  __m128i block = _mm_load_si128((const __m128i *)input);
+  __m128i subkey = _mm_load_si128((const __m128i *)(subkeys + 160));
+  block = _mm_xor_si128(block, subkey);
+
+  for (i = 9; i > 0; i--) {
+    subkey = _mm_load_si128((const __m128i *)(subkeys + 16*i));
+    block = _mm_aesdec_si128(block, _mm_aesimc_si128(subkey));
+  }
+
+  subkey = _mm_load_si128((const __m128i *)subkeys);
+  block = _mm_aesdeclast_si128(block, subkey);
+
+  _mm_store_si128((__m128i *)output, block);
+}
+
+static int aesni_r8_filter(
+  const r8_filter_t *filter,
+  const placed_t *base,
+  const placed_t *cand3,
+  const int len3,
+  int *survivors
+) {
+  int l;
+  int n = 0;
+  alignas(16) uint32_t diff32[4];
+  __m128i ct = _mm_loadu_si128((const __m128i *)filter->ct);
+  __m128i fct = _mm_loadu_si128((const __m128i *)filter->fct);
+
+  for (l = 0; l < len3; l++) {
+    __builtin_prefetch(&cand3[l + PLACED_PREFETCH]);
+
+    /* xor last round key */
+    __m128i k10 = _mm_or_si128(base->v, cand3[l].v);
+    __m128i x = _mm_xor_si128(ct, k10);
+    __m128i y = _mm_xor_si128(fct, k10);
+
+    /* decrypt last round */
+    __m128i k9 = _mm_aesimc_si128(ks_ni_k9(k10));
+    x = _mm_aesdec_si128(x, k9);
+    y = _mm_aesdec_si128(y, k9);
+
+    /* decrypt round 9 */
+    x = _mm_aesdec_si128(x, k9);
+    y = _mm_aesdec_si128(y, k9);
+
+    /* xor of states of ciphertext pair before mix column in round 8 */
+    x = _mm_xor_si128(x, y);
+    _mm_store_si128((__m128i *)diff32, x);
+
+    if (r8_filter_check(filter, diff32[filter->col8])) {
+      survivors[n++] = l;
+    }
+  }
+  return n;
+}
+
+static int aesni_r8_group_filter(
+  const r8_group_t *group,
+  const placed_t *base,
+  const placed_t *cand3,
+  const int len3,
+  int *survivors
+) {
+  int l, f;
+  int n = 0;
+  alignas(16) uint32_t diff32[4];
+  __m128i ct = _mm_loadu_si128((const __m128i *)group->ct);
+
+  for (l = 0; l < len3; l++) {
+    __builtin_prefetch(&cand3[l + PLACED_PREFETCH]);
+    __m128i k10 = _mm_or_si128(base->v, cand3[l].v);
+    __m128i k9 = _mm_aesimc_si128(ks_ni_k9(k10));
+
+    /* correct ciphertext decrypted once for the group */
+    __m128i x = _mm_xor_si128(ct, k10);
+    x = _mm_aesdec_si128(_mm_aesdec_si128(x, k9), k9);
+
+    for (f = 0; f < group->nfilters; f++) {
+      __m128i y = _mm_xor_si128(_mm_loadu_si128((const __m128i *)group->filters[f].fct), k10);
+      y = _mm_aesdec_si128(_mm_aesdec_si128(y, k9), k9);
+      _mm_store_si128((__m128i *)diff32, _mm_xor_si128(x, y));
+      if (!r8_filter_match(&group->filters[f], diff32)) {
+        break;
+      }
+    }
+    if (f == group->nfilters) {
+      survivors[n++] = l;
+    }
+  }
+  return n;
+}
+
+/**
+ * KEY_INVERSE_LANES keys at once (see ks_ni_inverse), the last ones one by one.
+ */
+static void aesni_key_inverse(const uint8_t *subkeys10, uint8_t *out, const int n, const int round) {
+  static const uint8_t RC[10] = {0x36, 0x1b, 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01};
+  int i, j, r;
+  int steps = round == 9 ? 1 : 10;
+  __m128i rc;
+  __m128i k[KEY_INVERSE_LANES];
+
+  if (round != 0 && round != 9) {
+    key_inverse_words(subkeys10, out, n, round);
+    return;
+  }
+  for (i = 0; i + KEY_INVERSE_LANES <= n; i += KEY_INVERSE_LANES) {
+    for (j = 0; j < KEY_INVERSE_LANES; j++) {
+      k[j] = _mm_loadu_si128((const __m128i *)(subkeys10 + 16*(i + j)));
+    }
+    for (r = 0; r < steps; r++) {
+      rc = _mm_set1_epi32(RC[r]);
+      for (j = 0; j < KEY_INVERSE_LANES; j++) {
+        k[j] = ks_ni_inverse(k[j], rc);
+      }
+    }
+    for (j = 0; j < KEY_INVERSE_LANES; j++) {
+      _mm_storeu_si128((__m128i *)(out + 16*(i + j)), k[j]);
+    }
+  }
+  for (; i < n; i++) {
+    k[0] = _mm_loadu_si128((const __m128i *)(subkeys10 + 16*i));
+    k[0] = round == 9 ? ks_ni_k9(k[0]) : ks_ni_k0(k[0]);
+    _mm_storeu_si128((__m128i *)(out + 16*i), k[0]);
+  }
+}
+
+const kernel_t KERNEL_AESNI_IMPL = {
+  "aesni", aesni_supported, NULL, aesni_encrypt, aesni_decrypt, aesni_r8_filter, aesni_r8_group_filter,
+  aesni_key_inverse
+};
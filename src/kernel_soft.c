@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include <string.h>
+#include "dfa.h"
+
+/**
+ * Software kernels (no AES instruction), for hosts without AES-NI.
+ *
+ * The decryption rounds use tables combining inverse sbox and
+ * inverse mix column (TD[r][x] is the column produced by byte x on row r),
+ * built once when the variant is selected.
+ * The filtering runs 5 to 8 times slower than with AES-NI (see dfa-check).
+ * It is not bitsliced: candidates of a batch share the ciphertexts and differ
+ * only in the four bytes of diagonal 3, so slicing across candidates is
+ * the way to speed it up.
+ */
+static uint32_t TD[4][256];
+
+#define ROTL8(w) (((w) << 8) | ((w) >> 24))
+
+static uint8_t gmul(uint8_t a, uint8_t b) {
+  uint8_t p = 0;
+  while (b != 0) {
+    if (b & 1) {
+      p ^= a;
+    }
+    a = XTIME(a);
+    b >>= 1;
+  }
+  return p;
+}
+
+static void soft_init(void) {
+  int r, x;
+  uint8_t s;
+  for (x = 0; x < 256; x++) {
+    s = invsbox[x];
+    TD[0][x] = (uint32_t)gmul(s, 0x0e)
+      | ((uint32_t)gmul(s, 0x09) << 8)
+      | ((uint32_t)gmul(s, 0x0d) << 16)
+      | ((uint32_t)gmul(s, 0x0b) << 24);
+    for (r = 1; r < 4; r++) {
+      TD[r][x] = ROTL8(TD[r - 1][x]);
+    }
+  }
+}
+
+static bool soft_supported(void) {
+  return true;
+}
+
+/**
+ * Same as the instruction aesdec: inverse shift row, inverse sbox,
+ * inverse mix column, then xor with `key` (state as four 32-bit columns).
+ */
+static void aesdec(uint32_t state[4], const uint32_t key[4]) {
+  int c;
+  uint32_t out[4];
+  for (c = 0; c < 4; c++) {
+    out[c] = TD[0][state[c] & 0xff]
+      ^ TD[1][(state[(c + 3) & 3] >> 8) & 0xff]
+      ^ TD[2][(state[(c + 2) & 3] >> 16) & 0xff]
+      ^ TD[3][state[(c + 1) & 3] >> 24]
+      ^ key[c];
+  }
+  memcpy(state, out, 16);
+}
+
+/**
+ * Inverse mix column of a round key (as the instruction aesimc):
+ * the tables include the inverse sbox, so bytes go through the sbox first.
+ */
+static void aesimc(uint32_t key[4]) {
+  int c;
+  for (c = 0; c < 4; c++) {
+    key[c] = TD[0][sbox[key[c] & 0xff]]
+      ^ TD[1][sbox[(key[c] >> 8) & 0xff]]
+      ^ TD[2][sbox[(key[c] >> 16) & 0xff]]
+      ^ TD[3][sbox[key[c] >> 24]];
+  }
+}
+
+static void soft_encrypt(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]) {
+  int i, round;
+  uint8_t s[16], t[16];
+
+  for (i = 0; i < 16; i++) {
+    s[i] = input[i] ^ subkeys[i];
+  }
+  for (round = 1; round < 11; round++) {
+    /* sub bytes and shift rows */
+    for (i = 0; i < 16; i++) {
+      t[i] = sbox[s[(i + 4*(i % 4)) % 16]];
+    }
+    if (round < 10) {
+      for (i = 0; i < 16; i += 4) {
+        mix_column(t + i);
+      }
+    }
+    for (i = 0; i < 16; i++) {
+      s[i] = t[i] ^ subkeys[16*round + i];
+    }
+  }
+  memcpy(output, s, 16);
+}
+
+static void soft_decrypt(const uint8_t input[16], uint8_t output[16], const uint8_t subkeys[176]) {
+  int i, round;
+  uint8_t s[16], t[16];
+
+  for (i = 0; i < 16; i++) {
+    s[i] = input[i] ^ subkeys[160 + i];
+  }
+  for (round = 9; round >= 0; round--) {
+    /* inverse shift rows and inverse sub bytes */
+    for (i = 0; i < 16; i++) {
+      t[i] = invsbox[s[(i + 16 - 4*(i % 4)) % 16]];
+    }
+    for (i = 0; i < 16; i++) {
+      s[i] = t[i] ^ subkeys[16*round + i];
+    }
+    if (round > 0) {
+      for (i = 0; i < 16; i += 4) {
+        inv_mix_column(s + i);
+      }
+    }
+  }
+  memcpy(output, s, 16);
+}
+
+static int soft_r8_filter(
+  const r8_filter_t *filter,
+  const placed_t *base,
+  const placed_t *cand3,
+  const int len3,
+  int *survivors
+) {
+  int l, c;
+  int n = 0;
+  uint32_t k10[4], k9[4], x[4], y[4], ct[4], fct[4];
+
+  memcpy(ct, filter->ct, 16);
+  memcpy(fct, filter->fct, 16);
+  for (l = 0; l < len3; l++) {
+    for (c = 0; c < 4; c++) {
+      k10[c] = base->w[c] | cand3[l].w[c];
+    }
+    k9_from_k10((const uint8_t *)k10, (uint8_t *)k9);
+    aesimc(k9);
+
+    /* decrypt last round and round 9 */
+    for (c = 0; c < 4; c++) {
+      x[c] = ct[c] ^ k10[c];
+      y[c] = fct[c] ^ k10[c];
+    }
+    aesdec(x, k9);
+    aesdec(y, k9);
+    aesdec(x, k9);
+    aesdec(y, k9);
+
+    if (r8_filter_check(filter, x[filter->col8] ^ y[filter->col8])) {
+      survivors[n++] = l;
+    }
+  }
+  return n;
+}
+
+static int soft_r8_group_filter(
+  const r8_group_t *group,
+  const placed_t *base,
+  const placed_t *cand3,
+  const int len3,
+  int *survivors
+) {
+  int l, c, f;
+  int n = 0;
+  uint32_t k10[4], k9[4], x[4], y[4], diff[4], ct[4];
+
+  memcpy(ct, group->ct, 16);
+  for (l = 0; l < len3; l++) {
+    for (c = 0; c < 4; c++) {
+      k10[c] = base->w[c] | cand3[l].w[c];
+    }
+    k9_from_k10((const uint8_t *)k10, (uint8_t *)k9);
+    aesimc(k9);
+
+    /* correct ciphertext decrypted once for the group */
+    for (c = 0; c < 4; c++) {
+      x[c] = ct[c] ^ k10[c];
+    }
+    aesdec(x, k9);
+    aesdec(x, k9);
+
+    for (f = 0; f < group->nfilters; f++) {
+      memcpy(y, group->filters[f].fct, 16);
+      for (c = 0; c < 4; c++) {
+        y[c] ^= k10[c];
+      }
+      aesdec(y, k9);
+      aesdec(y, k9);
+      for (c = 0; c < 4; c++) {
+        diff[c] = x[c] ^ y[c];
+      }
+      if (!r8_filter_match(&group->filters[f], diff)) {
+        break;
+      }
+    }
+    if (f == group->nfilters) {
+      survivors[n++] = l;
+    }
+  }
+  return n;
+}
+
+const kernel_t KERNEL_SOFT_IMPL = {
+  "soft", soft_supported, soft_init, soft_encrypt, soft_decrypt, soft_r8_filter, soft_r8_group_filter,
+  key_inverse_words
+};
@@ -0,0 +1,173 @@
+#include <immintrin.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <string.h>
+#include "dfa.h"
+
+/**
+ * Kernels with VAES instructions (this file is compiled with -mvaes -mavx2):
+ * two candidates are processed together, one in each 128-bit lane
+ * of a 256-bit register (for the correct and for the faulty ciphertext).
+ * Encryption (rare) is the same as with AES-NI.
+ */
+static bool vaes_supported(void) {
+  return __builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx2")
+    && __builtin_cpu_supports("aes");
+}
+
+static int vaes_r8_filter(
+  const r8_filter_t *filter,
+  const placed_t *base,
+  const placed_t *cand3,
+  const int len3,
+  int *survivors
+) {
+  int l;
+  int n = 0;
+  int col8 = filter->col8;
+  alignas(32) uint32_t diff32[8];
+  __m256i base2 = _mm256_broadcastsi128_si256(base->v);
+  __m256i ct = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)filter->ct));
+  __m256i fct = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)filter->fct));
+
+  for (l = 0; l + 1 < len3; l += 2) {
+    __builtin_prefetch(&cand3[l + PLACED_PREFETCH]);
+
+    /* xor last round keys (candidate l in the low lane, l + 1 in the high lane) */
+    __m256i k10 = _mm256_or_si256(base2, _mm256_loadu_si256((const __m256i *)&cand3[l]));
+    __m256i x = _mm256_xor_si256(ct, k10);
+    __m256i y = _mm256_xor_si256(fct, k10);
+
+    /* decrypt last round and round 9 */
+    __m256i k9 = ks_vaes_k9(k10);
+    k9 = _mm256_set_m128i(
+      _mm_aesimc_si128(_mm256_extracti128_si256(k9, 1)),
+      _mm_aesimc_si128(_mm256_castsi256_si128(k9))
+    );
+    x = _mm256_aesdec_epi128(x, k9);
+    y = _mm256_aesdec_epi128(y, k9);
+    x = _mm256_aesdec_epi128(x, k9);
+    y = _mm256_aesdec_epi128(y, k9);
+
+    /* xor of states of ciphertext pair before mix column in round 8 */
+    _mm256_store_si256((__m256i *)diff32, _mm256_xor_si256(x, y));
+
+    if (r8_filter_check(filter, diff32[col8])) {
+      survivors[n++] = l;
+    }
+    if (r8_filter_check(filter, diff32[4 + col8])) {
+      survivors[n++] = l + 1;
+    }
+  }
+
+  /* last candidate (odd length) */
+  if (l < len3) {
+    __m128i k10 = _mm_or_si128(base->v, cand3[l].v);
+    __m128i k9 = _mm_aesimc_si128(ks_ni_k9(k10));
+    __m128i x = _mm_xor_si128(_mm256_castsi256_si128(ct), k10);
+    __m128i y = _mm_xor_si128(_mm256_castsi256_si128(fct), k10);
+    x = _mm_aesdec_si128(_mm_aesdec_si128(x, k9), k9);
+    y = _mm_aesdec_si128(_mm_aesdec_si128(y, k9), k9);
+    _mm_store_si128((__m128i *)diff32, _mm_xor_si128(x, y));
+    if (r8_filter_check(filter, diff32[col8])) {
+      survivors[n++] = l;
+    }
+  }
+  return n;
+}
+
+static int vaes_r8_group_filter(
+  const r8_group_t *group,
+  const placed_t *base,
+  const placed_t *cand3,
+  const int len3,
+  int *survivors
+) {
+  int l, f;
+  int n = 0;
+  bool pass0, pass1;
+  alignas(32) uint32_t diff32[8];
+  __m256i base2 = _mm256_broadcastsi128_si256(base->v);
+  __m256i ct = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)group->ct));
+
+  for (l = 0; l + 1 < len3; l += 2) {
+    __builtin_prefetch(&cand3[l + PLACED_PREFETCH]);
+    __m256i k10 = _mm256_or_si256(base2, _mm256_loadu_si256((const __m256i *)&cand3[l]));
+    __m256i k9 = ks_vaes_k9(k10);
+    k9 = _mm256_set_m128i(
+      _mm_aesimc_si128(_mm256_extracti128_si256(k9, 1)),
+      _mm_aesimc_si128(_mm256_castsi256_si128(k9))
+    );
+
+    /* correct ciphertext decrypted once for the group (both candidates) */
+    __m256i x = _mm256_xor_si256(ct, k10);
+    x = _mm256_aesdec_epi128(_mm256_aesdec_epi128(x, k9), k9);
+
+    /* faulty ciphertexts until both candidates fail */
+    pass0 = true;
+    pass1 = true;
+    for (f = 0; f < group->nfilters && (pass0 || pass1); f++) {
+      __m256i fct = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)group->filters[f].fct));
+      __m256i y = _mm256_xor_si256(fct, k10);
+      y = _mm256_aesdec_epi128(_mm256_aesdec_epi128(y, k9), k9);
+      _mm256_store_si256((__m256i *)diff32, _mm256_xor_si256(x, y));
+      pass0 = pass0 && r8_filter_match(&group->filters[f], diff32);
+      pass1 = pass1 && r8_filter_match(&group->filters[f], diff32 + 4);
+    }
+    if (pass0) {
+      survivors[n++] = l;
+    }
+    if (pass1) {
+      survivors[n++] = l + 1;
+    }
+  }
+
+  /* last candidate (odd length) */
+  if (l < len3) {
+    __m128i k10 = _mm_or_si128(base->v, cand3[l].v);
+    __m128i k9 = _mm_aesimc_si128(ks_ni_k9(k10));
+    __m128i x = _mm_xor_si128(_mm256_castsi256_si128(ct), k10);
+    x = _mm_aesdec_si128(_mm_aesdec_si128(x, k9), k9);
+    for (f = 0; f < group->nfilters; f++) {
+      __m128i y = _mm_xor_si128(_mm_loadu_si128((const __m128i *)group->filters[f].fct), k10);
+      y = _mm_aesdec_si128(_mm_aesdec_si128(y, k9), k9);
+      _mm_store_si128((__m128i *)diff32, _mm_xor_si128(x, y));
+      if (!r8_filter_match(&group->filters[f], diff32)) {
+        break;
+      }
+    }
+    if (f == group->nfilters) {
+      survivors[n++] = l;
+    }
+  }
+  return n;
+}
+
+/**
+ * Two keys at once (see ks_vaes_inverse), the last one with AES-NI if `n` is odd.
+ */
+static void vaes_key_inverse(const uint8_t *subkeys10, uint8_t *out, const int n, const int round) {
+  int i;
+  __m256i k;
+  __m128i k1;
+
+  if (round != 0 && round != 9) {
+    key_inverse_words(subkeys10, out, n, round);
+    return;
+  }
+  for (i = 0; i + 1 < n; i += 2) {
+    k = _mm256_loadu_si256((const __m256i *)(subkeys10 + 16*i));
+    k = round == 9 ? ks_vaes_k9(k) : ks_vaes_k0(k);
+    _mm256_storeu_si256((__m256i *)(out + 16*i), k);
+  }
+  if (i < n) {
+    k1 = _mm_loadu_si128((const __m128i *)(subkeys10 + 16*i));
+    k1 = round == 9 ? ks_ni_k9(k1) : ks_ni_k0(k1);
+    _mm_storeu_si128((__m128i *)(out + 16*i), k1);
+  }
+}
+
+const kernel_t KERNEL_VAES_IMPL = {
+  "vaes", vaes_supported, NULL, NULL, NULL, vaes_r8_filter, vaes_r8_group_filter,
+  vaes_key_inverse
+};
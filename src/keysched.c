@@ -0,0 +1,59 @@
+#include <stdint.h>
+#include <string.h>
+#include "dfa.h"
+
+/* SubWord(RotWord(w)) */
+static inline uint32_t sub_rot_word(const uint32_t w) {
+  return (uint32_t)sbox[(w >> 8) & 0xff]
+    | ((uint32_t)sbox[(w >> 16) & 0xff] << 8)
+    | ((uint32_t)sbox[w >> 24] << 16)
+    | ((uint32_t)sbox[w & 0xff] << 24);
+}
+
+/**
+ * Round key r - 1 from the round key r (see keysched.h).
+ */
+static inline void inverse_step(uint32_t w[4], const int r) {
+  w[3] ^= w[2];
+  w[2] ^= w[1];
+  w[1] ^= w[0];
+  w[0] ^= sub_rot_word(w[3]) ^ rcon[r - 1];
+}
+
+void k9_from_k10(const uint8_t subkey10[16], uint8_t subkey9[16]) {
+  uint32_t w[4];
+  memcpy(w, subkey10, 16);
+  inverse_step(w, 10);
+  memcpy(subkey9, w, 16);
+}
+
+/**
+ * Reconstruct the AES round keys from the last one
+ * (all of them are needed for an encryption).
+ */
+void reverse_key_expansion(const uint8_t subkey10[16], uint8_t subkeys[176]) {
+  int r;
+  uint32_t w[4];
+  memcpy(w, subkey10, 16);
+  memcpy(subkeys + 160, w, 16);
+  for (r = 10; r > 0; r--) {
+    inverse_step(w, r);
+    memcpy(subkeys + 16*(r - 1), w, 16);
+  }
+}
+
+/**
+ * Round keys `round` (9, or 0 for the master keys) of `n` keys
+ * given by their last round keys (16 bytes each), without AES instructions.
+ */
+void key_inverse_words(const uint8_t *subkeys10, uint8_t *out, const int n, const int round) {
+  int i, r;
+  uint32_t w[4];
+  for (i = 0; i < n; i++) {
+    memcpy(w, subkeys10 + 16*i, 16);
+    for (r = 10; r > round; r--) {
+      inverse_step(w, r);
+    }
+    memcpy(out + 16*i, w, 16);
+  }
+}
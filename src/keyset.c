@@ -0,0 +1,190 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+
+#define SLOT_EMPTY 0
+#define SLOT_BUSY 1
+#define SLOT_READY 2
+
+/**
+ * Hash of a 128-bit key (keys are expected to be uniformly distributed,
+ * so folding both halves with a multiplicative mix is enough).
+ */
+static uint64_t key_hash(const uint8_t key[16]) {
+  uint64_t lo, hi;
+  memcpy(&lo, key, 8);
+  memcpy(&hi, key + 8, 8);
+  lo ^= hi * 0x9e3779b97f4a7c15UL;
+  lo ^= lo >> 29;
+  lo *= 0xbf58476d1ce4e5b9UL;
+  lo ^= lo >> 32;
+  return lo;
+}
+
+/**
+ * Allocate a set able to hold `max_keys` distinct keys.
+ * The table is kept at most half full so that probing stays short.
+ *
+ * Returns -1 if memory cannot be allocated.
+ */
+int keyset_init(keyset_t *set, const size_t max_keys) {
+  size_t capacity = 16;
+
+  set->max_keys = max_keys > 0 ? max_keys : 1;
+  while (capacity < 2*set->max_keys) {
+    capacity <<= 1;
+  }
+
+  set->keys = malloc(capacity * sizeof(*set->keys));
+  set->hypotheses = calloc(capacity, sizeof(*set->hypotheses));
+  set->state = calloc(capacity, sizeof(*set->state));
+  set->order = malloc(set->max_keys * sizeof(*set->order));
+  set->capacity = capacity;
+  set->len = 0;
+  set->inserts = 0;
+  set->overflow = 0;
+
+  if (set->keys == NULL || set->hypotheses == NULL || set->state == NULL || set->order == NULL) {
+    keyset_free(set);
+    return -1;
+  }
+  return 0;
+}
+
+void keyset_free(keyset_t *set) {
+  free(set->keys);
+  free(set->hypotheses);
+  free(set->state);
+  free(set->order);
+  set->keys = NULL;
+  set->hypotheses = NULL;
+  set->state = NULL;
+  set->order = NULL;
+  set->len = 0;
+}
+
+/**
+ * Make room for `n` more distinct keys: the table is doubled (or more)
+ * and the keys are rehashed, keeping their order of first insertion.
+ * Not thread-safe: called before inserting a known number of keys
+ * (e.g., by results_merge once the searches are done).
+ *
+ * Returns -1 if memory cannot be allocated (the set is then unchanged).
+ */
+int keyset_reserve(keyset_t *set, const size_t n) {
+  size_t i, slot, mask;
+  size_t max_keys = set->max_keys;
+  keyset_t grown;
+
+  if (set->len + n <= set->max_keys) {
+    return 0;
+  }
+  while (max_keys < set->len + n) {
+    max_keys *= 2;
+  }
+  if (keyset_init(&grown, max_keys) == -1) {
+    return -1;
+  }
+
+  mask = grown.capacity - 1;
+  for (i = 0; i < set->len; i++) {
+    slot = (size_t)key_hash(set->keys[set->order[i]]) & mask;
+    while (grown.state[slot] != SLOT_EMPTY) {
+      slot = (slot + 1) & mask;
+    }
+    memcpy(grown.keys[slot], set->keys[set->order[i]], 16);
+    grown.hypotheses[slot] = set->hypotheses[set->order[i]];
+    grown.state[slot] = SLOT_READY;
+    grown.order[i] = (uint32_t)slot;
+  }
+  grown.len = set->len;
+  grown.inserts = set->inserts;
+  grown.overflow = set->overflow;
+  keyset_free(set);
+  *set = grown;
+  return 0;
+}
+
+/**
+ * Insert a key produced under hypothesis `hypothesis` (in [0, 63]).
+ * Safe to call concurrently from several threads without a lock:
+ * a slot is claimed with a compare-and-swap on its state, then the key
+ * is published; threads probing a slot being written wait for it.
+ *
+ * Returns 1 if the key is new, 0 if it was already in the set
+ * (the hypothesis is recorded anyway) and -1 if the set is full
+ * (the set is not grown here: see keyset_reserve).
+ */
+int keyset_insert(keyset_t *set, const uint8_t key[16], const int hypothesis) {
+  size_t mask = set->capacity - 1;
+  size_t slot = (size_t)key_hash(key) & mask;
+  size_t idx;
+  uint8_t state;
+  uint64_t hyp = 1UL << (hypothesis & 63);
+
+  __atomic_fetch_add(&set->inserts, 1, __ATOMIC_RELAXED);
+
+  for (;;) {
+    state = __atomic_load_n(&set->state[slot], __ATOMIC_ACQUIRE);
+
+    if (state == SLOT_EMPTY) {
+      /* refuse new keys when the order list is full */
+      if (__atomic_load_n(&set->len, __ATOMIC_RELAXED) >= set->max_keys) {
+        __atomic_fetch_add(&set->overflow, 1, __ATOMIC_RELAXED);
+        return -1;
+      }
+      if (__atomic_compare_exchange_n(
+            &set->state[slot], &state, SLOT_BUSY, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        idx = __atomic_fetch_add(&set->len, 1, __ATOMIC_RELAXED);
+        if (idx >= set->max_keys) {
+          /* lost the race for the last place: free the slot again (threads
+           * probing it waited while it was busy, so no key lies beyond it) */
+          __atomic_fetch_sub(&set->len, 1, __ATOMIC_RELAXED);
+          __atomic_fetch_add(&set->overflow, 1, __ATOMIC_RELAXED);
+          __atomic_store_n(&set->state[slot], SLOT_EMPTY, __ATOMIC_RELEASE);
+          return -1;
+        }
+        memcpy(set->keys[slot], key, 16);
+        __atomic_fetch_or(&set->hypotheses[slot], hyp, __ATOMIC_RELAXED);
+        set->order[idx] = (uint32_t)slot;
+        __atomic_store_n(&set->state[slot], SLOT_READY, __ATOMIC_RELEASE);
+        return 1;
+      }
+      /* another thread claimed the slot: look at it again */
+      continue;
+    }
+
+    if (state == SLOT_BUSY) {
+      /* key being written by another thread */
+      continue;
+    }
+
+    if (memcmp(set->keys[slot], key, 16) == 0) {
+      __atomic_fetch_or(&set->hypotheses[slot], hyp, __ATOMIC_RELAXED);
+      return 0;
+    }
+    slot = (slot + 1) & mask;
+  }
+}
+
+/**
+ * Number of distinct keys in the set.
+ */
+size_t keyset_len(const keyset_t *set) {
+  return set->len;
+}
+
+/**
+ * Access the i-th distinct key (in order of first insertion).
+ */
+const uint8_t *keyset_get(const keyset_t *set, const size_t i) {
+  return set->keys[set->order[i]];
+}
+
+/**
+ * Bitmask of the hypotheses that produced the i-th distinct key.
+ */
+uint64_t keyset_hypotheses(const keyset_t *set, const size_t i) {
+  return set->hypotheses[set->order[i]];
+}
@@ -1,57 +1,272 @@
+#include <getopt.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "dfa.h"
 #ifdef _OPENMP
 #include "omp.h"
 #endif
 
 static char *DEFAULT_OUTPUT_FILENAME = "keys.txt";
+static char *DEFAULT_BINARY_FILENAME = "keys.bin";
+static char *DEFAULT_FACTORED_FILENAME = "keys.fact";
+
+#define OPT_TIME_BUDGET 256
+#define OPT_KERNEL 257
+#define OPT_CHUNK 258
+#define OPT_AUTOTUNE 259
+#define OPT_ESTIMATE 260
+#define OPT_DAEMON 261
+#define OPT_JOBS 262
+#define OPT_PROFILE 263
+#define OPT_FILTER 264
+
+static struct option long_options[] = {
+  {"time-budget", required_argument, NULL, OPT_TIME_BUDGET},
+  {"kernel", required_argument, NULL, OPT_KERNEL},
+  {"threads", required_argument, NULL, 't'},
+  {"chunk", required_argument, NULL, OPT_CHUNK},
+  {"autotune", no_argument, NULL, OPT_AUTOTUNE},
+  {"estimate", no_argument, NULL, OPT_ESTIMATE},
+  {"daemon", required_argument, NULL, OPT_DAEMON},
+  {"jobs", required_argument, NULL, OPT_JOBS},
+  {"profile", required_argument, NULL, OPT_PROFILE},
+  {"filter", required_argument, NULL, OPT_FILTER},
+  {NULL, 0, NULL, 0}
+};
+
+/**
+ * Write keys to a file (text or binary format),
+ * falling back to /tmp if the file cannot be written.
+ */
+static void save_keys(
+  char *out_fname,
+  const int format,
+  const keyset_t *keys,
+  const keyfile_header_t *header
+) {
+  FILE *fp;
+  int err;
+  char *fallback = format == OUTPUT_BINARY ? "/tmp/keys.bin" : "/tmp/keys.txt";
+
+  if (format == OUTPUT_BINARY) {
+    err = write_keys_binary(out_fname, keys, header);
+    if (err != 0) {
+      fprintf(stderr, "[!] Cannot write to file '%s', writing to '%s'\n", out_fname, fallback);
+      out_fname = fallback;
+      err = write_keys_binary(out_fname, keys, header);
+    }
+  }
+  else {
+    fp = fopen(out_fname, "w");
+    if (fp == NULL) {
+      fprintf(stderr, "[!] Cannot write to file '%s', writing to '%s'\n", out_fname, fallback);
+      out_fname = fallback;
+      fp = fopen(out_fname, "w");
+    }
+    err = fp == NULL ? -1 : write_keys_text(fp, keys);
+    if (fp != NULL && fclose(fp) != 0) {
+      err = -1;
+    }
+  }
+
+  if (err != 0) {
+    fprintf(stderr, "[!] Cannot write to file '%s', I give up\n", out_fname);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stderr, "[*] %zu keys written to file %s\n", keyset_len(keys), out_fname);
+}
+
+/**
+ * Threads, schedule and AES kernels: tuned for this host if requested,
+ * options given on the command line take precedence.
+ */
+static void setup_tuning(
+  tuning_t *tuning,
+  const bool autotune,
+  const int threads,
+  const int chunk,
+  const int kernel,
+  const char *kernel_name
+) {
+  tune_defaults(tuning);
+  if (autotune) {
+    tune_host(tuning);
+  }
+  if (threads > 0) {
+    tuning->threads = threads;
+  }
+  if (chunk > 0) {
+    tuning->chunk = chunk;
+  }
+  if (kernel != KERNEL_AUTO) {
+    tuning->kernel = kernel;
+  }
+  if (tune_apply(tuning) == -1) {
+    fprintf(stderr, "[!] Kernels '%s' not supported by this CPU\n", kernel_name);
+    exit(EXIT_FAILURE);
+  }
+}
 
 int main(int argc, char *argv[]) {
-  FILE *fp = NULL;
-  pair_t pairs[PAIRS_MAX];
+  pair_t *pairs = NULL;
   known_pt_t known_pt;
-  int i, j, opt, err, nkeys, npairs;
+  int opt, err, nkeys;
+  int format = OUTPUT_TEXT;
+  int npairs = 0;
   int mode = -1;
-  uint8_t masterkeys[KEYS_MAX][16];
-  char options[] = "89o:i:";
+  size_t i;
+  keyset_t keys;
+  keyfile_header_t header = {0};
+  factored_t factored = {0};
+  factored_header_t fheader = {0};
+  int pinning = PIN_NONE;
+  int kernel = KERNEL_AUTO;
+  char *kernel_name = "auto";
+  int threads = 0;
+  int chunk = 0;
+  bool autotune = false;
+  bool estimate = false;
+  bool bitflip = false;
+  char *socket_path = NULL;
+  int njobs = 1;
+  char *profile_fname = NULL;
+  char *filter_fname = NULL;
+  FILE *fp;
+  tuning_t tuning;
+  char options[] = "89o:i:f:c:P:t:";
   char *in_fname = NULL;
   char *out_fname = NULL;
+  char *end;
+  double budget = 0;
+  search_ctl_t ctl;
+  arena_t arena;
 #ifdef _OPENMP
   int num_threads;
 #endif
 
   /* scan command line arguments */
-  opt = getopt(argc, argv, options);
+  opt = getopt_long(argc, argv, options, long_options, NULL);
   while (opt != -1) {
     switch(opt) {
 
     case '8':
-      if (mode == -1) {
-        mode = DFA_ROUND_8;
+      /* -8 and -9 together: pairs from both rounds are combined */
+      mode = (mode == DFA_ROUND_9 || mode == DFA_MIXED) ? DFA_MIXED : DFA_ROUND_8;
+      break;
+
+    case '9':
+      mode = (mode == DFA_ROUND_8 || mode == DFA_MIXED) ? DFA_MIXED : DFA_ROUND_9;
+      break;
+
+    case 'i':
+      in_fname = optarg;
+      break;
+
+    case 'o':
+      out_fname = optarg;
+      break;
+
+    case 'f':
+      if (strcmp(optarg, "text") == 0) {
+        format = OUTPUT_TEXT;
+      }
+      else if (strcmp(optarg, "binary") == 0) {
+        format = OUTPUT_BINARY;
+      }
+      else if (strcmp(optarg, "factored") == 0) {
+        format = OUTPUT_FACTORED;
+        factored.requested = true;
       }
       else {
-        fprintf(stderr, "[!] -8 and -9 cannot be used at the same time\n");
+        fprintf(stderr, "[!] Output format must be 'text', 'binary' or 'factored'\n");
         exit(EXIT_FAILURE);
       }
       break;
 
-    case '9':
-      if (mode == -1) {
-        mode = DFA_ROUND_9;
+    case 'c':
+      if (cache_init(optarg) != 0) {
+        fprintf(stderr, "[!] Cache directory '%s' cannot be used\n", optarg);
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case 'P':
+      if (strcmp(optarg, "compact") == 0) {
+        pinning = PIN_COMPACT;
+      }
+      else if (strcmp(optarg, "scatter") == 0) {
+        pinning = PIN_SCATTER;
       }
       else {
-        fprintf(stderr, "[!] -8 and -9 cannot be used at the same time\n");
+        fprintf(stderr, "[!] Thread pinning must be 'compact' or 'scatter'\n");
         exit(EXIT_FAILURE);
       }
       break;
 
-    case 'i':
-      in_fname = optarg;
+    case OPT_TIME_BUDGET:
+      budget = strtod(optarg, &end);
+      if (*end != '\0' || !(budget > 0)) {
+        fprintf(stderr, "[!] Time budget must be a positive number of seconds\n");
+        exit(EXIT_FAILURE);
+      }
       break;
 
-    case 'o':
-      out_fname = optarg;
+    case OPT_KERNEL:
+      kernel_name = optarg;
+      kernel = kernel_from_name(optarg);
+      if (kernel == -2) {
+        fprintf(stderr, "[!] Kernels must be 'auto', 'soft', 'aesni' or 'vaes'\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case 't':
+      threads = (int)strtol(optarg, &end, 10);
+      if (*end != '\0' || threads < 1) {
+        fprintf(stderr, "[!] Number of threads must be a positive integer\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case OPT_CHUNK:
+      chunk = (int)strtol(optarg, &end, 10);
+      if (*end != '\0' || chunk < 1) {
+        fprintf(stderr, "[!] Chunk size must be a positive integer\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case OPT_AUTOTUNE:
+      autotune = true;
+      break;
+
+    case OPT_ESTIMATE:
+      estimate = true;
+      break;
+
+    case OPT_DAEMON:
+      socket_path = optarg;
+      break;
+
+    case OPT_JOBS:
+      njobs = (int)strtol(optarg, &end, 10);
+      if (*end != '\0' || njobs < 1) {
+        fprintf(stderr, "[!] Number of jobs must be a positive integer\n");
+        exit(EXIT_FAILURE);
+      }
+      break;
+
+    case OPT_PROFILE:
+      if (!profile_available()) {
+        fprintf(stderr, "[!] Built without profiling (make PROFILE=1)\n");
+        exit(EXIT_FAILURE);
+      }
+      profile_fname = optarg;
+      break;
+
+    case OPT_FILTER:
+      filter_fname = optarg;
       break;
 
     case '?':
@@ -59,7 +274,15 @@ int main(int argc, char *argv[]) {
       exit(EXIT_FAILURE);
       break;
     }
-    opt = getopt(argc, argv, options);
+    opt = getopt_long(argc, argv, options, long_options, NULL);
+  }
+
+  /* daemon: jobs come from the socket (each with its round and data) */
+  if (socket_path != NULL) {
+    setup_tuning(&tuning, autotune, threads, chunk, kernel, kernel_name);
+    fprintf(stderr, "[*] Kernels: %s\n", kernel_current()->name);
+    err = daemon_run(socket_path, njobs, max_threads(), tuning.chunk);
+    return err == 0 ? 0 : EXIT_FAILURE;
   }
 
   if (mode == -1) {
@@ -73,68 +296,194 @@ int main(int argc, char *argv[]) {
   }
 
   if (out_fname == NULL) {
-    out_fname = DEFAULT_OUTPUT_FILENAME;
+    out_fname = format == OUTPUT_BINARY ? DEFAULT_BINARY_FILENAME : DEFAULT_OUTPUT_FILENAME;
+    if (format == OUTPUT_FACTORED) {
+      out_fname = DEFAULT_FACTORED_FILENAME;
+    }
   }
 
   /* load data from file */
-  err = readfile(in_fname, pairs, &npairs, &known_pt);
+  err = readfile(in_fname, &pairs, &npairs, &known_pt);
   if (err == -1) {
     fprintf(stderr, "[!] Input file cannot be opened\n");
     exit(EXIT_FAILURE);
   }
+  /* the keys of a previous run can be checked against known plaintexts only */
+  if (npairs == 0 && filter_fname == NULL) {
+    fprintf(stderr, "[!] No ciphertext pair in the input file\n");
+    exit(EXIT_FAILURE);
+  }
 
   if (known_pt.is_some) {
     fprintf(stderr, "[*] A known plaintext/ciphertext has been provided\n");
   }
 
+  npairs = select_pairs(pairs, npairs, mode);
+  if (npairs == 0 && filter_fname == NULL) {
+    fprintf(stderr, "[!] No ciphertext pair for this round\n");
+    exit(EXIT_FAILURE);
+  }
+  /* a bitflip at a known position is searched bit by bit in round 8 */
+  for (i = 0; i < (size_t)npairs && mode != DFA_ROUND_9; i++) {
+    if (pairs[i].bitflip && pairs[i].fault_pos >= 0 && pairs[i].fault_pos < 16) {
+      bitflip = true;
+    }
+  }
+
+  setup_tuning(&tuning, autotune, threads, chunk, kernel, kernel_name);
 #ifdef _OPENMP
   num_threads = omp_get_max_threads();
   fprintf(stderr, "[*] Number of threads: %d\n", num_threads);
 #endif
+  pin_threads(pinning);
+  fprintf(stderr, "[*] Kernels: %s\n", kernel_current()->name);
+
+  /* estimate of the search only */
+  if (estimate) {
+    arena_init(&arena, 0);
+    err = mode == DFA_ROUND_8 ? r8_estimate(pairs, npairs, &arena, NULL, NULL, &known_pt) : -1;
+    arena_free(&arena);
+    free(pairs);
+    if (err == -1) {
+      fprintf(stderr, "[!] Estimate only available for a single pair with a fault in round 8\n");
+      exit(EXIT_FAILURE);
+    }
+    return 0;
+  }
+
+  if (keyset_init(&keys, KEYSET_INITIAL) == -1) {
+    fprintf(stderr, "[!] Cannot allocate the key set\n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* with a time budget, keys are printed on stdout as soon as they are found */
+  if (budget > 0 && mode == DFA_ROUND_9) {
+    fprintf(stderr, "[!] Time budget ignored with a fault in round 9\n");
+    budget = 0;
+  }
+  if (search_ctl_init(&ctl, budget, budget > 0) == -1) {
+    fprintf(stderr, "[!] Cannot allocate the key set\n");
+    exit(EXIT_FAILURE);
+  }
+  if (budget > 0) {
+    fprintf(stderr, "[*] Time budget: %.1f s\n", budget);
+  }
 
-  /* launch analysis */
-  if (mode == DFA_ROUND_9) {
-    nkeys = r9_key_recovery(pairs, npairs, &known_pt, masterkeys);
+  /* launch analysis (buffers sized from the data are allocated in the arena) */
+  arena_init(&arena, 0);
+  if (filter_fname != NULL) {
+    /* keys of a previous run checked against the pairs and plaintexts (no search) */
+    postfilter_keys(filter_fname, pairs, npairs, mode, &known_pt, &arena, &keys);
+  }
+  else if (mode == DFA_ROUND_9) {
+    r9_key_recovery(pairs, npairs, &arena, &known_pt, &keys, &factored, &ctl);
+  }
+  else if (mode == DFA_MIXED) {
+    mixed_key_recovery(pairs, npairs, &arena, &known_pt, &keys, &factored, &ctl);
   }
   else {
-    nkeys = r8_key_recovery(pairs, npairs, &known_pt, masterkeys);
+    r8_key_recovery(pairs, npairs, &arena, NULL, NULL, &known_pt, &keys, &ctl);
+  }
+  arena_free(&arena);
+  nkeys = (int)keyset_len(&keys);
+
+  /* funnel and phases of the searches (profiling builds only) */
+  if (profile_available()) {
+    profile_summary(stderr);
+  }
+  if (profile_fname != NULL) {
+    fp = strcmp(profile_fname, "-") == 0 ? stdout : fopen(profile_fname, "w");
+    if (fp == NULL) {
+      fprintf(stderr, "[!] Cannot write to file '%s'\n", profile_fname);
+    }
+    else {
+      profile_json(fp);
+      if (fp != stdout) {
+        fclose(fp);
+      }
+    }
   }
 
-  if (nkeys == 0) {
+  if (keys.inserts > (size_t)nkeys + keys.overflow) {
+    fprintf(
+      stderr,
+      "[*] %d distinct key(s), %zu duplicate(s) removed\n",
+      nkeys, keys.inserts - (size_t)nkeys - keys.overflow
+    );
+    for (i = 0; i < keyset_len(&keys); i++) {
+      if (__builtin_popcountl(keyset_hypotheses(&keys, i)) > 1) {
+        print_key_hypotheses(keyset_get(&keys, i), keyset_hypotheses(&keys, i), bitflip);
+      }
+    }
+  }
+  if (keys.overflow > 0) {
+    fprintf(
+      stderr,
+      "[!] %zu key(s) discarded: the key set cannot grow (out of memory)\n",
+      keys.overflow
+    );
+  }
+
+  /* only key spaces of faults in round 9 without known plaintext can be factored */
+  if (format == OUTPUT_FACTORED && !factored.is_some) {
+    format = OUTPUT_TEXT;
+    if (out_fname == DEFAULT_FACTORED_FILENAME) {
+      out_fname = DEFAULT_OUTPUT_FILENAME;
+    }
+    if (nkeys > 1) {
+      fprintf(stderr, "[!] Key space not factored with this analysis: keys written as text\n");
+    }
+  }
+
+  if (factored.is_some) {
+    /* key space too large (or factored output requested): store the lists of candidates */
+    if (format != OUTPUT_FACTORED && out_fname == DEFAULT_OUTPUT_FILENAME) {
+      out_fname = DEFAULT_FACTORED_FILENAME;
+    }
+    fheader.mode = (uint32_t)mode;
+    fheader.input_hash = hash_file(in_fname);
+    fheader.npairs = (uint32_t)npairs;
+    if (write_factored(out_fname, &factored, &fheader) != 0) {
+      fprintf(stderr, "[!] Cannot write to file '%s'\n", out_fname);
+      exit(EXIT_FAILURE);
+    }
+    fprintf(
+      stderr,
+      "[*] Factored key space (%lu keys) written to file %s\n"
+      "[*] Use dfa-keys to enumerate the keys\n",
+      (unsigned long)factored_size(&factored), out_fname
+    );
+    factored_free(&factored);
+  }
+  else if (nkeys == 0) {
     fprintf(stderr, "[*] The attack was unsuccessful: check your data\n");
   }
   else {
-    if (nkeys == 1) {
-      if (known_pt.is_some) {
+    if (nkeys == 1 && ctl.streamed != NULL) {
+      fprintf(stderr, "[*] Key printed when found\n");
+    }
+    else if (nkeys == 1) {
+      if (known_pt_unique(&known_pt)) {
         fprintf(stderr, "[*] Master key found:\n");
       }
       else {
-        fprintf(stderr, "[*] Potential master key found:\n");
+        fprintf(stderr, "[*] Potential master key found%s:\n", known_pt.is_some ? " (plaintexts partially known)" : "");
       }
-      print_hex(masterkeys[0], 16);
+      print_hex(keyset_get(&keys, 0), 16);
     }
-    else {
+    if (nkeys > 1 || format == OUTPUT_BINARY) {
       /* write all keys to file */
-      fp = fopen(out_fname, "w");
-      if (fp == NULL) {
-        fprintf(stderr, "[!] Cannot write to file '%s', writing to '/tmp/keys.txt'\n", out_fname);
-        out_fname = "/tmp/keys.txt";
-        fp = fopen(out_fname, "w");
-        if (fp == NULL) {
-          fprintf(stderr, "[!] Cannot write to file '/tmp/keys.txt', I give up\n");
-          exit(EXIT_FAILURE);
-        }
-      }
-      for (i = 0; i < nkeys; i++) {
-        for (j = 0; j < 16; j++) {
-          fprintf(fp, "%02x", masterkeys[i][j]);
-        }
-        fprintf(fp, "\n");
-      }
-      fprintf(stderr, "[*] %d keys written to file %s\n", nkeys, out_fname);
-      fclose(fp);
+      header.mode = (uint32_t)mode;
+      header.input_hash = hash_file(in_fname);
+      header.npairs = (uint32_t)npairs;
+      header.flags = known_pt_unique(&known_pt) ? KEYFILE_VERIFIED : 0;
+      header.flags |= bitflip ? KEYFILE_BITFLIP : 0;
+      save_keys(out_fname, format, &keys, &header);
     }
   }
 
+  search_ctl_free(&ctl);
+  keyset_free(&keys);
+  free(pairs);
   return 0;
 }
@@ -0,0 +1,219 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dfa.h"
+
+#define WRITE_BUFFER_SIZE (1 << 20)
+
+static const char KEYFILE_MAGIC[8] = "DFAKEYS";
+static const char HEX_DIGITS[16] = "0123456789abcdef";
+
+/**
+ * FNV-1a hash of a file content (0 if the file cannot be read).
+ */
+uint64_t hash_file(const char *filename) {
+  FILE *fp;
+  uint8_t buffer[4096];
+  size_t i, n;
+  uint64_t h = 0xcbf29ce484222325UL;
+
+  fp = fopen(filename, "rb");
+  if (fp == NULL) {
+    return 0;
+  }
+  while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
+    for (i = 0; i < n; i++) {
+      h ^= buffer[i];
+      h *= 0x100000001b3UL;
+    }
+  }
+  fclose(fp);
+  return h;
+}
+
+/**
+ * Buffered output of keys in hexadecimal (one per line) to `fp`:
+ * lines are formatted in a large buffer flushed with a single fwrite,
+ * instead of one fprintf per byte.
+ *
+ * Returns -1 if memory cannot be allocated.
+ */
+int hex_writer_init(hex_writer_t *w, FILE *fp) {
+  w->fp = fp;
+  w->pos = 0;
+  w->err = 0;
+  w->buffer = malloc(WRITE_BUFFER_SIZE);
+  return w->buffer == NULL ? -1 : 0;
+}
+
+void hex_writer_put(hex_writer_t *w, const uint8_t key[16]) {
+  int j;
+  for (j = 0; j < 16; j++) {
+    w->buffer[w->pos++] = HEX_DIGITS[key[j] >> 4];
+    w->buffer[w->pos++] = HEX_DIGITS[key[j] & 15];
+  }
+  w->buffer[w->pos++] = '\n';
+  if (w->pos > WRITE_BUFFER_SIZE - 33) {
+    w->err |= fwrite(w->buffer, 1, w->pos, w->fp) != w->pos;
+    w->pos = 0;
+  }
+}
+
+/**
+ * Flush the remaining lines and free the buffer.
+ * Returns -1 if a write failed.
+ */
+int hex_writer_close(hex_writer_t *w) {
+  if (w->pos > 0) {
+    w->err |= fwrite(w->buffer, 1, w->pos, w->fp) != w->pos;
+  }
+  w->err |= fflush(w->fp) != 0;
+  free(w->buffer);
+  w->buffer = NULL;
+  return w->err ? -1 : 0;
+}
+
+/**
+ * Write keys in hexadecimal (one per line).
+ */
+int write_keys_text(FILE *fp, const keyset_t *keys) {
+  size_t i;
+  hex_writer_t w;
+
+  if (hex_writer_init(&w, fp) == -1) {
+    return -1;
+  }
+  for (i = 0; i < keyset_len(keys); i++) {
+    hex_writer_put(&w, keyset_get(keys, i));
+  }
+  return hex_writer_close(&w);
+}
+
+/**
+ * Write keys in the binary format:
+ * - header (see keyfile_header_t);
+ * - packed 16-byte keys;
+ * - for each key, the mask of hypotheses that produced it (8 bytes, little-endian).
+ *
+ * The file is allocated first then filled through a memory mapping,
+ * written back before returning (-1 on error, the file is then removed).
+ */
+int write_keys_binary(const char *filename, const keyset_t *keys, const keyfile_header_t *header) {
+  int fd, err;
+  size_t i, len;
+  uint8_t *map;
+  uint8_t (*out_keys)[16];
+  uint64_t *out_hyp;
+  uint64_t nkeys = keyset_len(keys);
+  keyfile_header_t hdr = *header;
+
+  memcpy(hdr.magic, KEYFILE_MAGIC, 8);
+  hdr.version = KEYFILE_VERSION;
+  hdr.nkeys = nkeys;
+  hdr.flags |= KEYFILE_HAS_HYPOTHESES;
+  hdr.hypotheses = 0;
+  for (i = 0; i < nkeys; i++) {
+    hdr.hypotheses |= keyset_hypotheses(keys, i);
+  }
+
+  len = sizeof(hdr) + nkeys * (16 + sizeof(uint64_t));
+  fd = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    return -1;
+  }
+  /* blocks allocated now: a full disk is an error here, not a SIGBUS in the copy */
+  if (posix_fallocate(fd, 0, len) != 0) {
+    close(fd);
+    unlink(filename);
+    return -1;
+  }
+  map = mmap(NULL, len, PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    unlink(filename);
+    return -1;
+  }
+
+  memcpy(map, &hdr, sizeof(hdr));
+  out_keys = (uint8_t (*)[16])(map + sizeof(hdr));
+  out_hyp = (uint64_t *)(map + sizeof(hdr) + nkeys * 16);
+  for (i = 0; i < nkeys; i++) {
+    memcpy(out_keys[i], keyset_get(keys, i), 16);
+    out_hyp[i] = keyset_hypotheses(keys, i);
+  }
+
+  /* write errors are only reported by msync and close */
+  err = msync(map, len, MS_SYNC) != 0;
+  munmap(map, len);
+  err |= close(fd) != 0;
+  if (err) {
+    unlink(filename);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * Map a binary key file in memory and check its header.
+ * Returns -1 if the file cannot be read or is not a key file.
+ */
+int keyfile_open(const char *filename, keyfile_t *kf) {
+  int fd;
+  struct stat st;
+  size_t record;
+  const uint8_t *map;
+
+  fd = open(filename, O_RDONLY);
+  if (fd == -1) {
+    return -1;
+  }
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(keyfile_header_t)) {
+    close(fd);
+    return -1;
+  }
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return -1;
+  }
+
+  memcpy(&kf->header, map, sizeof(kf->header));
+  kf->map = (void *)map;
+  kf->map_len = st.st_size;
+  if (memcmp(kf->header.magic, KEYFILE_MAGIC, 8) != 0 || kf->header.version != KEYFILE_VERSION) {
+    keyfile_close(kf);
+    return -1;
+  }
+
+  /* number of keys checked against the size of the file before any multiplication
+   * (a forged count would wrap around) */
+  record = 16;
+  if (kf->header.flags & KEYFILE_HAS_HYPOTHESES) {
+    record += sizeof(uint64_t);
+  }
+  if (kf->header.nkeys > (kf->map_len - sizeof(keyfile_header_t)) / record) {
+    keyfile_close(kf);
+    return -1;
+  }
+
+  kf->keys = (const uint8_t (*)[16])(map + sizeof(keyfile_header_t));
+  kf->hypotheses = NULL;
+  if (kf->header.flags & KEYFILE_HAS_HYPOTHESES) {
+    kf->hypotheses = (const uint64_t *)(map + sizeof(keyfile_header_t) + kf->header.nkeys * 16);
+  }
+  return 0;
+}
+
+void keyfile_close(keyfile_t *kf) {
+  if (kf->map != NULL) {
+    munmap(kf->map, kf->map_len);
+  }
+  kf->map = NULL;
+  kf->keys = NULL;
+  kf->hypotheses = NULL;
+}
@@ -0,0 +1,255 @@
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+
+/* keys checked at once by a thread (round 8 filters take them as a batch) */
+#define POSTFILTER_BLOCK 256
+
+/**
+ * Check of a key against a pair with a fault in round 9: the difference
+ * of the diagonal after inverse sbox, through inverse mix column, must be
+ * a single non-null byte (on the row of the fault if known, see r8_filter_check).
+ */
+typedef struct R9Check {
+  const pair_t *pair;
+  int col;
+  r8_filter_t fault;      /* only row8, fault_value and bitflip are used */
+} r9_check_t;
+
+static bool r9_check(const r9_check_t *check, const uint8_t subkey10[16]) {
+  int b, p;
+  uint8_t col[4];
+
+  for (b = 0; b < 4; b++) {
+    p = POSITIONS[check->col][b];
+    col[b] = invsbox[check->pair->ct[p] ^ subkey10[p]] ^ invsbox[check->pair->fct[p] ^ subkey10[p]];
+  }
+  inv_mix_column(col);
+  return r8_filter_check(&check->fault, BYTES_TO_WORD(col));
+}
+
+/**
+ * Load the keys of a previous run: a binary key file (see write_keys_binary),
+ * or hexadecimal keys, one per line. Returns -1 if the file cannot be read.
+ */
+static int load_keys(const char *filename, uint8_t (**keys)[16], uint64_t **hypotheses, size_t *nkeys) {
+  size_t size = 0;
+  uint8_t key[16];
+  char buffer[128];
+  keyfile_t kf;
+  FILE *fp;
+
+  *keys = NULL;
+  *hypotheses = NULL;
+  *nkeys = 0;
+  if (keyfile_open(filename, &kf) == 0) {
+    *keys = malloc(kf.header.nkeys * 16 + 1);
+    *hypotheses = kf.hypotheses != NULL ? malloc(kf.header.nkeys * sizeof(uint64_t) + 1) : NULL;
+    if (*keys == NULL || (kf.hypotheses != NULL && *hypotheses == NULL)) {
+      fprintf(stderr, "[!] Cannot allocate keys\n");
+      exit(EXIT_FAILURE);
+    }
+    memcpy(*keys, kf.keys, kf.header.nkeys * 16);
+    if (kf.hypotheses != NULL) {
+      memcpy(*hypotheses, kf.hypotheses, kf.header.nkeys * sizeof(uint64_t));
+    }
+    *nkeys = kf.header.nkeys;
+    keyfile_close(&kf);
+    return 0;
+  }
+
+  fp = fopen(filename, "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  while (fgets(buffer, 128, fp)) {
+    if (buffer[0] == '#' || hex_to_bytes(buffer, strlen(buffer), key, 16) != 0) {
+      continue;
+    }
+    if (*nkeys == size) {
+      size = size == 0 ? 1024 : 2*size;
+      *keys = realloc(*keys, size * 16);
+      if (*keys == NULL) {
+        fprintf(stderr, "[!] Cannot allocate keys\n");
+        exit(EXIT_FAILURE);
+      }
+    }
+    memcpy((*keys)[(*nkeys)++], key, 16);
+  }
+  fclose(fp);
+  return 0;
+}
+
+/**
+ * Keep the keys consistent with all the pairs and plaintexts:
+ * `keep[i]` is set for the surviving keys, and their number is returned.
+ *
+ * Keys are checked in parallel by blocks: pairs with a fault in round 8
+ * through the filters of the kernels (one group of pairs after the other,
+ * on the survivors of the previous one), then pairs with a fault in round 9,
+ * then the known plaintexts.
+ */
+static size_t postfilter(
+  const uint8_t (*keys)[16],
+  const size_t nkeys,
+  const r8_group_t *groups,
+  const int ngroups,
+  const r9_check_t *checks,
+  const int nchecks,
+  const known_pt_t *known_pt,
+  bool *keep
+) {
+  long blk;
+  long nblocks = (long)((nkeys + POSTFILTER_BLOCK - 1) / POSTFILTER_BLOCK);
+  size_t kept = 0;
+  const kernel_t *kernel = kernel_current();
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic) reduction(+:kept)
+#endif
+  for (blk = 0; blk < nblocks; blk++) {
+    int g, c, s, n, m, len;
+    size_t i;
+    size_t first = (size_t)blk * POSTFILTER_BLOCK;
+    alignas(16) uint8_t subkeys[POSTFILTER_BLOCK][176];
+    placed_t placed[POSTFILTER_BLOCK], remaining[POSTFILTER_BLOCK];
+    placed_t base;
+    int survivors[POSTFILTER_BLOCK], next[POSTFILTER_BLOCK];
+
+    len = nkeys - first < POSTFILTER_BLOCK ? (int)(nkeys - first) : POSTFILTER_BLOCK;
+    base.v = _mm_setzero_si128();
+    for (s = 0; s < len; s++) {
+      key_expansion(keys[first + s], subkeys[s]);
+      memcpy(placed[s].b, subkeys[s] + 160, 16);
+      survivors[s] = s;
+    }
+    n = len;
+
+    for (g = 0; g < ngroups && n > 0; g++) {
+      for (s = 0; s < n; s++) {
+        remaining[s] = placed[survivors[s]];
+      }
+      m = kernel->r8_group_filter(&groups[g], &base, remaining, n, next);
+      for (s = 0; s < m; s++) {
+        next[s] = survivors[next[s]];
+      }
+      memcpy(survivors, next, m * sizeof(int));
+      n = m;
+    }
+
+    for (s = 0; s < n; s++) {
+      for (c = 0; c < nchecks && r9_check(&checks[c], placed[survivors[s]].b); c++);
+      if (c < nchecks || (known_pt->is_some && !known_pt_check(known_pt, subkeys[survivors[s]]))) {
+        continue;
+      }
+      i = first + survivors[s];
+      keep[i] = true;
+      kept++;
+    }
+  }
+  return kept;
+}
+
+/**
+ * Post-filter mode: the keys of a previous run (`filename`, text or binary)
+ * are checked against new pairs and known plaintexts instead of searching again.
+ * Surviving keys are inserted in `out` (with their hypotheses if the file has them).
+ * Returns the number of surviving keys.
+ */
+int postfilter_keys(
+  const char *filename,
+  const pair_t *pairs,
+  const int npairs,
+  const int mode,
+  const known_pt_t *known_pt,
+  arena_t *arena,
+  keyset_t *out
+) {
+  int i, h, round, row, ngroups;
+  int n8 = 0;
+  int nchecks = 0;
+  size_t k, nkeys, kept;
+  uint8_t (*keys)[16];
+  uint64_t *hypotheses;
+  bool *keep;
+  pair_t *pairs8 = arena_alloc(arena, npairs * sizeof(pair_t) + 1);
+  r9_check_t *checks = arena_alloc(arena, npairs * sizeof(r9_check_t) + 1);
+  pair_group_t *groups = NULL;
+  r8_group_t *filter_groups = NULL;
+  double start = wall_time();
+
+  if (load_keys(filename, &keys, &hypotheses, &nkeys) == -1) {
+    fprintf(stderr, "[!] Key file '%s' cannot be opened\n", filename);
+    exit(EXIT_FAILURE);
+  }
+  fprintf(stderr, "[*] %zu keys loaded from %s\n", nkeys, filename);
+
+  /* checks of each pair, by round of the fault */
+  for (i = 0; i < npairs; i++) {
+    round = mode == DFA_MIXED ? pair_round(&pairs[i]) : mode;
+    if (round == DFA_ROUND_8) {
+      pairs8[n8++] = pairs[i];
+      continue;
+    }
+    checks[nchecks].pair = &pairs[i];
+    checks[nchecks].col = find_faulty_column(&pairs[i]);
+    if (checks[nchecks].col == -1) {
+      fprintf(stderr, "[!] Pair %d ignored: ciphertexts do not differ on a single diagonal\n", i + 1);
+      continue;
+    }
+    row = -1;
+    if (pairs[i].fault_pos != -1 && pairs[i].fault_pos / 4 == checks[nchecks].col) {
+      row = pairs[i].fault_pos % 4;
+    }
+    checks[nchecks].fault.row8 = row;
+    checks[nchecks].fault.col8 = checks[nchecks].col;
+    checks[nchecks].fault.fault_value = pairs[i].fault_value;
+    checks[nchecks].fault.bitflip = pairs[i].bitflip;
+    nchecks++;
+  }
+  ngroups = n8 > 0 ? group_pairs(pairs8, n8, arena, &groups, NULL) : 0;
+  if (ngroups > 0) {
+    filter_groups = r8_filter_groups(pairs8, groups, ngroups, arena);
+  }
+  fprintf(
+    stderr, "[*] Checks: %d pairs in round 8, %d pairs in round 9, %d known plaintexts\n",
+    n8, nchecks, known_pt->is_some ? known_pt->n : 0
+  );
+
+  keep = calloc(nkeys + 1, sizeof(bool));
+  if (keep == NULL) {
+    fprintf(stderr, "[!] Cannot allocate keys\n");
+    exit(EXIT_FAILURE);
+  }
+  kept = postfilter(
+    (const uint8_t (*)[16])keys, nkeys, filter_groups, ngroups, checks, nchecks, known_pt, keep
+  );
+
+  /* survivors in the order of the file */
+  if (keyset_reserve(out, kept) == -1) {
+    fprintf(stderr, "[!] Cannot grow the key set\n");
+  }
+  for (k = 0; k < nkeys; k++) {
+    if (!keep[k]) {
+      continue;
+    }
+    if (hypotheses == NULL || hypotheses[k] == 0) {
+      keyset_insert(out, keys[k], HYPOTHESIS(0, 0));
+      continue;
+    }
+    for (h = 0; h < 64; h++) {
+      if ((hypotheses[k] >> h) & 1) {
+        keyset_insert(out, keys[k], h);
+      }
+    }
+  }
+  fprintf(stderr, "[*] %zu of %zu keys kept (%.3f s)\n", kept, nkeys, wall_time() - start);
+
+  free(keep);
+  free(keys);
+  free(hypotheses);
+  return (int)kept;
+}
@@ -0,0 +1,283 @@
+#include <stdio.h>
+#include "profile.h"
+
+#ifdef DFA_PROFILE
+
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *COUNTER_NAMES[PROF_COUNTERS] = {
+  "candidates", "r8_keys", "r8_single_byte", "r8_fault",
+  "exhaustive_keys", "key_expansion", "pt_checked", "pt_match"
+};
+
+static const char *PHASE_NAMES[PROF_PHASES] = {"candidates", "r8_filter", "exhaustive"};
+
+static const char *EVENT_NAMES[PERF_EVENTS] = {"cycles", "instructions", "cache_misses"};
+
+static const uint64_t EVENT_CONFIGS[PERF_EVENTS] = {
+  PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+};
+
+_Thread_local profile_thread_t *profile_self = NULL;
+
+static profile_thread_t *threads = NULL;
+static int nthreads = 0;
+static int perf_threads = 0;
+static pthread_mutex_t threads_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec*1000000000UL + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * Group of hardware events counting the calling thread only (user space),
+ * read at once through its leader. Returns -1 if not permitted
+ * (e.g. perf_event_paranoid, or no PMU in a virtual machine).
+ */
+static int perf_open(void) {
+  int e, i;
+  int fds[PERF_EVENTS];
+  struct perf_event_attr attr;
+
+  for (e = 0; e < PERF_EVENTS; e++) {
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = EVENT_CONFIGS[e];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    fds[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, e == 0 ? -1 : fds[0], 0);
+    if (fds[e] == -1) {
+      for (i = 0; i < e; i++) {
+        close(fds[i]);
+      }
+      return -1;
+    }
+  }
+  return fds[0];
+}
+
+static void perf_read(const int fd, uint64_t events[PERF_EVENTS]) {
+  uint64_t buf[1 + PERF_EVENTS];
+
+  if (fd == -1 || read(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf) || buf[0] != PERF_EVENTS) {
+    memset(events, 0, PERF_EVENTS * sizeof(uint64_t));
+    return;
+  }
+  memcpy(events, buf + 1, PERF_EVENTS * sizeof(uint64_t));
+}
+
+/**
+ * Counters of the calling thread, allocated and registered on first use.
+ */
+profile_thread_t *profile_register(void) {
+  profile_thread_t *t = calloc(1, sizeof(profile_thread_t));
+
+  if (t == NULL) {
+    fprintf(stderr, "[!] Cannot allocate the profile\n");
+    exit(EXIT_FAILURE);
+  }
+  t->perf_fd = perf_open();
+  pthread_mutex_lock(&threads_lock);
+  t->id = nthreads++;
+  perf_threads += t->perf_fd != -1;
+  t->next = threads;
+  threads = t;
+  pthread_mutex_unlock(&threads_lock);
+  profile_self = t;
+  return t;
+}
+
+/**
+ * Start of a phase on the calling thread (nested calls of the same phase
+ * are counted once).
+ */
+void profile_begin(const int phase) {
+  profile_thread_t *t = profile_self != NULL ? profile_self : profile_register();
+  profile_phase_t *p = &t->phases[phase];
+
+  if (p->depth++ > 0) {
+    return;
+  }
+  perf_read(t->perf_fd, p->start_events);
+  p->start_ns = now_ns();
+}
+
+void profile_end(const int phase) {
+  int e;
+  uint64_t ns = now_ns();
+  uint64_t events[PERF_EVENTS];
+  profile_thread_t *t = profile_self;
+  profile_phase_t *p;
+
+  if (t == NULL || t->phases[phase].depth == 0) {
+    return;
+  }
+  p = &t->phases[phase];
+  if (--p->depth > 0) {
+    return;
+  }
+  perf_read(t->perf_fd, events);
+  p->calls++;
+  p->ns += ns - p->start_ns;
+  for (e = 0; e < PERF_EVENTS; e++) {
+    p->events[e] += events[e] - p->start_events[e];
+  }
+}
+
+int profile_available(void) {
+  return 1;
+}
+
+static void totals(uint64_t counters[PROF_COUNTERS], profile_phase_t phases[PROF_PHASES]) {
+  int c, ph, e;
+  profile_thread_t *t;
+
+  memset(counters, 0, PROF_COUNTERS * sizeof(uint64_t));
+  memset(phases, 0, PROF_PHASES * sizeof(profile_phase_t));
+  for (t = threads; t != NULL; t = t->next) {
+    for (c = 0; c < PROF_COUNTERS; c++) {
+      counters[c] += t->counters[c];
+    }
+    for (ph = 0; ph < PROF_PHASES; ph++) {
+      phases[ph].calls += t->phases[ph].calls;
+      phases[ph].ns += t->phases[ph].ns;
+      for (e = 0; e < PERF_EVENTS; e++) {
+        phases[ph].events[e] += t->phases[ph].events[e];
+      }
+    }
+  }
+}
+
+static double ratio(const uint64_t a, const uint64_t b) {
+  return b == 0 ? 0 : (double)a / (double)b;
+}
+
+/**
+ * Summary of the funnel and of the phases (time spread over the threads,
+ * from the least to the most loaded one).
+ */
+void profile_summary(FILE *fp) {
+  int ph;
+  uint64_t c[PROF_COUNTERS];
+  uint64_t min, max;
+  profile_phase_t p[PROF_PHASES];
+  profile_thread_t *t;
+
+  pthread_mutex_lock(&threads_lock);
+  totals(c, p);
+  fprintf(fp, "[*] Profile (%d threads, hardware events %s):\n",
+    nthreads, perf_threads == nthreads && nthreads > 0 ? "available" : "unavailable");
+  fprintf(fp, "[*]   candidates generated   %lu\n", (unsigned long)c[PROF_CANDIDATES]);
+  if (c[PROF_R8_KEYS] > 0) {
+    fprintf(fp, "[*]   round 8 keys decrypted %lu\n", (unsigned long)c[PROF_R8_KEYS]);
+    fprintf(fp, "[*]     single non-null byte %lu (%.3g)\n",
+      (unsigned long)c[PROF_R8_SINGLE_BYTE], ratio(c[PROF_R8_SINGLE_BYTE], c[PROF_R8_KEYS]));
+    fprintf(fp, "[*]     fault value/bitflip  %lu (%.3g)\n",
+      (unsigned long)c[PROF_R8_FAULT], ratio(c[PROF_R8_FAULT], c[PROF_R8_SINGLE_BYTE]));
+  }
+  if (c[PROF_EXHAUSTIVE_KEYS] > 0) {
+    fprintf(fp, "[*]   exhaustive search keys %lu\n", (unsigned long)c[PROF_EXHAUSTIVE_KEYS]);
+  }
+  fprintf(fp, "[*]   key expansions         %lu\n", (unsigned long)c[PROF_KEY_EXPANSION]);
+  fprintf(fp, "[*]   known plaintext tests  %lu, matches %lu\n",
+    (unsigned long)c[PROF_PT_CHECKED], (unsigned long)c[PROF_PT_MATCH]);
+
+  for (ph = 0; ph < PROF_PHASES; ph++) {
+    if (p[ph].calls == 0) {
+      continue;
+    }
+    min = UINT64_MAX;
+    max = 0;
+    for (t = threads; t != NULL; t = t->next) {
+      if (t->phases[ph].calls > 0) {
+        min = t->phases[ph].ns < min ? t->phases[ph].ns : min;
+        max = t->phases[ph].ns > max ? t->phases[ph].ns : max;
+      }
+    }
+    fprintf(fp, "[*]   phase %-10s %lu calls, %.3f s (threads %.3f to %.3f s)",
+      PHASE_NAMES[ph], (unsigned long)p[ph].calls, p[ph].ns / 1e9, min / 1e9, max / 1e9);
+    if (p[ph].events[PERF_CYCLES] > 0) {
+      fprintf(fp, ", %.3g cycles, IPC %.2f, %.3g cache misses",
+        (double)p[ph].events[PERF_CYCLES],
+        ratio(p[ph].events[PERF_INSTRUCTIONS], p[ph].events[PERF_CYCLES]),
+        (double)p[ph].events[PERF_CACHE_MISSES]);
+    }
+    fprintf(fp, "\n");
+  }
+  pthread_mutex_unlock(&threads_lock);
+}
+
+static void json_phases(FILE *fp, const profile_phase_t phases[PROF_PHASES], const char *indent) {
+  int ph, e;
+
+  for (ph = 0; ph < PROF_PHASES; ph++) {
+    fprintf(fp, "%s\"%s\": {\"calls\": %lu, \"seconds\": %.6f",
+      indent, PHASE_NAMES[ph], (unsigned long)phases[ph].calls, phases[ph].ns / 1e9);
+    for (e = 0; e < PERF_EVENTS; e++) {
+      fprintf(fp, ", \"%s\": %lu", EVENT_NAMES[e], (unsigned long)phases[ph].events[e]);
+    }
+    fprintf(fp, "}%s\n", ph + 1 < PROF_PHASES ? "," : "");
+  }
+}
+
+static void json_counters(FILE *fp, const uint64_t counters[PROF_COUNTERS], const char *indent) {
+  int c;
+
+  for (c = 0; c < PROF_COUNTERS; c++) {
+    fprintf(fp, "%s\"%s\": %lu%s\n",
+      indent, COUNTER_NAMES[c], (unsigned long)counters[c], c + 1 < PROF_COUNTERS ? "," : "");
+  }
+}
+
+/**
+ * Report in JSON: totals, then counters and phases of each thread.
+ */
+void profile_json(FILE *fp) {
+  uint64_t c[PROF_COUNTERS];
+  profile_phase_t p[PROF_PHASES];
+  profile_thread_t *t;
+
+  pthread_mutex_lock(&threads_lock);
+  totals(c, p);
+  fprintf(fp, "{\n  \"perf_events\": %s,\n", perf_threads == nthreads && nthreads > 0 ? "true" : "false");
+  fprintf(fp, "  \"counters\": {\n");
+  json_counters(fp, c, "    ");
+  fprintf(fp, "  },\n  \"phases\": {\n");
+  json_phases(fp, p, "    ");
+  fprintf(fp, "  },\n  \"threads\": [");
+  for (t = threads; t != NULL; t = t->next) {
+    fprintf(fp, "%s\n    {\n      \"id\": %d,\n      \"counters\": {\n", t == threads ? "" : ",", t->id);
+    json_counters(fp, t->counters, "        ");
+    fprintf(fp, "      },\n      \"phases\": {\n");
+    json_phases(fp, t->phases, "        ");
+    fprintf(fp, "      }\n    }");
+  }
+  fprintf(fp, "\n  ]\n}\n");
+  pthread_mutex_unlock(&threads_lock);
+}
+
+#else
+
+int profile_available(void) {
+  return 0;
+}
+
+void profile_summary(FILE *fp) {
+  (void)fp;
+}
+
+void profile_json(FILE *fp) {
+  (void)fp;
+}
+
+#endif /* DFA_PROFILE */
@@ -0,0 +1,303 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+
+#ifdef _OPENMP
+#include "omp.h"
+#endif
+
+int thread_num(void) {
+#ifdef _OPENMP
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+int max_threads(void) {
+#ifdef _OPENMP
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+/**
+ * Allocate one result buffer for each thread.
+ */
+void results_init(results_t *results) {
+  results->nthreads = max_threads();
+  results->buffers = calloc(results->nthreads, sizeof(*results->buffers));
+  if (results->buffers == NULL) {
+    fprintf(stderr, "[!] Cannot allocate result buffers\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void results_free(results_t *results) {
+  int t;
+  for (t = 0; t < results->nthreads; t++) {
+    free(results->buffers[t].entries);
+  }
+  free(results->buffers);
+  results->buffers = NULL;
+}
+
+/**
+ * Append a key to the buffer of thread `tid` (only this thread writes to it,
+ * so no synchronization is needed).
+ * The ordinal is the position of the key in the sequential enumeration,
+ * used to merge buffers in a reproducible order.
+ */
+void results_push(results_t *results, const int tid, const uint64_t ordinal, const uint8_t key[16]) {
+  result_buffer_t *buf = &results->buffers[tid];
+  result_entry_t *entries;
+
+  if (buf->len == buf->size) {
+    buf->size = buf->size == 0 ? 64 : 2*buf->size;
+    entries = realloc(buf->entries, buf->size * sizeof(*entries));
+    if (entries == NULL) {
+      fprintf(stderr, "[!] Cannot allocate result buffer\n");
+      exit(EXIT_FAILURE);
+    }
+    buf->entries = entries;
+  }
+  buf->entries[buf->len].ordinal = ordinal;
+  memcpy(buf->entries[buf->len].key, key, 16);
+  buf->len++;
+}
+
+static int cmp_entries(const void *a, const void *b) {
+  const result_entry_t *x = a;
+  const result_entry_t *y = b;
+  return (x->ordinal > y->ordinal) - (x->ordinal < y->ordinal);
+}
+
+/**
+ * Merge all buffers into the key set, sorted by ordinal: the order of keys
+ * does not depend on the number of threads or on the scheduling.
+ *
+ * Returns the number of new distinct keys.
+ */
+int results_merge(results_t *results, keyset_t *keys, const int hypothesis) {
+  int t;
+  int nkeys = 0;
+  size_t i;
+  size_t total = 0;
+  result_entry_t *all;
+
+  for (t = 0; t < results->nthreads; t++) {
+    total += results->buffers[t].len;
+  }
+  if (total == 0) {
+    return 0;
+  }
+
+  all = malloc(total * sizeof(*all));
+  if (all == NULL) {
+    fprintf(stderr, "[!] Cannot allocate result buffer\n");
+    exit(EXIT_FAILURE);
+  }
+  total = 0;
+  for (t = 0; t < results->nthreads; t++) {
+    memcpy(&all[total], results->buffers[t].entries, results->buffers[t].len * sizeof(*all));
+    total += results->buffers[t].len;
+  }
+  qsort(all, total, sizeof(*all), cmp_entries);
+
+  /* room for all of them (keys that cannot be allocated are counted as overflow) */
+  if (keyset_reserve(keys, total) == -1) {
+    fprintf(stderr, "[!] Cannot grow the key set\n");
+  }
+  for (i = 0; i < total; i++) {
+    nkeys += keyset_insert(keys, all[i].key, hypothesis) == 1;
+  }
+  free(all);
+  return nkeys;
+}
+
+/**
+ * Place candidates of diagonal `diag` (see placed_t).
+ */
+void place_diagonal(placed_t *placed, const uint32_t *candidates, const int len, const int diag) {
+  int i, b;
+  for (i = 0; i < len; i++) {
+    placed[i].v = _mm_setzero_si128();
+    for (b = 0; b < 4; b++) {
+      placed[i].b[POSITIONS[diag][b]] = TAKEBYTE(candidates[i], b);
+    }
+  }
+}
+
+/**
+ * Candidates of the four diagonals placed by the calling thread, in a single
+ * aligned allocation (free `local[0]`): lists are streamed in order by the
+ * searches, and with the first-touch policy of the kernel, they are allocated
+ * on the NUMA node of the thread.
+ */
+void place_candidates(
+  uint32_t *const candidates[4],
+  const int candidates_len[4],
+  placed_t *local[4]
+) {
+  int i;
+  size_t total = 0;
+
+  for (i = 0; i < 4; i++) {
+    total += candidates_len[i];
+  }
+  /* size multiple of the alignment (at least one vector) */
+  local[0] = aligned_alloc(64, ((total + 1) * sizeof(placed_t) + 63) & ~(size_t)63);
+  if (local[0] == NULL) {
+    fprintf(stderr, "[!] Cannot allocate candidates\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < 4; i++) {
+    if (i > 0) {
+      local[i] = local[i - 1] + candidates_len[i - 1];
+    }
+    place_diagonal(local[i], candidates[i], candidates_len[i], i);
+  }
+}
+
+/**
+ * Read an integer from a sysfs file (-1 if absent).
+ */
+static int read_sysfs_int(const char *fmt, const int cpu) {
+  FILE *fp;
+  char path[128];
+  int value = -1;
+
+  snprintf(path, sizeof(path), fmt, cpu);
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    return -1;
+  }
+  if (fscanf(fp, "%d", &value) != 1) {
+    value = -1;
+  }
+  fclose(fp);
+  return value;
+}
+
+/**
+ * Number of physical cores among the CPUs allowed for the process
+ * (SMT siblings share a core), and number of logical CPUs in `ncpus`.
+ */
+int physical_cores(int *ncpus) {
+  cpu_set_t allowed;
+  int i, j, n = 0;
+  int ids[CPU_SETSIZE];
+  int ncores = 0;
+
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    *ncpus = max_threads();
+    return *ncpus;
+  }
+  for (i = 0; i < CPU_SETSIZE; i++) {
+    if (!CPU_ISSET(i, &allowed)) {
+      continue;
+    }
+    n++;
+    ids[ncores] = 65536 * read_sysfs_int("/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i)
+      + read_sysfs_int("/sys/devices/system/cpu/cpu%d/topology/core_id", i);
+    for (j = 0; j < ncores && ids[j] != ids[ncores]; j++);
+    if (j == ncores) {
+      ncores++;
+    }
+  }
+  *ncpus = n;
+  return ncores > 0 ? ncores : n;
+}
+
+/**
+ * Pin each OpenMP thread to a CPU.
+ *
+ * CPUs allowed for the process are ordered by socket then core:
+ * - PIN_COMPACT: threads fill a socket before the next one;
+ * - PIN_SCATTER: threads alternate between sockets.
+ *
+ * The thread pool is kept by the OpenMP runtime, so the binding applies
+ * to all subsequent parallel regions.
+ */
+void pin_threads(const int policy) {
+  cpu_set_t allowed;
+  int cpus[CPU_SETSIZE];
+  int sockets[CPU_SETSIZE];
+  int order[CPU_SETSIZE];
+  int ncpus = 0;
+  int nsockets = 0;
+  int i, j, s, tmp;
+
+  if (policy == PIN_NONE) {
+    return;
+  }
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    fprintf(stderr, "[!] Cannot get CPU affinity, threads are not pinned\n");
+    return;
+  }
+
+  for (i = 0; i < CPU_SETSIZE; i++) {
+    if (CPU_ISSET(i, &allowed)) {
+      cpus[ncpus] = i;
+      sockets[ncpus] = read_sysfs_int("/sys/devices/system/cpu/cpu%d/topology/physical_package_id", i);
+      if (sockets[ncpus] < 0) {
+        sockets[ncpus] = 0;
+      }
+      if (sockets[ncpus] + 1 > nsockets) {
+        nsockets = sockets[ncpus] + 1;
+      }
+      ncpus++;
+    }
+  }
+
+  /* compact: sort by socket (stable, so CPU numbers stay in order) */
+  for (i = 1; i < ncpus; i++) {
+    for (j = i; j > 0 && sockets[j - 1] > sockets[j]; j--) {
+      tmp = sockets[j]; sockets[j] = sockets[j - 1]; sockets[j - 1] = tmp;
+      tmp = cpus[j]; cpus[j] = cpus[j - 1]; cpus[j - 1] = tmp;
+    }
+  }
+  for (i = 0; i < ncpus; i++) {
+    order[i] = cpus[i];
+  }
+
+  /* scatter: take CPUs from each socket in turn */
+  if (policy == PIN_SCATTER && nsockets > 1) {
+    int taken = 0;
+    int rank = 0;
+    while (taken < ncpus) {
+      for (s = 0; s < nsockets; s++) {
+        int r = 0;
+        for (i = 0; i < ncpus; i++) {
+          if (sockets[i] == s && r++ == rank) {
+            order[taken++] = cpus[i];
+            break;
+          }
+        }
+      }
+      rank++;
+    }
+  }
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+  {
+    cpu_set_t set;
+    int tid = thread_num();
+    CPU_ZERO(&set);
+    CPU_SET(order[tid % ncpus], &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      fprintf(stderr, "[!] Cannot pin thread %d\n", tid);
+    }
+  }
+  fprintf(
+    stderr, "[*] Threads pinned (%s) on %d CPU(s), %d socket(s)\n",
+    policy == PIN_SCATTER ? "scatter" : "compact", ncpus, nsockets
+  );
+}
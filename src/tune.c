@@ -0,0 +1,311 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "dfa.h"
+
+#ifdef _OPENMP
+#include "omp.h"
+#endif
+
+#define TUNE_VERSION 1
+#define TUNE_REPEAT 2
+
+/* sizes of the synthetic lists of candidates (a few tens of ms for both searches with AES-NI) */
+static const int R8_LENS[4] = {128, 16, 16, 48};
+static const int EXH_LENS[4] = {128, 8, 8, 16};
+
+/* chunk sizes tried for the schedule of the outer loops */
+static const int CHUNKS[] = {1, 2, 4, 8};
+
+/**
+ * Default configuration: OpenMP threads, one candidate of diagonal 0 at a time,
+ * best kernels supported by the CPU.
+ */
+void tune_defaults(tuning_t *tuning) {
+  tuning->threads = 0;
+  tuning->chunk = 1;
+  tuning->kernel = KERNEL_AUTO;
+}
+
+/**
+ * Set the configuration for the following searches.
+ * Returns -1 if the kernels are not supported by the CPU.
+ */
+int tune_apply(const tuning_t *tuning) {
+#ifdef _OPENMP
+  if (tuning->threads > 0) {
+    omp_set_num_threads(tuning->threads);
+  }
+  omp_set_schedule(omp_sched_dynamic, tuning->chunk);
+#endif
+  return kernel_select(tuning->kernel) == -1 ? -1 : 0;
+}
+
+static void cpu_model(char *model, const size_t len) {
+  FILE *fp;
+  char line[512];
+  char *p;
+
+  snprintf(model, len, "unknown");
+  fp = fopen("/proc/cpuinfo", "r");
+  if (fp == NULL) {
+    return;
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (strncmp(line, "model name", 10) == 0 && (p = strchr(line, ':')) != NULL) {
+      for (p++; *p == ' '; p++);
+      p[strcspn(p, "\n")] = '\0';
+      snprintf(model, len, "%s", p);
+      break;
+    }
+  }
+  fclose(fp);
+}
+
+/**
+ * File of the tuning of this host: $XDG_CACHE_HOME/dfa-aes/tune-<hostname>
+ * (or ~/.cache/dfa-aes). Directories are created if `create` is set.
+ */
+static int tune_path(char *path, const size_t len, const bool create) {
+  char host[256];
+  char dir[4096];
+  const char *base = getenv("XDG_CACHE_HOME");
+
+  if (base != NULL && base[0] != '\0') {
+    snprintf(dir, sizeof(dir), "%s", base);
+  }
+  else if ((base = getenv("HOME")) != NULL) {
+    snprintf(dir, sizeof(dir), "%s/.cache", base);
+  }
+  else {
+    return -1;
+  }
+  if (create && mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    return -1;
+  }
+  strncat(dir, "/dfa-aes", sizeof(dir) - strlen(dir) - 1);
+  if (create && mkdir(dir, 0755) != 0 && errno != EEXIST) {
+    return -1;
+  }
+  if (gethostname(host, sizeof(host)) != 0) {
+    snprintf(host, sizeof(host), "localhost");
+  }
+  host[sizeof(host) - 1] = '\0';
+  snprintf(path, len, "%s/tune-%s", dir, host);
+  return 0;
+}
+
+/**
+ * Load the tuning of this host.
+ * Returns -1 if absent, or if made for another CPU (model, number of CPUs)
+ * or for kernels that are not supported anymore.
+ */
+int tune_load(tuning_t *tuning) {
+  FILE *fp;
+  char path[4400];
+  char line[512], model[256], name[32];
+  int version = 0, ncpus = -1, valid = 0, n;
+  tuning_t t;
+
+  if (tune_path(path, sizeof(path), false) != 0 || (fp = fopen(path, "r")) == NULL) {
+    return -1;
+  }
+  cpu_model(model, sizeof(model));
+  physical_cores(&n);
+  tune_defaults(&t);
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    if (strncmp(line, "cpu ", 4) == 0) {
+      valid = strcmp(line + 4, model) == 0;
+    }
+    else if (sscanf(line, "version %d", &version) == 1
+      || sscanf(line, "cpus %d", &ncpus) == 1
+      || sscanf(line, "threads %d", &t.threads) == 1
+      || sscanf(line, "chunk %d", &t.chunk) == 1) {
+      continue;
+    }
+    else if (sscanf(line, "kernel %31s", name) == 1) {
+      t.kernel = kernel_from_name(name);
+    }
+  }
+  fclose(fp);
+
+  if (!valid || version != TUNE_VERSION || ncpus != n || t.threads < 1 || t.chunk < 1
+      || t.kernel < 0 || kernel_select(t.kernel) == -1) {
+    return -1;
+  }
+  *tuning = t;
+  return 0;
+}
+
+void tune_save(const tuning_t *tuning) {
+  FILE *fp;
+  char path[4400];
+  char model[256];
+  int n;
+
+  if (tune_path(path, sizeof(path), true) != 0 || (fp = fopen(path, "w")) == NULL) {
+    fprintf(stderr, "[!] Cannot save the tuning of this host\n");
+    return;
+  }
+  cpu_model(model, sizeof(model));
+  physical_cores(&n);
+  fprintf(fp, "version %d\ncpu %s\ncpus %d\n", TUNE_VERSION, model, n);
+  fprintf(fp, "threads %d\nchunk %d\n", tuning->threads, tuning->chunk);
+  fprintf(fp, "kernel %s\n", kernel_current()->name);
+  fclose(fp);
+}
+
+/**
+ * Synthetic lists of candidates (random words, so almost no key passes)
+ * and a random known plaintext, to run the searches on.
+ */
+typedef struct Workload {
+  pair_t pair;
+  known_pt_t known_pt;
+  uint32_t *r8[4];
+  uint32_t *exh[4];
+  keyset_t keys;
+} workload_t;
+
+static uint32_t xorshift(uint64_t *state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return (uint32_t)(*state >> 16);
+}
+
+static void workload_init(workload_t *w, arena_t *arena) {
+  int i, j;
+  uint64_t state = 0x9e3779b97f4a7c15UL;
+  uint8_t pt[16], ct[16], mask[16];
+
+  memset(&w->pair, 0, sizeof(w->pair));
+  for (i = 0; i < 16; i++) {
+    w->pair.ct[i] = (uint8_t)xorshift(&state);
+    w->pair.fct[i] = (uint8_t)xorshift(&state);
+    pt[i] = (uint8_t)xorshift(&state);
+    ct[i] = (uint8_t)xorshift(&state);
+    mask[i] = 0xff;
+  }
+  w->pair.fault_value = -1;
+  known_pt_init(&w->known_pt);
+  known_pt_add(&w->known_pt, pt, mask, ct);
+  for (i = 0; i < 4; i++) {
+    w->r8[i] = arena_alloc(arena, R8_LENS[i] * sizeof(uint32_t));
+    for (j = 0; j < R8_LENS[i]; j++) {
+      w->r8[i][j] = xorshift(&state);
+    }
+    w->exh[i] = arena_alloc(arena, EXH_LENS[i] * sizeof(uint32_t));
+    for (j = 0; j < EXH_LENS[i]; j++) {
+      w->exh[i][j] = xorshift(&state);
+    }
+  }
+  if (keyset_init(&w->keys, KEYSET_INITIAL) == -1) {
+    fprintf(stderr, "[!] Cannot allocate the key set\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * Time of both searches with a configuration (best of a few runs).
+ */
+static double measure(workload_t *w, const tuning_t *tuning) {
+  int r;
+  double t, best = 0;
+
+  tune_apply(tuning);
+  for (r = 0; r < TUNE_REPEAT; r++) {
+    t = wall_time();
+    r8_search(&w->pair, -1, 0, w->r8, R8_LENS, &w->known_pt, &w->keys);
+    exhaustive_search(w->exh, EXH_LENS, &w->known_pt, 0, &w->keys, NULL);
+    t = wall_time() - t;
+    if (r == 0 || t < best) {
+      best = t;
+    }
+  }
+  return best;
+}
+
+/**
+ * Short calibration sweeps on synthetic candidates:
+ * kernels first (all threads), then number of threads
+ * (physical cores or all logical CPUs), then chunk size.
+ * The fastest configuration is kept in `tuning` and applied.
+ */
+void tune_calibrate(tuning_t *tuning) {
+  int id, i, ncpus, ncores;
+  int threads[2];
+  double t, best;
+  tuning_t cur, best_tuning;
+  workload_t w;
+  arena_t arena;
+
+  arena_init(&arena, 0);
+  workload_init(&w, &arena);
+  ncores = physical_cores(&ncpus);
+  threads[0] = ncpus;
+  threads[1] = ncores;
+
+  tune_defaults(&cur);
+  cur.threads = ncpus;
+  best_tuning = cur;
+  best = 0;
+  for (id = 0; id < KERNEL_COUNT; id++) {
+    if (kernel_select(id) == -1) {
+      continue;
+    }
+    cur.kernel = id;
+    t = measure(&w, &cur);
+    fprintf(stderr, "[*] Calibration: kernels %s, %.3f s\n", kernel_current()->name, t);
+    if (best == 0 || t < best) {
+      best = t;
+      best_tuning = cur;
+    }
+  }
+
+  cur = best_tuning;
+  for (i = 1; i < 2 && threads[1] != threads[0]; i++) {
+    cur.threads = threads[i];
+    t = measure(&w, &cur);
+    fprintf(stderr, "[*] Calibration: %d threads, %.3f s\n", cur.threads, t);
+    if (t < best) {
+      best = t;
+      best_tuning = cur;
+    }
+  }
+
+  cur = best_tuning;
+  for (i = 1; i < (int)(sizeof(CHUNKS) / sizeof(CHUNKS[0])); i++) {
+    cur.chunk = CHUNKS[i];
+    t = measure(&w, &cur);
+    fprintf(stderr, "[*] Calibration: chunks of %d, %.3f s\n", cur.chunk, t);
+    if (t < best) {
+      best = t;
+      best_tuning = cur;
+    }
+  }
+
+  keyset_free(&w.keys);
+  arena_free(&arena);
+  *tuning = best_tuning;
+  tune_apply(tuning);
+}
+
+/**
+ * Tuning of this host, loaded from its cache file,
+ * or calibrated (and saved) if absent or outdated.
+ */
+void tune_host(tuning_t *tuning) {
+  if (tune_load(tuning) == 0) {
+    fprintf(stderr, "[*] Tuning of this host loaded\n");
+    return;
+  }
+  fprintf(stderr, "[*] Calibrating this host...\n");
+  tune_calibrate(tuning);
+  tune_save(tuning);
+}
@@ -31,7 +31,7 @@ static uint8_t char_to_nibble(const char c) {
  * An error occurs if the output buffer is not filled.
  * Extra characters are ignored.
  */
-static int hex_to_bytes(const char *a, const int alen, uint8_t *b, const int blen) {
+int hex_to_bytes(const char *a, const int alen, uint8_t *b, const int blen) {
   int i = 0;
   int j = 0;
   int hi = 1;
@@ -63,25 +63,56 @@ static int hex_to_bytes(const char *a, const int alen, uint8_t *b, const int ble
 }
 
 /**
- * This function parses the input file.
+ * Same as hex_to_bytes for a block of 16 bytes where '?' stands for an unknown nibble:
+ * known bits are set in `mask`.
  */
-int readfile(const char *filename, pair_t pairs[PAIRS_MAX], int *npairs, known_pt_t *known_pt) {
-  FILE *fp;
+static int hex_to_masked_block(const char *a, const int alen, uint8_t b[16], uint8_t mask[16]) {
+  int i;
+  int j = 0;
+  uint8_t c;
+
+  memset(b, 0, 16);
+  memset(mask, 0, 16);
+  for (i = 0; i < alen && j < 32; i++) {
+    c = char_to_nibble(a[i]);
+    if (c == 255 && a[i] != '?') {
+      continue;
+    }
+    if (c != 255) {
+      b[j / 2] |= c << (j % 2 == 0 ? 4 : 0);
+      mask[j / 2] |= j % 2 == 0 ? 0xf0 : 0x0f;
+    }
+    j++;
+  }
+  return j == 32 ? 0 : -1;
+}
+
+/**
+ * This function parses the input data (file or job of the daemon).
+ * The array of pairs is allocated (and grown) as pairs are read.
+ * Plaintexts (the `pt:`/`ct:` block, and the `pt=` field of pairs) are added
+ * to `known_pt`.
+ * Returns -2 on malformed input (the error is printed and nothing is allocated).
+ */
+int read_pairs(FILE *fp, pair_t **pairs_out, int *npairs, known_pt_t *known_pt) {
   int err = -1;
-  int n;
+  int n, round, field;
   int num_line = 0;
-  char buffer[128];
-  char *tmp;
+  int size = 0;
+  int ignored = 0;
+  char buffer[256];
+  char *tmp, *start, *saveptr;
   bool has_pt = false;
   bool has_ct = false;
+  uint8_t pt[16], pt_mask[16], ct[16];
+  known_pt_t given;
+  pair_t *pairs = NULL;
 
-  fp = fopen(filename, "r");
-  if (fp == NULL) {
-    return -1;
-  }
-
+  *npairs = 0;
+  known_pt_init(known_pt);
+  known_pt_init(&given);
   /* read file line by line, order does not matter */
-  while(fgets(buffer, 128, fp)) {
+  while(fgets(buffer, 256, fp)) {
     num_line++;
     n = strlen(buffer);
 
@@ -91,56 +122,91 @@ int readfile(const char *filename, pair_t pairs[PAIRS_MAX], int *npairs, known_p
     }
 
     if (buffer[0] == 'p' && buffer[1] == 't' && buffer[2] == ':' && !has_pt) {
-      /* load known plaintext */
-      err = hex_to_bytes(buffer + 3, n - 3, known_pt->pt, 16);
+      /* load known plaintext ('?' for unknown nibbles) */
+      err = hex_to_masked_block(buffer + 3, n - 3, pt, pt_mask);
       if (err != 0) {
         fprintf(stderr, "[!] Malformed input for known plaintext on line %d\n", num_line);
-        exit(EXIT_FAILURE);
+        free(pairs);
+        return -2;
       }
       has_pt = true;
     }
     else if (buffer[0] == 'c' && buffer[1] == 't' && buffer[2] == ':' && !has_ct) {
       /* load ciphertext of known plaintext */
-      err = hex_to_bytes(buffer + 3, n - 3, known_pt->ct, 16);
+      err = hex_to_bytes(buffer + 3, n - 3, ct, 16);
       if (err != 0) {
         fprintf(
           stderr,
           "[!] Malformed input for ciphertext of known plaintext on line %d\n", num_line
         );
-        exit(EXIT_FAILURE);
+        free(pairs);
+        return -2;
       }
       has_ct = true;
     }
-    else if (*npairs < PAIRS_MAX) {
+    else {
+      if (*npairs == size) {
+        size = size == 0 ? 16 : 2*size;
+        pairs = realloc(pairs, size * sizeof(pair_t));
+        if (pairs == NULL) {
+          fprintf(stderr, "[!] Cannot allocate ciphertext pairs\n");
+          exit(EXIT_FAILURE);
+        }
+      }
+
+      /* optional tag for the round of the fault ("r8:" or "r9:") */
+      round = 0;
+      start = buffer;
+      if (buffer[0] == 'r' && (buffer[1] == '8' || buffer[1] == '9') && buffer[2] == ':') {
+        round = buffer[1] - '0';
+        start = buffer + 3;
+      }
+
       /* load first ciphertext from a pair of good/faulty ciphertexts */
-      tmp = strtok(buffer, ",");
-      err = hex_to_bytes(tmp, strlen(tmp), pairs[*npairs].ct, 16);
+      tmp = strtok_r(start, ",", &saveptr);
+      err = tmp == NULL ? -1 : hex_to_bytes(tmp, strlen(tmp), pairs[*npairs].ct, 16);
       if (err != 0) {
         fprintf(stderr, "[!] Malformed input for first ciphertext on line %d\n", num_line);
-        exit(EXIT_FAILURE);
+        free(pairs);
+        return -2;
       }
 
       /* load second ciphertext from a pair of good/faulty ciphertexts */
-      tmp = strtok(NULL, ",");
-      err = hex_to_bytes(tmp, strlen(tmp), pairs[*npairs].fct, 16);
+      tmp = strtok_r(NULL, ",", &saveptr);
+      err = tmp == NULL ? -1 : hex_to_bytes(tmp, strlen(tmp), pairs[*npairs].fct, 16);
       if (err != 0) {
         fprintf(stderr, "[!] Malformed input for second ciphertext on line %d\n", num_line);
-        exit(EXIT_FAILURE);
+        free(pairs);
+        return -2;
       }
 
-      /* load fault position and fault value if present */
-      tmp = strtok(NULL, ",");
+      /* load fault position and fault value if present, and the plaintext (pt=...) */
       pairs[*npairs].bitflip = false;
       pairs[*npairs].fault_pos = -1;
       pairs[*npairs].fault_value = -1;
-      if (tmp != NULL) {
-        pairs[*npairs].fault_pos = atoi(tmp);
-        if (pairs[*npairs].fault_pos < -1 || pairs[*npairs].fault_pos > 15) {
-          fprintf(stderr, "[!] Malformed input for fault position on line %d\n", num_line);
-          exit(EXIT_FAILURE);
+      pairs[*npairs].round = round;
+      field = 0;
+      while ((tmp = strtok_r(NULL, ", \t\r\n", &saveptr)) != NULL) {
+        if (tmp[0] == 'p' && tmp[1] == 't' && tmp[2] == '=') {
+          /* plaintext of the correct ciphertext: a verification pair */
+          err = hex_to_masked_block(tmp + 3, strlen(tmp) - 3, pt, pt_mask);
+          if (err != 0) {
+            fprintf(stderr, "[!] Malformed input for plaintext on line %d\n", num_line);
+            free(pairs);
+            return -2;
+          }
+          ignored += known_pt_add(&given, pt, pt_mask, pairs[*npairs].ct) == -1;
+        }
+        else if (field == 0) {
+          pairs[*npairs].fault_pos = atoi(tmp);
+          if (pairs[*npairs].fault_pos < -1 || pairs[*npairs].fault_pos > 15) {
+            fprintf(stderr, "[!] Malformed input for fault position on line %d\n", num_line);
+            free(pairs);
+            return -2;
+          }
+          field++;
         }
-        tmp = strtok(NULL, " ");
-        if (tmp != NULL) {
+        else if (field == 1) {
           if (tmp[0] == 'b') {
             pairs[*npairs].bitflip = true;
           }
@@ -148,45 +214,87 @@ int readfile(const char *filename, pair_t pairs[PAIRS_MAX], int *npairs, known_p
             pairs[*npairs].fault_value = atoi(tmp);
             if (pairs[*npairs].fault_value < 1 || pairs[*npairs].fault_value > 255) {
               fprintf(stderr, "[!] Malformed input for fault value on line %d\n", num_line);
-              exit(EXIT_FAILURE);
+              free(pairs);
+              return -2;
             }
           }
+          field++;
         }
       }
 
       (*npairs)++;
-      if (*npairs == PAIRS_MAX) {
-        fprintf(
-          stderr,
-          "[!] Maximum ciphertext pairs reached (%d), others will be discarded\n",
-          PAIRS_MAX
-        );
-      }
     }
   }
+  *pairs_out = pairs;
 
   if (has_pt && !has_ct) {
     fprintf(stderr, "[!] Known plaintext ignored (corresponding ciphertext is absent)\n");
-    known_pt->is_some = false;
   }
   else if (!has_pt && has_ct) {
     fprintf(stderr, "[!] Ciphertext ignored (corresponding known plaintext absent)\n");
-    known_pt->is_some = false;
+  }
+  else if (has_pt) {
+    known_pt_add(known_pt, pt, pt_mask, ct);
+  }
+  /* plaintexts of the pairs after the pt:/ct: block */
+  for (n = 0; n < given.n; n++) {
+    ignored += known_pt_add(known_pt, given.pt[n], given.mask[n], given.ct[n]) == -1;
+  }
+  if (ignored > 0) {
+    fprintf(stderr, "[!] %d plaintexts ignored (at most %d are checked)\n", ignored, VERIFY_MAX);
+  }
+  if (known_pt->is_some) {
+    fprintf(stderr, "[*] Known plaintext/ciphertext provided (%d pairs)\n", known_pt->n);
   }
   else {
-    known_pt->is_some = has_pt;
-    if (has_pt) {
-      fprintf(stderr, "[*] Known plaintext/ciphertext provided\n");
-    }
-    else {
-      fprintf(stderr, "[*] No known plaintext/ciphertext provided\n");
-    }
+    fprintf(stderr, "[*] No known plaintext/ciphertext provided\n");
   }
 
-  fclose(fp);
   return 0;
 }
 
+/**
+ * Parse the input file (exits on malformed input).
+ */
+int readfile(const char *filename, pair_t **pairs, int *npairs, known_pt_t *known_pt) {
+  int err;
+  FILE *fp = fopen(filename, "r");
+
+  if (fp == NULL) {
+    return -1;
+  }
+  err = read_pairs(fp, pairs, npairs, known_pt);
+  fclose(fp);
+  if (err == -2) {
+    exit(EXIT_FAILURE);
+  }
+  return err;
+}
+
+/**
+ * Keep the pairs usable in `mode`: pairs tagged with the other round
+ * are only used in mixed mode. Returns the number of pairs kept.
+ */
+int select_pairs(pair_t *pairs, const int npairs, const int mode) {
+  int i, j;
+
+  if (mode == DFA_MIXED) {
+    return npairs;
+  }
+  for (i = 0, j = 0; i < npairs; i++) {
+    if (pairs[i].round != 0 && pairs[i].round != mode) {
+      fprintf(
+        stderr,
+        "[!] Pair %d ignored: fault in round %d (use -8 -9 for a mixed analysis)\n",
+        i + 1, pairs[i].round
+      );
+      continue;
+    }
+    pairs[j++] = pairs[i];
+  }
+  return j;
+}
+
 void print_hex(const uint8_t *buffer, const int len) {
   int i;
   for (i = 0; i < len; i++) {
@@ -259,3 +367,36 @@ void print_number_candidates(const int candidates_len[4], const long nb_cand) {
     nb_cand, bit_length(nb_cand)
   );
 }
+
+/**
+ * Print a mask of hypotheses (see HYPOTHESIS): the column of the fault
+ * in round 8, and the bit of the fault if it is a bitflip.
+ */
+void print_hypotheses(FILE *fp, const uint64_t hypotheses, const bool bitflip) {
+  int h;
+  for (h = 0; h < 64; h++) {
+    if (((hypotheses >> h) & 1) == 0) {
+      continue;
+    }
+    if (bitflip) {
+      fprintf(fp, " (column %d, bit %d)", h / 8, h % 8);
+    }
+    else {
+      fprintf(fp, " (column %d)", h / 8);
+    }
+  }
+}
+
+/**
+ * Print which hypotheses produced a key.
+ */
+void print_key_hypotheses(const uint8_t key[16], const uint64_t hypotheses, const bool bitflip) {
+  int i;
+  fprintf(stderr, "    - Key ");
+  for (i = 0; i < 16; i++) {
+    fprintf(stderr, "%02x", key[i]);
+  }
+  fprintf(stderr, " found with hypotheses:");
+  print_hypotheses(stderr, hypotheses, bitflip);
+  fprintf(stderr, "\n");
+}
@@ -0,0 +1,88 @@
+#include <stdalign.h>
+#include <stdint.h>
+#include <string.h>
+#include "dfa.h"
+
+void known_pt_init(known_pt_t *known_pt) {
+  known_pt->n = 0;
+  known_pt->known_bits = 0;
+  known_pt->is_some = false;
+}
+
+/**
+ * Add a plaintext (known bits set in `mask`) and its ciphertext.
+ * Returns 1 if added, 0 if useless (nothing known, or already there),
+ * -1 if there are already VERIFY_MAX pairs.
+ */
+int known_pt_add(known_pt_t *known_pt, const uint8_t pt[16], const uint8_t mask[16], const uint8_t ct[16]) {
+  int i, v;
+  int known = 0;
+  int n = known_pt->n;
+
+  for (i = 0; i < 16; i++) {
+    known += mask[i] != 0;
+  }
+  if (known == 0) {
+    return 0;
+  }
+  for (v = 0; v < n; v++) {
+    if (memcmp(known_pt->ct[v], ct, 16) == 0 && memcmp(known_pt->mask[v], mask, 16) == 0) {
+      for (i = 0; i < 16 && ((known_pt->pt[v][i] ^ pt[i]) & mask[i]) == 0; i++);
+      if (i == 16) {
+        return 0;
+      }
+    }
+  }
+  if (n == VERIFY_MAX) {
+    return -1;
+  }
+
+  known_pt->partial[n] = false;
+  for (i = 0; i < 16; i++) {
+    known_pt->pt[n][i] = pt[i] & mask[i];
+    known_pt->mask[n][i] = mask[i];
+    known_pt->partial[n] |= mask[i] != 0xff;
+    known_pt->known_bits += __builtin_popcount(mask[i]);
+  }
+  memcpy(known_pt->ct[n], ct, 16);
+  known_pt->n++;
+  known_pt->is_some = true;
+  return 1;
+}
+
+/**
+ * Whether a single key is expected to match: the known bits must cover
+ * a full block (a wrong key matches a partial plaintext with probability
+ * 2^-known_bits, so many keys of a large key space would).
+ * Searches stop at the first matching key only in this case.
+ */
+bool known_pt_unique(const known_pt_t *known_pt) {
+  return known_pt->known_bits >= VERIFY_UNIQUE_BITS;
+}
+
+/**
+ * Check a key (expanded) against every pair, stopping at the first mismatch:
+ * full plaintexts are encrypted, partial ones are compared with the decryption
+ * of their ciphertext on their known bits.
+ */
+bool known_pt_check(const known_pt_t *known_pt, const uint8_t subkeys[176]) {
+  int i, v;
+  alignas(16) uint8_t block[16];
+
+  for (v = 0; v < known_pt->n; v++) {
+    if (known_pt->partial[v]) {
+      decrypt_aes(known_pt->ct[v], block, subkeys);
+      for (i = 0; i < 16 && ((block[i] ^ known_pt->pt[v][i]) & known_pt->mask[v][i]) == 0; i++);
+      if (i < 16) {
+        return false;
+      }
+    }
+    else {
+      encrypt_aes(known_pt->pt[v], block, subkeys);
+      if (memcmp(block, known_pt->ct[v], 16) != 0) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,1214 @@
+#include <dirent.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "dfa.h"
+#ifdef _OPENMP
+#include "omp.h"
+#endif
+
+/* largest lists of candidates given to the searches (keys of a case) */
+#define EXHAUSTIVE_LEN012 8
+#define EXHAUSTIVE_LEN3 64
+#define R8_LEN012 6
+#define R8_LEN3 256
+#define GROUP_LEN3 512
+#define INTERSECTION_LISTS 8
+#define INTERSECTION_LEN 1500
+#define PRIMITIVE_KEYS 64
+
+/* daemon job cancelled while it runs: delay before the cancel, and longest response */
+#define CANCEL_DELAY_US 1000000
+#define CANCEL_MAX 2.0
+
+static const uint8_t FULL_MASK[16] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+static const kernel_t *const KERNELS[KERNEL_COUNT] = {
+  &KERNEL_SOFT_IMPL,
+  &KERNEL_AESNI_IMPL,
+  &KERNEL_VAES_IMPL
+};
+
+/**
+ * Comparisons of a function with its reference: cases run, mismatches,
+ * items processed (e.g., keys) and time spent by each side.
+ */
+typedef struct Stat {
+  const char *name;
+  long cases;
+  long mismatches;
+  double items;
+  double ref_time;
+  double opt_time;
+} stat_t;
+
+static uint64_t splitmix(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15UL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+  return z ^ (z >> 31);
+}
+
+static void random_bytes(uint64_t *rng, uint8_t *out, const int n) {
+  int i;
+  for (i = 0; i < n; i++) {
+    out[i] = (uint8_t)splitmix(rng);
+  }
+}
+
+static int cmp_word(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static int cmp_key(const void *a, const void *b) {
+  return memcmp(a, b, 16);
+}
+
+static void mismatch(stat_t *stat, const long c, const char *what) {
+  stat->mismatches++;
+  fprintf(stderr, "[!] %s, case %ld: %s\n", stat->name, c, what);
+}
+
+/*
+ * Reference implementations: the straightforward versions of the functions
+ * (as first written, before their optimizations), on bytes and without
+ * AES instructions, tables or threads.
+ */
+
+static int ref_k10_cand_from_diff_mc(
+  const pair_t *pair,
+  const int col,
+  const uint32_t *diff_mc_list,
+  const int diff_mc_len,
+  uint32_t **candidates
+) {
+  int i, k0, k1, k2, k3;
+  int cand_len = 0;
+  int size = 256;
+  uint8_t diff, good[4], faulty[4];
+
+  *candidates = malloc(size * sizeof(uint32_t));
+  for (i = 0; i < 4; i++) {
+    good[i] = pair->ct[POSITIONS[col][i]];
+    faulty[i] = pair->fct[POSITIONS[col][i]];
+  }
+
+  for (i = 0; i < diff_mc_len; i++) {
+    for (k0 = 0; k0 < 256; k0++) {
+      diff = invsbox[good[0] ^ (uint8_t)k0] ^ invsbox[faulty[0] ^ (uint8_t)k0];
+      if (diff != TAKEBYTE(diff_mc_list[i], 0)) {
+        continue;
+      }
+      for (k1 = 0; k1 < 256; k1++) {
+        diff = invsbox[good[1] ^ (uint8_t)k1] ^ invsbox[faulty[1] ^ (uint8_t)k1];
+        if (diff != TAKEBYTE(diff_mc_list[i], 1)) {
+          continue;
+        }
+        for (k2 = 0; k2 < 256; k2++) {
+          diff = invsbox[good[2] ^ (uint8_t)k2] ^ invsbox[faulty[2] ^ (uint8_t)k2];
+          if (diff != TAKEBYTE(diff_mc_list[i], 2)) {
+            continue;
+          }
+          for (k3 = 0; k3 < 256; k3++) {
+            diff = invsbox[good[3] ^ (uint8_t)k3] ^ invsbox[faulty[3] ^ (uint8_t)k3];
+            if (diff != TAKEBYTE(diff_mc_list[i], 3)) {
+              continue;
+            }
+            if (cand_len == size) {
+              size *= 2;
+              *candidates = realloc(*candidates, size * sizeof(uint32_t));
+            }
+            if (*candidates == NULL) {
+              fprintf(stderr, "[!] Cannot allocate candidates\n");
+              exit(EXIT_FAILURE);
+            }
+            (*candidates)[cand_len++] = ((uint32_t)k3 << 24)
+              | ((uint32_t)k2 << 16)
+              | ((uint32_t)k1 << 8)
+              | (uint32_t)k0;
+          } /* end for k3 */
+        } /* end for k2 */
+      } /* end for k1 */
+    } /* end for k0 */
+  } /* end for i */
+
+  return cand_len;
+}
+
+static void ref_intersection(uint32_t *list1, int *len1, const uint32_t *list2, const int len2) {
+  int i, j;
+  int new_len = 0;
+  for (i = 0; i < *len1; i++) {
+    for (j = 0; j < len2; j++) {
+      if (list1[i] == list2[j]) {
+        list1[new_len++] = list2[j];
+        break;
+      }
+    }
+  }
+  *len1 = new_len;
+}
+
+static void ref_reverse_key_expansion(const uint8_t subkey10[16], uint8_t subkeys[176]) {
+  int i;
+  for (i = 160; i < 176; i++) {
+    subkeys[i] = subkey10[i - 160];
+  }
+  for (i = 156; i >= 0; i -= 4) {
+    if (i % 16 == 0) {
+      subkeys[i] = subkeys[i + 16] ^ sbox[subkeys[i + 13]] ^ rcon[i >> 4];
+      subkeys[i + 1] = subkeys[i + 17] ^ sbox[subkeys[i + 14]];
+      subkeys[i + 2] = subkeys[i + 18] ^ sbox[subkeys[i + 15]];
+      subkeys[i + 3] = subkeys[i + 19] ^ sbox[subkeys[i + 12]];
+    }
+    else {
+      subkeys[i] = subkeys[i + 16] ^ subkeys[i + 12];
+      subkeys[i + 1] = subkeys[i + 17] ^ subkeys[i + 13];
+      subkeys[i + 2] = subkeys[i + 18] ^ subkeys[i + 14];
+      subkeys[i + 3] = subkeys[i + 19] ^ subkeys[i + 15];
+    }
+  }
+}
+
+/* inverse shift rows and inverse sbox (the inverse of the first step of a round) */
+static void ref_inv_sub_shift(const uint8_t in[16], uint8_t out[16]) {
+  int i;
+  for (i = 0; i < 16; i++) {
+    out[(i + 4*(i % 4)) % 16] = invsbox[in[i]];
+  }
+}
+
+static void ref_decrypt(const uint8_t ct[16], uint8_t pt[16], const uint8_t subkeys[176]) {
+  int i, r;
+  uint8_t s[16], t[16];
+
+  for (i = 0; i < 16; i++) {
+    s[i] = ct[i] ^ subkeys[160 + i];
+  }
+  for (r = 9; r >= 0; r--) {
+    ref_inv_sub_shift(s, t);
+    for (i = 0; i < 16; i++) {
+      s[i] = t[i] ^ subkeys[16*r + i];
+    }
+    for (i = 0; r > 0 && i < 16; i += 4) {
+      inv_mix_column(s + i);
+    }
+  }
+  memcpy(pt, s, 16);
+}
+
+/**
+ * Difference of the states of a pair before mix column in round 8
+ * (one word for each column), decrypted with the last round key `subkey10`.
+ */
+static void ref_r8_diff(const uint8_t ct[16], const uint8_t fct[16], const uint8_t subkey10[16], uint32_t diff[4]) {
+  int i, r;
+  uint8_t subkeys[176];
+  uint8_t x[16], y[16], t[16], u[16];
+
+  ref_reverse_key_expansion(subkey10, subkeys);
+  for (i = 0; i < 16; i++) {
+    x[i] = ct[i] ^ subkey10[i];
+    y[i] = fct[i] ^ subkey10[i];
+  }
+  for (r = 0; r < 2; r++) {
+    ref_inv_sub_shift(x, t);
+    ref_inv_sub_shift(y, u);
+    for (i = 0; i < 16; i++) {
+      x[i] = t[i] ^ subkeys[144 + i];
+      y[i] = u[i] ^ subkeys[144 + i];
+    }
+    for (i = 0; i < 16; i += 4) {
+      inv_mix_column(x + i);
+      inv_mix_column(y + i);
+    }
+  }
+  for (i = 0; i < 4; i++) {
+    diff[i] = (uint32_t)(x[4*i] ^ y[4*i])
+      | ((uint32_t)(x[4*i + 1] ^ y[4*i + 1]) << 8)
+      | ((uint32_t)(x[4*i + 2] ^ y[4*i + 2]) << 16)
+      | ((uint32_t)(x[4*i + 3] ^ y[4*i + 3]) << 24);
+  }
+}
+
+static bool ref_r8_check(const r8_filter_t *filter, const int col8, const uint32_t diff[4]) {
+  int row;
+  int nonzero = 0;
+  uint8_t value = 0;
+
+  for (row = 0; row < 4; row++) {
+    if (TAKEBYTE(diff[col8], row) != 0) {
+      nonzero++;
+      value = TAKEBYTE(diff[col8], row);
+      if (filter->row8 != -1 && row != filter->row8) {
+        return false;
+      }
+    }
+  }
+  /* a null column passes (with a null fault value) */
+  if (nonzero > 1) {
+    return false;
+  }
+  if (filter->fault_value != -1) {
+    return value == filter->fault_value;
+  }
+  if (filter->bitflip) {
+    return value == 1 || value == 2 || value == 4 || value == 8
+      || value == 16 || value == 32 || value == 64 || value == 128;
+  }
+  return true;
+}
+
+static bool ref_r8_match(const r8_filter_t *filter, const uint8_t ct[16], const uint8_t subkey10[16]) {
+  int col;
+  uint32_t diff[4];
+
+  ref_r8_diff(ct, filter->fct, subkey10, diff);
+  if (filter->col8 != -1) {
+    return ref_r8_check(filter, filter->col8, diff);
+  }
+  for (col = 0; col < 4; col++) {
+    if (ref_r8_check(filter, col, diff)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * Keys of the candidates (all master keys, or those matching the plaintext).
+ * Returns the number of keys, put in `keys` (allocated).
+ */
+static int ref_exhaustive_search(
+  uint32_t *const candidates[4],
+  const int candidates_len[4],
+  const uint8_t *pt,
+  const uint8_t *ct,
+  const r8_filter_t *filter,
+  uint8_t (**keys)[16]
+) {
+  int i, j, k, l;
+  int nkeys = 0;
+  uint8_t subkey10[16];
+  uint8_t subkeys[176];
+  uint8_t ctcmp[16];
+
+  *keys = malloc(16 * (size_t)candidates_len[0] * candidates_len[1] * candidates_len[2] * candidates_len[3] + 1);
+  if (*keys == NULL) {
+    fprintf(stderr, "[!] Cannot allocate keys\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < candidates_len[0]; i++) {
+    subkey10[0]  = TAKEBYTE(candidates[0][i], 0);
+    subkey10[13] = TAKEBYTE(candidates[0][i], 1);
+    subkey10[10] = TAKEBYTE(candidates[0][i], 2);
+    subkey10[7]  = TAKEBYTE(candidates[0][i], 3);
+
+    for (j = 0; j < candidates_len[1]; j++) {
+      subkey10[4]  = TAKEBYTE(candidates[1][j], 0);
+      subkey10[1]  = TAKEBYTE(candidates[1][j], 1);
+      subkey10[14] = TAKEBYTE(candidates[1][j], 2);
+      subkey10[11] = TAKEBYTE(candidates[1][j], 3);
+
+      for (k = 0; k < candidates_len[2]; k++) {
+        subkey10[8]  = TAKEBYTE(candidates[2][k], 0);
+        subkey10[5]  = TAKEBYTE(candidates[2][k], 1);
+        subkey10[2]  = TAKEBYTE(candidates[2][k], 2);
+        subkey10[15] = TAKEBYTE(candidates[2][k], 3);
+
+        for (l = 0; l < candidates_len[3]; l++) {
+          subkey10[12] = TAKEBYTE(candidates[3][l], 0);
+          subkey10[9]  = TAKEBYTE(candidates[3][l], 1);
+          subkey10[6]  = TAKEBYTE(candidates[3][l], 2);
+          subkey10[3]  = TAKEBYTE(candidates[3][l], 3);
+
+          if (filter != NULL && !ref_r8_match(filter, filter->ct, subkey10)) {
+            continue;
+          }
+          ref_reverse_key_expansion(subkey10, subkeys);
+          if (pt != NULL) {
+            encrypt_faulty(pt, subkeys, 0, 0, 0, ctcmp);
+            if (memcmp(ct, ctcmp, 16) != 0) {
+              continue;
+            }
+          }
+          memcpy((*keys)[nkeys++], subkeys, 16);
+        } /* end for l */
+      } /* end for k */
+    } /* end for j */
+  } /* end for i */
+  return nkeys;
+}
+
+/*
+ * Generator of the corpora: random master keys and plaintexts,
+ * faults simulated with encrypt_faulty, and lists of candidates
+ * around the right diagonals of the last round key.
+ */
+
+static void random_key(uint64_t *rng, uint8_t masterkey[16], uint8_t subkeys[176]) {
+  random_bytes(rng, masterkey, 16);
+  key_expansion(masterkey, subkeys);
+}
+
+static uint8_t random_fault(uint64_t *rng, const bool bitflip) {
+  return bitflip ? (uint8_t)(1 << (splitmix(rng) % 8)) : (uint8_t)(1 + splitmix(rng) % 255);
+}
+
+static void random_pair(
+  uint64_t *rng,
+  const uint8_t subkeys[176],
+  const int round,
+  const int pos,
+  const uint8_t value,
+  pair_t *pair
+) {
+  uint8_t pt[16];
+
+  random_bytes(rng, pt, 16);
+  memset(pair, 0, sizeof(pair_t));
+  encrypt_faulty(pt, subkeys, 0, 0, 0, pair->ct);
+  encrypt_faulty(pt, subkeys, round, pos, value, pair->fct);
+  pair->fault_pos = pos;
+  pair->fault_value = value;
+  pair->round = round;
+}
+
+static uint32_t diagonal_word(const uint8_t subkey10[16], const int diag) {
+  int b;
+  uint32_t word = 0;
+  for (b = 0; b < 4; b++) {
+    word |= (uint32_t)subkey10[POSITIONS[diag][b]] << (8*b);
+  }
+  return word;
+}
+
+static void place_word(placed_t *placed, const uint32_t word, const int diag) {
+  int b;
+  for (b = 0; b < 4; b++) {
+    placed->b[POSITIONS[diag][b]] = TAKEBYTE(word, b);
+  }
+}
+
+/**
+ * `len` distinct random words, one of them `word` (at a random place).
+ */
+static void random_list(uint64_t *rng, const uint32_t word, const int len, uint32_t *list) {
+  int i, j;
+  for (i = 0; i < len; i++) {
+    do {
+      list[i] = (uint32_t)splitmix(rng);
+      for (j = 0; j < i && list[j] != list[i]; j++);
+    } while (j < i || list[i] == word);
+  }
+  list[splitmix(rng) % len] = word;
+}
+
+static void random_candidates(
+  uint64_t *rng,
+  const uint8_t subkey10[16],
+  const int max012,
+  const int max3,
+  uint32_t *lists,
+  uint32_t *candidates[4],
+  int candidates_len[4]
+) {
+  int d;
+  for (d = 0; d < 4; d++) {
+    candidates[d] = lists + d * max012;
+    candidates_len[d] = 1 + (int)(splitmix(rng) % (d < 3 ? max012 : max3));
+    random_list(rng, diagonal_word(subkey10, d), candidates_len[d], candidates[d]);
+  }
+}
+
+/**
+ * Fault hypothesis of a filter: the right one, or partially unknown,
+ * or (sometimes) a wrong column.
+ */
+static void random_filter(uint64_t *rng, const pair_t *pair, const bool unknown_col, r8_filter_t *filter) {
+  uint8_t value = (uint8_t)pair->fault_value;
+
+  memcpy(filter->ct, pair->ct, 16);
+  memcpy(filter->fct, pair->fct, 16);
+  filter->col8 = pair->fault_pos / 4;
+  if (splitmix(rng) % 5 == 0) {
+    filter->col8 = (filter->col8 + 1 + (int)(splitmix(rng) % 3)) % 4;
+  }
+  else if (unknown_col && splitmix(rng) % 2 == 0) {
+    filter->col8 = -1;
+  }
+  filter->row8 = splitmix(rng) % 2 ? pair->fault_pos % 4 : -1;
+  filter->fault_value = splitmix(rng) % 2 ? pair->fault_value : -1;
+  filter->bitflip = (value & (value - 1)) == 0 && splitmix(rng) % 2;
+}
+
+static bool same_keys(uint8_t (*ref)[16], const int nref, const keyset_t *keys) {
+  size_t i;
+  uint8_t (*opt)[16];
+  bool same;
+
+  if (keyset_len(keys) != (size_t)nref) {
+    return false;
+  }
+  opt = malloc(16 * (size_t)nref + 1);
+  if (opt == NULL) {
+    fprintf(stderr, "[!] Cannot allocate keys\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < (size_t)nref; i++) {
+    memcpy(opt[i], keyset_get(keys, i), 16);
+  }
+  qsort(ref, nref, 16, cmp_key);
+  qsort(opt, nref, 16, cmp_key);
+  same = memcmp(ref, opt, 16 * (size_t)nref) == 0;
+  free(opt);
+  return same;
+}
+
+static bool contains_key(uint8_t (*keys)[16], const int nkeys, const uint8_t key[16]) {
+  int i;
+  for (i = 0; i < nkeys && memcmp(keys[i], key, 16) != 0; i++);
+  return i < nkeys;
+}
+
+/*
+ * Cases: one random input, given to the reference and to the optimized function.
+ */
+
+/**
+ * k10_cand_from_diff_mc (with the tables of the correct ciphertext or without):
+ * candidates of a diagonal, compared as sets, for a fault in round 9
+ * (delta-sets of a single fault, of bitflips or of any fault, on the row of the fault
+ * or on any row), or for a pair with a fault in round 8 and any column.
+ */
+static void case_candidates(uint64_t *rng, const long c, arena_t *arena, stat_t *stat, stat_t *stat_tables) {
+  int i, col, row, len, nref, nopt, ntables;
+  int fault_len = 0;
+  int fault_list[255];
+  uint32_t diff[4*255];
+  uint32_t *ref, *opt, *tab;
+  uint8_t masterkey[16], subkeys[176], value;
+  bool bitflip = splitmix(rng) % 3 == 0;
+  bool expect_right = true;
+  pair_t pair;
+  ct_tables_t tables;
+  arena_mark_t mark = arena_mark(arena);
+  double start;
+
+  random_key(rng, masterkey, subkeys);
+  value = random_fault(rng, bitflip);
+  if (splitmix(rng) % 4 == 0) {
+    random_pair(rng, subkeys, DFA_ROUND_8, (int)(splitmix(rng) % 16), value, &pair);
+    col = (int)(splitmix(rng) % 4);
+    row = -1;
+    expect_right = false;
+  }
+  else {
+    random_pair(rng, subkeys, DFA_ROUND_9, (int)(splitmix(rng) % 16), value, &pair);
+    col = find_faulty_column(&pair);
+    row = splitmix(rng) % 2 ? pair.fault_pos % 4 : -1;
+  }
+  switch (expect_right ? splitmix(rng) % 3 : 2) {
+  case 0:
+    fault_list[fault_len++] = value;
+    break;
+  case 1:
+    for (i = 0; i < 8; i++) {
+      fault_list[fault_len++] = 1 << i;
+    }
+    expect_right = bitflip;
+    break;
+  default:
+    for (i = 1; i < 256; i++) {
+      fault_list[fault_len++] = i;
+    }
+  }
+  len = get_diff_mc(row, fault_list, fault_len, diff);
+
+  start = wall_time();
+  nref = ref_k10_cand_from_diff_mc(&pair, col, diff, len, &ref);
+  stat->ref_time += wall_time() - start;
+  stat_tables->ref_time += wall_time() - start;
+  start = wall_time();
+  nopt = k10_cand_from_diff_mc(&pair, col, diff, len, NULL, arena, &opt);
+  stat->opt_time += wall_time() - start;
+  start = wall_time();
+  ct_tables_init(&tables, pair.ct);
+  ntables = k10_cand_from_diff_mc(&pair, col, diff, len, &tables, arena, &tab);
+  stat_tables->opt_time += wall_time() - start;
+
+  stat->cases++;
+  stat->items += len;
+  stat_tables->cases++;
+  stat_tables->items += len;
+  qsort(ref, nref, sizeof(uint32_t), cmp_word);
+  qsort(opt, nopt, sizeof(uint32_t), cmp_word);
+  qsort(tab, ntables, sizeof(uint32_t), cmp_word);
+  if (nopt != nref || memcmp(ref, opt, nref * sizeof(uint32_t)) != 0) {
+    mismatch(stat, c, "candidates differ from the reference");
+  }
+  if (ntables != nref || memcmp(ref, tab, nref * sizeof(uint32_t)) != 0) {
+    mismatch(stat_tables, c, "candidates differ from the reference");
+  }
+  if (expect_right && bsearch(&(uint32_t){diagonal_word(subkeys + 160, col)}, ref, nref, sizeof(uint32_t), cmp_word) == NULL) {
+    mismatch(stat, c, "the right diagonal is not a candidate of the reference");
+  }
+  free(ref);
+  arena_release(arena, mark);
+}
+
+/**
+ * intersection and intersection_reduce: lists of random words in a small range
+ * (with common elements and duplicates), compared in order.
+ */
+static void case_intersection(uint64_t *rng, const long c, stat_t *stat, stat_t *stat_reduce) {
+  int i, j, n, len;
+  uint32_t range = 64 + (uint32_t)(splitmix(rng) % 4096);
+  uint32_t *ref[INTERSECTION_LISTS], *opt[INTERSECTION_LISTS];
+  int ref_lens[INTERSECTION_LISTS], opt_lens[INTERSECTION_LISTS];
+  double start;
+
+  n = 2 + (int)(splitmix(rng) % (INTERSECTION_LISTS - 1));
+  for (i = 0; i < n; i++) {
+    len = 1 + (int)(splitmix(rng) % INTERSECTION_LEN);
+    ref[i] = malloc(len * sizeof(uint32_t));
+    opt[i] = malloc(len * sizeof(uint32_t));
+    if (ref[i] == NULL || opt[i] == NULL) {
+      fprintf(stderr, "[!] Cannot allocate candidates\n");
+      exit(EXIT_FAILURE);
+    }
+    for (j = 0; j < len; j++) {
+      ref[i][j] = (uint32_t)(splitmix(rng) % range);
+    }
+    memcpy(opt[i], ref[i], len * sizeof(uint32_t));
+    ref_lens[i] = opt_lens[i] = len;
+  }
+
+  /* two lists */
+  len = ref_lens[0];
+  start = wall_time();
+  ref_intersection(ref[0], &ref_lens[0], ref[1], ref_lens[1]);
+  stat->ref_time += wall_time() - start;
+  start = wall_time();
+  intersection(opt[0], &opt_lens[0], opt[1], opt_lens[1]);
+  stat->opt_time += wall_time() - start;
+  stat->cases++;
+  stat->items += len;
+  if (opt_lens[0] != ref_lens[0] || memcmp(ref[0], opt[0], ref_lens[0] * sizeof(uint32_t)) != 0) {
+    mismatch(stat, c, "intersection differs from the reference");
+  }
+
+  /* all of them (the first one is already intersected with the second one) */
+  len = ref_lens[0];
+  start = wall_time();
+  for (i = 1; i < n; i++) {
+    ref_intersection(ref[0], &ref_lens[0], ref[i], ref_lens[i]);
+  }
+  stat_reduce->ref_time += wall_time() - start;
+  start = wall_time();
+#ifdef _OPENMP
+#pragma omp parallel
+#pragma omp single
+#endif
+  intersection_reduce(opt, opt_lens, n);
+  stat_reduce->opt_time += wall_time() - start;
+  stat_reduce->cases++;
+  stat_reduce->items += len;
+  if (opt_lens[0] != ref_lens[0] || memcmp(ref[0], opt[0], ref_lens[0] * sizeof(uint32_t)) != 0) {
+    mismatch(stat_reduce, c, "intersection differs from the reference");
+  }
+
+  for (i = 0; i < n; i++) {
+    free(ref[i]);
+    free(opt[i]);
+  }
+}
+
+/**
+ * reverse_key_expansion (on words) against the byte version.
+ */
+static void case_key_schedule(uint64_t *rng, const long c, stat_t *stat) {
+  int i;
+  uint8_t masterkey[16];
+  uint8_t subkeys[PRIMITIVE_KEYS][176], ref[PRIMITIVE_KEYS][176], opt[PRIMITIVE_KEYS][176];
+  double start;
+
+  for (i = 0; i < PRIMITIVE_KEYS; i++) {
+    random_key(rng, masterkey, subkeys[i]);
+  }
+  start = wall_time();
+  for (i = 0; i < PRIMITIVE_KEYS; i++) {
+    ref_reverse_key_expansion(subkeys[i] + 160, ref[i]);
+  }
+  stat->ref_time += wall_time() - start;
+  start = wall_time();
+  for (i = 0; i < PRIMITIVE_KEYS; i++) {
+    reverse_key_expansion(subkeys[i] + 160, opt[i]);
+  }
+  stat->opt_time += wall_time() - start;
+  stat->cases++;
+  stat->items += PRIMITIVE_KEYS;
+  if (memcmp(ref, subkeys, sizeof(ref)) != 0 || memcmp(opt, subkeys, sizeof(opt)) != 0) {
+    mismatch(stat, c, "round keys differ from the key schedule");
+  }
+}
+
+/**
+ * Encryption, decryption and key_inverse of the selected kernels.
+ */
+static void case_primitives(uint64_t *rng, const long c, stat_t *stat_enc, stat_t *stat_dec, stat_t *stat_inv) {
+  int i, round;
+  uint8_t masterkey[16];
+  alignas(16) uint8_t subkeys[PRIMITIVE_KEYS][176];
+  uint8_t pt[PRIMITIVE_KEYS][16], ct[PRIMITIVE_KEYS][16];
+  uint8_t ref[PRIMITIVE_KEYS][16], opt[PRIMITIVE_KEYS][16];
+  uint8_t subkeys10[PRIMITIVE_KEYS][16];
+  uint8_t full[176];
+  const kernel_t *kernel = kernel_current();
+  double start;
+
+  for (i = 0; i < PRIMITIVE_KEYS; i++) {
+    random_key(rng, masterkey, subkeys[i]);
+    random_bytes(rng, pt[i], 16);
+    memcpy(subkeys10[i], subkeys[i] + 160, 16);
+  }
+
+  start = wall_time();
+  for (i = 0; i < PRIMITIVE_KEYS; i++) {
+    encrypt_faulty(pt[i], subkeys[i], 0, 0, 0, ref[i]);
+  }
+  stat_enc->ref_time += wall_time() - start;
+  start = wall_time();
+  for (i = 0; i < PRIMITIVE_KEYS; i++) {
+    encrypt_aes(pt[i], opt[i], subkeys[i]);
+  }
+  stat_enc->opt_time += wall_time() - start;
+  stat_enc->cases++;
+  stat_enc->items += PRIMITIVE_KEYS;
+  if (memcmp(ref, opt, sizeof(ref)) != 0) {
+    mismatch(stat_enc, c, "ciphertexts differ from the reference");
+  }
+  memcpy(ct, ref, sizeof(ct));
+
+  start = wall_time();
+  for (i = 0; i < PRIMITIVE_KEYS; i++) {
+    ref_decrypt(ct[i], ref[i], subkeys[i]);
+  }
+  stat_dec->ref_time += wall_time() - start;
+  start = wall_time();
+  for (i = 0; i < PRIMITIVE_KEYS; i++) {
+    decrypt_aes(ct[i], opt[i], subkeys[i]);
+  }
+  stat_dec->opt_time += wall_time() - start;
+  stat_dec->cases++;
+  stat_dec->items += PRIMITIVE_KEYS;
+  if (memcmp(ref, pt, sizeof(ref)) != 0 || memcmp(opt, pt, sizeof(opt)) != 0) {
+    mismatch(stat_dec, c, "plaintexts differ from the reference");
+  }
+
+  for (round = 0; round < 10; round += 9) {
+    start = wall_time();
+    for (i = 0; i < PRIMITIVE_KEYS; i++) {
+      ref_reverse_key_expansion(subkeys10[i], full);
+      memcpy(ref[i], full + 16*round, 16);
+    }
+    stat_inv->ref_time += wall_time() - start;
+    start = wall_time();
+    kernel->key_inverse(subkeys10[0], opt[0], PRIMITIVE_KEYS, round);
+    stat_inv->opt_time += wall_time() - start;
+    stat_inv->cases++;
+    stat_inv->items += PRIMITIVE_KEYS;
+    if (memcmp(ref, opt, sizeof(ref)) != 0) {
+      mismatch(stat_inv, c, "round keys differ from the reference");
+    }
+  }
+}
+
+/**
+ * r8_filter and r8_group_filter of the selected kernels: pairs sharing
+ * their correct ciphertext with faults in round 8, keys around the right one
+ * (diagonals 0 to 2 right or random), survivors compared in order.
+ */
+static void case_filters(uint64_t *rng, const long c, stat_t *stat, stat_t *stat_group) {
+  int d, f, l, nref, nopt;
+  int len3 = 1 + (int)(splitmix(rng) % GROUP_LEN3);
+  int nfilters = 1 + (int)(splitmix(rng) % 4);
+  int ref[GROUP_LEN3], opt[GROUP_LEN3];
+  uint8_t masterkey[16], subkeys[176], pt[16];
+  uint32_t words[GROUP_LEN3];
+  placed_t base, key;
+  placed_t *cand3 = malloc(GROUP_LEN3 * sizeof(placed_t));
+  pair_t pair;
+  r8_filter_t filters[4];
+  r8_group_t group;
+  const kernel_t *kernel = kernel_current();
+  double start;
+
+  if (cand3 == NULL) {
+    fprintf(stderr, "[!] Cannot allocate candidates\n");
+    exit(EXIT_FAILURE);
+  }
+  random_key(rng, masterkey, subkeys);
+  random_bytes(rng, pt, 16);
+  for (f = 0; f < nfilters; f++) {
+    random_pair(rng, subkeys, DFA_ROUND_8, (int)(splitmix(rng) % 16), random_fault(rng, splitmix(rng) % 2), &pair);
+    encrypt_faulty(pt, subkeys, 0, 0, 0, pair.ct);
+    encrypt_faulty(pt, subkeys, DFA_ROUND_8, pair.fault_pos, (uint8_t)pair.fault_value, pair.fct);
+    /* the column of the fault may be unknown with groups only */
+    random_filter(rng, &pair, f > 0, &filters[f]);
+  }
+  memcpy(group.ct, pair.ct, 16);
+  group.filters = filters;
+  group.nfilters = nfilters;
+
+  base.v = _mm_setzero_si128();
+  for (d = 0; d < 3; d++) {
+    place_word(&base, splitmix(rng) % 4 ? diagonal_word(subkeys + 160, d) : (uint32_t)splitmix(rng), d);
+  }
+  random_list(rng, diagonal_word(subkeys + 160, 3), len3, words);
+  for (l = 0; l < len3; l++) {
+    cand3[l].v = _mm_setzero_si128();
+    place_word(&cand3[l], words[l], 3);
+  }
+
+  /* single filter (known column) on the first pair */
+  nref = 0;
+  start = wall_time();
+  for (l = 0; l < len3; l++) {
+    key.v = _mm_or_si128(base.v, cand3[l].v);
+    if (ref_r8_match(&filters[0], group.ct, key.b)) {
+      ref[nref++] = l;
+    }
+  }
+  stat->ref_time += wall_time() - start;
+  start = wall_time();
+  nopt = kernel->r8_filter(&filters[0], &base, cand3, len3, opt);
+  stat->opt_time += wall_time() - start;
+  stat->cases++;
+  stat->items += len3;
+  if (nopt != nref || memcmp(ref, opt, nref * sizeof(int)) != 0) {
+    mismatch(stat, c, "survivors differ from the reference");
+  }
+
+  nref = 0;
+  start = wall_time();
+  for (l = 0; l < len3; l++) {
+    key.v = _mm_or_si128(base.v, cand3[l].v);
+    for (f = 0; f < nfilters && ref_r8_match(&filters[f], group.ct, key.b); f++);
+    if (f == nfilters) {
+      ref[nref++] = l;
+    }
+  }
+  stat_group->ref_time += wall_time() - start;
+  start = wall_time();
+  nopt = kernel->r8_group_filter(&group, &base, cand3, len3, opt);
+  stat_group->opt_time += wall_time() - start;
+  stat_group->cases++;
+  stat_group->items += len3;
+  if (nopt != nref || memcmp(ref, opt, nref * sizeof(int)) != 0) {
+    mismatch(stat_group, c, "survivors differ from the reference");
+  }
+  free(cand3);
+}
+
+/**
+ * exhaustive_search: all the master keys of the candidates, or the key
+ * matching a known plaintext.
+ */
+static void case_exhaustive(uint64_t *rng, const long c, stat_t *stat) {
+  int nref;
+  int lens[4];
+  uint32_t lists[3*EXHAUSTIVE_LEN012 + EXHAUSTIVE_LEN3];
+  uint32_t *candidates[4];
+  uint8_t masterkey[16], subkeys[176], pt[16], ct[16];
+  uint8_t (*ref)[16];
+  bool with_pt = splitmix(rng) % 2;
+  known_pt_t known_pt;
+  keyset_t keys;
+  double start;
+
+  random_key(rng, masterkey, subkeys);
+  random_candidates(rng, subkeys + 160, EXHAUSTIVE_LEN012, EXHAUSTIVE_LEN3, lists, candidates, lens);
+  random_bytes(rng, pt, 16);
+  encrypt_faulty(pt, subkeys, 0, 0, 0, ct);
+  known_pt_init(&known_pt);
+  if (with_pt) {
+    known_pt_add(&known_pt, pt, FULL_MASK, ct);
+  }
+  if (keyset_init(&keys, KEYSET_INITIAL) == -1) {
+    fprintf(stderr, "[!] Cannot allocate keys\n");
+    exit(EXIT_FAILURE);
+  }
+
+  start = wall_time();
+  nref = ref_exhaustive_search(candidates, lens, with_pt ? pt : NULL, ct, NULL, &ref);
+  stat->ref_time += wall_time() - start;
+  start = wall_time();
+  exhaustive_search(candidates, lens, &known_pt, 0, &keys, NULL);
+  stat->opt_time += wall_time() - start;
+  stat->cases++;
+  stat->items += (double)lens[0] * lens[1] * lens[2] * lens[3];
+
+  if (!contains_key(ref, nref, masterkey)) {
+    mismatch(stat, c, "the master key is not found by the reference");
+  }
+  if (!same_keys(ref, nref, &keys)) {
+    mismatch(stat, c, "keys differ from the reference");
+  }
+  free(ref);
+  keyset_free(&keys);
+}
+
+/**
+ * r8_search: the keys of the candidates that pass the filtering
+ * of a pair with a fault in round 8 (right or wrong hypothesis).
+ */
+static void case_r8_search(uint64_t *rng, const long c, stat_t *stat) {
+  int nref;
+  int lens[4];
+  uint32_t lists[3*R8_LEN012 + R8_LEN3];
+  uint32_t *candidates[4];
+  uint8_t masterkey[16], subkeys[176];
+  uint8_t (*ref)[16];
+  pair_t pair;
+  r8_filter_t filter;
+  known_pt_t no_pt;
+  keyset_t keys;
+  double start;
+
+  random_key(rng, masterkey, subkeys);
+  random_pair(rng, subkeys, DFA_ROUND_8, (int)(splitmix(rng) % 16), random_fault(rng, splitmix(rng) % 2), &pair);
+  random_filter(rng, &pair, false, &filter);
+  pair.fault_value = filter.fault_value;
+  pair.bitflip = filter.bitflip;
+  random_candidates(rng, subkeys + 160, R8_LEN012, R8_LEN3, lists, candidates, lens);
+  known_pt_init(&no_pt);
+  if (keyset_init(&keys, KEYSET_INITIAL) == -1) {
+    fprintf(stderr, "[!] Cannot allocate keys\n");
+    exit(EXIT_FAILURE);
+  }
+
+  start = wall_time();
+  nref = ref_exhaustive_search(candidates, lens, NULL, NULL, &filter, &ref);
+  stat->ref_time += wall_time() - start;
+  start = wall_time();
+  r8_search(&pair, filter.row8, filter.col8, candidates, lens, &no_pt, &keys);
+  stat->opt_time += wall_time() - start;
+  stat->cases++;
+  stat->items += (double)lens[0] * lens[1] * lens[2] * lens[3];
+
+  if (filter.col8 == pair.fault_pos / 4 && !contains_key(ref, nref, masterkey)) {
+    mismatch(stat, c, "the master key is not found by the reference");
+  }
+  if (!same_keys(ref, nref, &keys)) {
+    mismatch(stat, c, "keys differ from the reference");
+  }
+  free(ref);
+  keyset_free(&keys);
+}
+
+/*
+ * Daemon: a job cancelled while it runs must stop at once, also when the
+ * filtering of a fault in round 8 goes through the cache.
+ */
+
+static void *daemon_thread(void *arg) {
+  int threads = 1;
+#ifdef _OPENMP
+  threads = omp_get_max_threads();
+#endif
+  daemon_run((const char *)arg, 1, threads, 0);
+  return NULL;
+}
+
+static int daemon_connect(const char *path) {
+  int i, fd;
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+  /* the daemon may not listen yet */
+  for (i = 0; i < 500; i++) {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+      return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+      return fd;
+    }
+    close(fd);
+    usleep(10000);
+  }
+  return -1;
+}
+
+static void remove_dir(const char *dir) {
+  char path[4096];
+  DIR *d = opendir(dir);
+  struct dirent *e;
+
+  if (d != NULL) {
+    while ((e = readdir(d)) != NULL) {
+      if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0) {
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        unlink(path);
+      }
+    }
+    closedir(d);
+  }
+  rmdir(dir);
+}
+
+/**
+ * Daemon run in a thread with the cache enabled (in a temporary directory):
+ * a round-8 job with an unknown fault (minutes of search) is cancelled
+ * after CANCEL_DELAY_US, and the response must come within CANCEL_MAX seconds.
+ */
+static void case_daemon_cancel(uint64_t *rng, stat_t *stat) {
+  int i, fd, fd_cancel;
+  char dir[] = "/tmp/dfa-check.XXXXXX";
+  char path[64];
+  char line[256];
+  unsigned long id;
+  uint8_t masterkey[16], subkeys[176];
+  pair_t pair;
+  pthread_t tid;
+  FILE *in = NULL;
+  double start;
+
+  stat->cases++;
+  if (mkdtemp(dir) == NULL || cache_init(dir) != 0) {
+    mismatch(stat, 0, "cannot create the cache directory");
+    return;
+  }
+  snprintf(path, sizeof(path), "%s/socket", dir);
+  if (pthread_create(&tid, NULL, daemon_thread, path) != 0 || pthread_detach(tid) != 0) {
+    mismatch(stat, 0, "cannot start the daemon");
+    remove_dir(dir);
+    return;
+  }
+  fd = daemon_connect(path);
+  if (fd == -1 || (in = fdopen(dup(fd), "r")) == NULL) {
+    mismatch(stat, 0, "cannot connect to the daemon");
+    remove_dir(dir);
+    return;
+  }
+
+  random_key(rng, masterkey, subkeys);
+  random_pair(rng, subkeys, DFA_ROUND_8, (int)(splitmix(rng) % 16), random_fault(rng, false), &pair);
+  dprintf(fd, "job 8\n");
+  for (i = 0; i < 16; i++) {
+    dprintf(fd, "%02x", pair.ct[i]);
+  }
+  dprintf(fd, ",");
+  for (i = 0; i < 16; i++) {
+    dprintf(fd, "%02x", pair.fct[i]);
+  }
+  dprintf(fd, "\nend\n");
+
+  if (fgets(line, sizeof(line), in) == NULL || sscanf(line, "queued %lu", &id) != 1) {
+    mismatch(stat, 0, "job not queued by the daemon");
+  }
+  else {
+    usleep(CANCEL_DELAY_US);
+    fd_cancel = daemon_connect(path);
+    start = wall_time();
+    if (fd_cancel != -1) {
+      dprintf(fd_cancel, "cancel %lu\nquit\n", id);
+    }
+    while (fgets(line, sizeof(line), in) != NULL && strncmp(line, "cancelled", 9) != 0
+           && strncmp(line, "done", 4) != 0);
+    stat->opt_time += wall_time() - start;
+    if (fd_cancel == -1 || strncmp(line, "cancelled", 9) != 0) {
+      mismatch(stat, 0, "job not cancelled");
+    }
+    else if (wall_time() - start > CANCEL_MAX) {
+      mismatch(stat, 0, "job stopped too late after its cancellation");
+    }
+    if (fd_cancel != -1) {
+      close(fd_cancel);
+    }
+  }
+  fclose(in);
+  close(fd);
+  /* the daemon thread stays blocked on its socket until the end */
+  signal(SIGINT, SIG_DFL);
+  signal(SIGTERM, SIG_DFL);
+  remove_dir(dir);
+}
+
+/*
+ * Report: one line for each function, with its throughput (items per second)
+ * with the reference and optimized versions.
+ */
+
+static void report(const stat_t *stat) {
+  double ref = stat->ref_time > 0 ? stat->items / stat->ref_time : 0;
+  double opt = stat->opt_time > 0 ? stat->items / stat->opt_time : 0;
+
+  if (stat->cases == 0) {
+    return;
+  }
+  printf(
+    "  %-24s %6ld %10ld %14.4g %14.4g %9.2fx\n",
+    stat->name, stat->cases, stat->mismatches, ref, opt, ref > 0 ? opt / ref : 0
+  );
+}
+
+static void report_header(const char *title) {
+  printf("%s\n", title);
+  printf(
+    "  %-24s %6s %10s %14s %14s %10s\n",
+    "function", "cases", "mismatches", "ref (items/s)", "opt (items/s)", "ratio"
+  );
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-n cases] [-k kernels] [-s seed]\n", name);
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * Differential testing of the optimized functions against their references
+ * (the straightforward versions of k10_cand_from_diff_mc, intersection,
+ * exhaustive_search and of the filtering of r8_exhaustive_search, kept here).
+ *
+ * Inputs are random (master keys, faults simulated with encrypt_faulty,
+ * lists of candidates around the right diagonals) and outputs are compared
+ * exactly: candidates and keys as sets, intersections and survivors in order.
+ * Functions depending on the kernels are run with each variant supported
+ * by the CPU. For each function, the report gives the throughputs of both versions
+ * (items: delta-set entries, list elements, blocks or keys) and their ratio;
+ * the references run on a single thread.
+ *
+ * - -n: cases for each function (20 by default);
+ * - -k: kernels to check (all the supported ones by default);
+ * - -s: seed (case i of a function always gets the same inputs).
+ *
+ * Mismatches are reported on stderr, and the exit status is then 1.
+ *
+ * Usage: dfa-check [-n cases] [-k kernels] [-s seed]
+ */
+int main(int argc, char *argv[]) {
+  int opt, id;
+  int only = KERNEL_AUTO;
+  long c;
+  long ncases = 20;
+  long mismatches = 0;
+  uint64_t seed = 1;
+  uint64_t rng;
+  arena_t arena;
+  stat_t cand = {.name = "k10_cand_from_diff_mc"};
+  stat_t cand_tables = {.name = "k10_cand (ct_tables)"};
+  stat_t inter = {.name = "intersection"};
+  stat_t reduce = {.name = "intersection_reduce"};
+  stat_t schedule = {.name = "reverse_key_expansion"};
+  stat_t cancel = {.name = "cancel (cache)"};
+
+  while ((opt = getopt(argc, argv, "n:k:s:")) != -1) {
+    switch (opt) {
+    case 'n':
+      ncases = atol(optarg);
+      break;
+    case 'k':
+      only = kernel_from_name(optarg);
+      if (only == -2) {
+        fprintf(stderr, "[!] Unknown kernels '%s'\n", optarg);
+        usage(argv[0]);
+      }
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (ncases < 1) {
+    usage(argv[0]);
+  }
+  arena_init(&arena, 0);
+
+  report_header("Functions without kernels");
+  for (c = 0; c < ncases; c++) {
+    rng = seed ^ ((uint64_t)1 << 32) ^ (uint64_t)c;
+    case_candidates(&rng, c, &arena, &cand, &cand_tables);
+    rng = seed ^ ((uint64_t)2 << 32) ^ (uint64_t)c;
+    case_intersection(&rng, c, &inter, &reduce);
+    rng = seed ^ ((uint64_t)3 << 32) ^ (uint64_t)c;
+    case_key_schedule(&rng, c, &schedule);
+  }
+  report(&cand);
+  report(&cand_tables);
+  report(&inter);
+  report(&reduce);
+  report(&schedule);
+  mismatches += cand.mismatches + cand_tables.mismatches + inter.mismatches + reduce.mismatches + schedule.mismatches;
+  fflush(stdout);
+
+  for (id = 0; id < KERNEL_COUNT; id++) {
+    char title[64];
+    stat_t enc = {.name = "encrypt_aes"};
+    stat_t dec = {.name = "decrypt_aes"};
+    stat_t inv = {.name = "key_inverse"};
+    stat_t filter = {.name = "r8_filter"};
+    stat_t group = {.name = "r8_group_filter"};
+    stat_t exhaustive = {.name = "exhaustive_search"};
+    stat_t r8 = {.name = "r8_search"};
+
+    if (only != KERNEL_AUTO && id != only) {
+      continue;
+    }
+    if (kernel_select(id) == -1) {
+      fprintf(stderr, "[*] Kernels %s not supported by the CPU, skipped\n", KERNELS[id]->name);
+      continue;
+    }
+    snprintf(title, sizeof(title), "Kernels %s", KERNELS[id]->name);
+    report_header(title);
+    for (c = 0; c < ncases; c++) {
+      rng = seed ^ ((uint64_t)4 << 32) ^ (uint64_t)c;
+      case_primitives(&rng, c, &enc, &dec, &inv);
+      rng = seed ^ ((uint64_t)5 << 32) ^ (uint64_t)c;
+      case_filters(&rng, c, &filter, &group);
+      rng = seed ^ ((uint64_t)6 << 32) ^ (uint64_t)c;
+      case_exhaustive(&rng, c, &exhaustive);
+      rng = seed ^ ((uint64_t)7 << 32) ^ (uint64_t)c;
+      case_r8_search(&rng, c, &r8);
+    }
+    report(&enc);
+    report(&dec);
+    report(&inv);
+    report(&filter);
+    report(&group);
+    report(&exhaustive);
+    report(&r8);
+    mismatches += enc.mismatches + dec.mismatches + inv.mismatches + filter.mismatches
+      + group.mismatches + exhaustive.mismatches + r8.mismatches;
+    fflush(stdout);
+  }
+  arena_free(&arena);
+
+  /* last: the cache stays enabled once set */
+  rng = seed ^ ((uint64_t)8 << 32);
+  case_daemon_cancel(&rng, &cancel);
+  printf("Daemon\n  %-24s %6ld %10ld %12.3f s\n", cancel.name, cancel.cases, cancel.mismatches, cancel.opt_time);
+  mismatches += cancel.mismatches;
+
+  if (mismatches > 0) {
+    fprintf(stderr, "[!] %ld mismatches with the references\n", mismatches);
+    return EXIT_FAILURE;
+  }
+  fprintf(stderr, "[*] All outputs match the references\n");
+  return EXIT_SUCCESS;
+}
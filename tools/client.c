@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "dfa.h"
+
+static int connect_socket(const char *path) {
+  int fd;
+  struct sockaddr_un addr;
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/**
+ * Local client of the daemon (`dfa --daemon <socket>`).
+ *
+ * - submit a job (input file format) and print its result on stdout:
+ *   keys one per line, or "factored <n>" followed by the candidates of each diagonal;
+ *   the identifier of the job is printed on stderr;
+ * - cancel a job with -C <id>;
+ * - list queued and running jobs with -S.
+ *
+ * Usage: dfa-client -s <socket> [-8] [-9] [-p priority] [-F] <file>
+ *        dfa-client -s <socket> -C <id>
+ *        dfa-client -s <socket> -S
+ */
+int main(int argc, char *argv[]) {
+  int opt, fd, ret = EXIT_FAILURE;
+  int mode = 0;
+  int priority = 0;
+  bool factored = false;
+  bool status = false;
+  char *socket_path = NULL;
+  char *cancel = NULL;
+  char line[4096];
+  FILE *in, *out, *fp;
+
+  while ((opt = getopt(argc, argv, "89s:p:FC:S")) != -1) {
+    switch (opt) {
+    case '8':
+      mode = mode == 9 || mode == 89 ? 89 : 8;
+      break;
+    case '9':
+      mode = mode == 8 || mode == 89 ? 89 : 9;
+      break;
+    case 's':
+      socket_path = optarg;
+      break;
+    case 'p':
+      priority = atoi(optarg);
+      break;
+    case 'F':
+      factored = true;
+      break;
+    case 'C':
+      cancel = optarg;
+      break;
+    case 'S':
+      status = true;
+      break;
+    default:
+      fprintf(stderr, "Usage: %s -s <socket> [-8] [-9] [-p priority] [-F] <file> | -C <id> | -S\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (socket_path == NULL || (cancel == NULL && !status && (mode == 0 || optind >= argc))) {
+    fprintf(stderr, "Usage: %s -s <socket> [-8] [-9] [-p priority] [-F] <file> | -C <id> | -S\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  fd = connect_socket(socket_path);
+  if (fd == -1) {
+    fprintf(stderr, "[!] Cannot connect to '%s'\n", socket_path);
+    return EXIT_FAILURE;
+  }
+  in = fdopen(fd, "r");
+  out = fdopen(dup(fd), "w");
+  if (in == NULL || out == NULL) {
+    fprintf(stderr, "[!] Cannot connect to '%s'\n", socket_path);
+    return EXIT_FAILURE;
+  }
+
+  if (cancel != NULL || status) {
+    if (cancel != NULL) {
+      fprintf(out, "cancel %s\n", cancel);
+    }
+    else {
+      fprintf(out, "status\n");
+    }
+    fprintf(out, "quit\n");
+    fflush(out);
+    while (fgets(line, sizeof(line), in) != NULL) {
+      if (strncmp(line, "error", 5) == 0) {
+        fprintf(stderr, "[!] %s", line + 6);
+        ret = EXIT_FAILURE;
+        break;
+      }
+      fputs(line, stdout);
+      ret = EXIT_SUCCESS;
+    }
+  }
+  else {
+    fp = fopen(argv[optind], "r");
+    if (fp == NULL) {
+      fprintf(stderr, "[!] Input file cannot be opened\n");
+      return EXIT_FAILURE;
+    }
+    fprintf(out, "job %d priority=%d%s\n", mode, priority, factored ? " factored" : "");
+    while (fgets(line, sizeof(line), fp) != NULL) {
+      fputs(line, out);
+      if (line[strlen(line) - 1] != '\n') {
+        fputc('\n', out);
+      }
+    }
+    fclose(fp);
+    fprintf(out, "end\n");
+    fflush(out);
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+      if (strncmp(line, "queued ", 7) == 0) {
+        fprintf(stderr, "[*] Job %s", line + 7);
+      }
+      else if (strncmp(line, "keys ", 5) == 0) {
+        fprintf(stderr, "[*] %ld keys\n", atol(line + 5));
+      }
+      else if (strncmp(line, "done ", 5) == 0) {
+        ret = EXIT_SUCCESS;
+        break;
+      }
+      else if (strncmp(line, "cancelled ", 10) == 0) {
+        fprintf(stderr, "[!] Job cancelled\n");
+        break;
+      }
+      else if (strncmp(line, "error", 5) == 0) {
+        fprintf(stderr, "[!] %s", line + 6);
+        break;
+      }
+      else {
+        fputs(line, stdout);
+      }
+    }
+  }
+
+  fclose(out);
+  fclose(in);
+  return ret;
+}
@@ -0,0 +1,354 @@
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dfa.h"
+#ifdef _OPENMP
+#include "omp.h"
+#endif
+
+#define MODELS 6
+
+/* knowledge of the fault given to the analysis (as in faultsimulator.py) */
+static const char *MODEL_NAMES[MODELS] = {
+  "unknown", "position", "value", "position_value", "bitflip", "position_bitflip"
+};
+
+typedef struct Trial {
+  double space;           /* keys before filtering (round 8: key spaces searched) */
+  double survivors;       /* keys given by the analysis */
+  double seconds;
+  bool right;             /* the master key is among them */
+} trial_t;
+
+static uint64_t splitmix(uint64_t *state) {
+  uint64_t z = (*state += 0x9e3779b97f4a7c15UL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9UL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebUL;
+  return z ^ (z >> 31);
+}
+
+/**
+ * Pairs of a trial: `npairs` faults in round 8 at random positions,
+ * or `npairs` sets of four faults in round 9 (one in each column).
+ */
+static int make_pairs(
+  const int round,
+  const int model,
+  const int npairs,
+  const uint8_t subkeys[176],
+  uint64_t *rng,
+  pair_t *pairs
+) {
+  int i, j, n;
+  uint8_t pt[16], value;
+  bool bitflip = model == 4 || model == 5;
+  bool known_pos = model == 1 || model == 3 || model == 5;
+  bool known_value = model == 2 || model == 3;
+
+  n = round == DFA_ROUND_8 ? npairs : 4*npairs;
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < 16; j++) {
+      pt[j] = (uint8_t)splitmix(rng);
+    }
+    memset(&pairs[i], 0, sizeof(pair_t));
+    pairs[i].fault_pos = round == DFA_ROUND_8 ? (int)(splitmix(rng) % 16) : 4*(i % 4) + (int)(splitmix(rng) % 4);
+    value = bitflip ? (uint8_t)(1 << (splitmix(rng) % 8)) : (uint8_t)(1 + splitmix(rng) % 255);
+    encrypt_faulty(pt, subkeys, 0, 0, 0, pairs[i].ct);
+    encrypt_faulty(pt, subkeys, round, pairs[i].fault_pos, value, pairs[i].fct);
+    pairs[i].fault_value = known_value ? value : -1;
+    pairs[i].bitflip = bitflip;
+    if (!known_pos) {
+      pairs[i].fault_pos = -1;
+    }
+  }
+  return n;
+}
+
+static bool factored_contains(const factored_t *factored, const uint8_t subkey10[16]) {
+  int diag, b, i;
+  uint32_t word;
+
+  for (diag = 0; diag < 4; diag++) {
+    word = 0;
+    for (b = 0; b < 4; b++) {
+      word |= (uint32_t)subkey10[POSITIONS[diag][b]] << (8*b);
+    }
+    for (i = 0; i < factored->candidates_len[diag] && factored->candidates[diag][i] != word; i++);
+    if (i == factored->candidates_len[diag]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * One trial: random master key and faults, then the key recovery
+ * as `dfa` runs it (without known plaintext).
+ */
+static void run_trial(const int round, const int model, const int npairs, uint64_t seed, trial_t *trial) {
+  int i, n;
+  uint8_t masterkey[16];
+  uint8_t subkeys[176];
+  pair_t *pairs = malloc(4 * npairs * sizeof(pair_t));
+  known_pt_t known_pt;
+  keyset_t keys;
+  factored_t factored = {0};
+  arena_t arena;
+  search_ctl_t ctl;
+  double start;
+
+  if (pairs == NULL || keyset_init(&keys, KEYSET_INITIAL) == -1 || search_ctl_init(&ctl, 0, false) == -1) {
+    fprintf(stderr, "[!] Cannot allocate the trial\n");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < 16; i++) {
+    masterkey[i] = (uint8_t)splitmix(&seed);
+  }
+  key_expansion(masterkey, subkeys);
+  n = make_pairs(round, model, npairs, subkeys, &seed, pairs);
+  known_pt_init(&known_pt);
+  arena_init(&arena, 0);
+
+  start = wall_time();
+  if (round == DFA_ROUND_8) {
+    r8_key_recovery(pairs, n, &arena, NULL, NULL, &known_pt, &keys, &ctl);
+    trial->space = ctl.space;
+  }
+  else {
+    r9_key_recovery(pairs, n, &arena, &known_pt, &keys, &factored, NULL);
+  }
+  trial->seconds = wall_time() - start;
+
+  if (factored.is_some) {
+    trial->survivors = (double)factored_size(&factored);
+    trial->right = factored_contains(&factored, subkeys + 160);
+    factored_free(&factored);
+  }
+  else {
+    trial->survivors = (double)keyset_len(&keys);
+    trial->right = false;
+    for (i = 0; i < (int)keyset_len(&keys) && !trial->right; i++) {
+      trial->right = memcmp(keyset_get(&keys, i), masterkey, 16) == 0;
+    }
+  }
+  if (round == DFA_ROUND_9) {
+    /* without filtering, all the candidates are keys */
+    trial->space = trial->survivors;
+  }
+
+  arena_free(&arena);
+  search_ctl_free(&ctl);
+  keyset_free(&keys);
+  free(pairs);
+}
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a;
+  double y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * Minimum, median, 90th percentile and maximum of `n` values (sorted in place).
+ */
+static void print_distribution(const char *name, double *v, const int n, const bool log) {
+  int i;
+  double q[4];
+
+  qsort(v, n, sizeof(double), cmp_double);
+  q[0] = v[0];
+  q[1] = v[(n - 1) / 2];
+  q[2] = v[(int)(0.9 * (n - 1) + 0.5)];
+  q[3] = v[n - 1];
+  printf("    %-16s", name);
+  for (i = 0; i < 4; i++) {
+    if (log) {
+      printf("  %s %7.2f", i == 0 ? "min" : i == 1 ? "median" : i == 2 ? "p90" : "max", q[i] > 0 ? log2(q[i]) : 0);
+    }
+    else {
+      printf("  %s %9.4g", i == 0 ? "min" : i == 1 ? "median" : i == 2 ? "p90" : "max", q[i]);
+    }
+  }
+  printf("\n");
+}
+
+static void report(const int model, trial_t *trials, const int ntrials) {
+  int i;
+  int unique = 0;
+  int right = 0;
+  double *v = malloc(ntrials * sizeof(double));
+
+  if (v == NULL) {
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < ntrials; i++) {
+    unique += trials[i].survivors == 1 && trials[i].right;
+    right += trials[i].right;
+  }
+  printf(
+    "%s: unique key %.1f%%, master key kept %.1f%%\n",
+    MODEL_NAMES[model], 100.0 * unique / ntrials, 100.0 * right / ntrials
+  );
+  for (i = 0; i < ntrials; i++) {
+    v[i] = trials[i].space;
+  }
+  print_distribution("key space (log2)", v, ntrials, true);
+  for (i = 0; i < ntrials; i++) {
+    v[i] = trials[i].survivors;
+  }
+  print_distribution("survivors", v, ntrials, false);
+  for (i = 0; i < ntrials; i++) {
+    v[i] = trials[i].seconds;
+  }
+  print_distribution("time (s)", v, ntrials, false);
+  free(v);
+}
+
+static void usage(const char *name) {
+  fprintf(
+    stderr,
+    "Usage: %s -8|-9 [-n trials] [-p pairs] [-m model[,model...]] [-j jobs] [-s seed] [-q] [-v]\n"
+    "Models: unknown, position, value, position_value, bitflip, position_bitflip\n",
+    name
+  );
+  exit(EXIT_FAILURE);
+}
+
+/**
+ * Monte-Carlo evaluation of the key recovery, to plan injection campaigns.
+ *
+ * For each fault model, random master keys and faults are simulated in memory
+ * and given to the key recovery (r8_key_recovery or r9_key_recovery, without
+ * known plaintext); the report gives, on stdout, how often a single key remains
+ * and the distributions of the key space, of the keys left and of the runtime.
+ *
+ * - -n: trials for each model (10 by default);
+ * - -p: pairs of each trial with a fault in round 8, or sets of four pairs
+ *   (one for each column) with a fault in round 9 (1 by default);
+ * - -m: models to evaluate (all by default);
+ * - -j: trials run at once, each on a single thread (number of threads by default;
+ *   with 1, each trial uses all the threads);
+ * - -s: seed (trial i of a model always gets the same key and faults);
+ * - -q: no line for each trial on stderr;
+ * - -v: keep the output of the analysis on stderr.
+ *
+ * Usage: dfa-eval -8|-9 [-n trials] [-p pairs] [-m model[,model...]] [-j jobs] [-s seed] [-q] [-v]
+ */
+int main(int argc, char *argv[]) {
+  int opt, m, t, fd;
+  int round = 0;
+  int ntrials = 10;
+  int npairs = 1;
+  int jobs = max_threads();
+  bool selected[MODELS] = {false};
+  bool any = false;
+  bool quiet = false;
+  bool verbose = false;
+  uint64_t seed = 1;
+  char *name, *saveptr;
+  FILE *log = stderr;
+  trial_t *trials;
+
+  while ((opt = getopt(argc, argv, "89n:p:m:j:s:qv")) != -1) {
+    switch (opt) {
+    case '8':
+      round = DFA_ROUND_8;
+      break;
+    case '9':
+      round = DFA_ROUND_9;
+      break;
+    case 'n':
+      ntrials = atoi(optarg);
+      break;
+    case 'p':
+      npairs = atoi(optarg);
+      break;
+    case 'm':
+      for (name = strtok_r(optarg, ",", &saveptr); name != NULL; name = strtok_r(NULL, ",", &saveptr)) {
+        for (m = 0; m < MODELS && strcmp(name, MODEL_NAMES[m]) != 0; m++);
+        if (m == MODELS) {
+          fprintf(stderr, "[!] Unknown fault model '%s'\n", name);
+          usage(argv[0]);
+        }
+        selected[m] = true;
+        any = true;
+      }
+      break;
+    case 'j':
+      jobs = atoi(optarg);
+      break;
+    case 's':
+      seed = strtoull(optarg, NULL, 0);
+      break;
+    case 'q':
+      quiet = true;
+      break;
+    case 'v':
+      verbose = true;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (round == 0 || ntrials < 1 || npairs < 1 || jobs < 1) {
+    usage(argv[0]);
+  }
+  for (m = 0; m < MODELS && !any; m++) {
+    selected[m] = true;
+  }
+
+  trials = malloc(ntrials * sizeof(trial_t));
+  if (trials == NULL) {
+    exit(EXIT_FAILURE);
+  }
+  kernel_current();
+
+  /* the analysis reports on stderr: kept for the progress of the trials only */
+  if (!verbose) {
+    fd = dup(STDERR_FILENO);
+    log = fd == -1 ? NULL : fdopen(fd, "w");
+    fd = open("/dev/null", O_WRONLY);
+    if (log == NULL || fd == -1 || dup2(fd, STDERR_FILENO) == -1) {
+      fprintf(stderr, "[!] Cannot redirect stderr\n");
+      exit(EXIT_FAILURE);
+    }
+    close(fd);
+    setvbuf(log, NULL, _IOLBF, 0);
+  }
+
+  printf(
+    "Round %d, %d %s per trial, %d trials per model, %d trials at once (kernels %s)\n",
+    round, round == DFA_ROUND_8 ? npairs : 4*npairs,
+    round == DFA_ROUND_8 ? "pair(s)" : "pairs (one for each column)", ntrials, jobs, kernel_current()->name
+  );
+  fflush(stdout);
+
+  for (m = 0; m < MODELS; m++) {
+    if (!selected[m]) {
+      continue;
+    }
+#ifdef _OPENMP
+    omp_set_max_active_levels(jobs > 1 ? 1 : 2);
+#pragma omp parallel for schedule(dynamic, 1) num_threads(jobs) if(jobs > 1)
+#endif
+    for (t = 0; t < ntrials; t++) {
+      run_trial(round, m, npairs, seed ^ ((uint64_t)m << 32) ^ (uint64_t)t, &trials[t]);
+      if (!quiet) {
+        fprintf(
+          log, "[*] %s trial %d: 2^%.1f keys before filtering, %.0f left%s, %.3f s\n",
+          MODEL_NAMES[m], t, trials[t].space > 0 ? log2(trials[t].space) : 0, trials[t].survivors,
+          trials[t].right ? "" : " (master key missed)", trials[t].seconds
+        );
+      }
+    }
+    report(m, trials, ntrials);
+    fflush(stdout);
+  }
+
+  free(trials);
+  return 0;
+}
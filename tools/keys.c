@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dfa.h"
+
+/**
+ * Convert a key file written by `dfa` to hexadecimal, one key per line on stdout;
+ * the header is described on stderr.
+ *
+ * Two formats are supported:
+ * - binary key file (`-f binary`);
+ * - factored key space (`-f factored`): keys are expanded on demand, and a range
+ *   of indices can be selected with -s (first index) and -n (number of keys)
+ *   to sample or shard the key space.
+ *
+ * Usage: dfa-keys [-s start] [-n count] <file>
+ */
+int main(int argc, char *argv[]) {
+  keyfile_t kf;
+  factored_t factored;
+  factored_header_t fheader;
+  factored_iter_t it;
+  uint64_t i;
+  uint64_t start = 0;
+  uint64_t count = UINT64_MAX;
+  int opt;
+  hex_writer_t w;
+  uint8_t key[16];
+
+  opt = getopt(argc, argv, "s:n:");
+  while (opt != -1) {
+    switch (opt) {
+    case 's':
+      start = strtoull(optarg, NULL, 0);
+      break;
+    case 'n':
+      count = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      fprintf(stderr, "Usage: %s [-s start] [-n count] <file>\n", argv[0]);
+      exit(EXIT_FAILURE);
+    }
+    opt = getopt(argc, argv, "s:n:");
+  }
+  if (optind != argc - 1) {
+    fprintf(stderr, "Usage: %s [-s start] [-n count] <file>\n", argv[0]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (hex_writer_init(&w, stdout) == -1) {
+    exit(EXIT_FAILURE);
+  }
+
+  if (keyfile_open(argv[optind], &kf) == 0) {
+    fprintf(stderr, "[*] Mode: %u\n", kf.header.mode);
+    fprintf(stderr, "[*] Input hash: %016lx\n", (unsigned long)kf.header.input_hash);
+    fprintf(stderr, "[*] Number of pairs: %u\n", kf.header.npairs);
+    fprintf(
+      stderr, "[*] Keys verified with known plaintext: %s\n",
+      (kf.header.flags & KEYFILE_VERIFIED) ? "yes" : "no"
+    );
+    fprintf(stderr, "[*] Hypotheses:");
+    print_hypotheses(stderr, kf.header.hypotheses, (kf.header.flags & KEYFILE_BITFLIP) != 0);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "[*] Number of keys: %lu\n", (unsigned long)kf.header.nkeys);
+
+    for (i = start; i < kf.header.nkeys && i - start < count; i++) {
+      hex_writer_put(&w, kf.keys[i]);
+    }
+    keyfile_close(&kf);
+  }
+  else if (factored_open(argv[optind], &factored, &fheader) == 0) {
+    fprintf(stderr, "[*] Mode: %u\n", fheader.mode);
+    fprintf(stderr, "[*] Input hash: %016lx\n", (unsigned long)fheader.input_hash);
+    fprintf(stderr, "[*] Number of pairs: %u\n", fheader.npairs);
+    print_number_candidates(factored.candidates_len, (long)fheader.nkeys);
+
+    factored_iter_init(&it, &factored, start, count > UINT64_MAX - start ? UINT64_MAX : start + count);
+    while (factored_iter_next(&it, key)) {
+      hex_writer_put(&w, key);
+    }
+    factored_free(&factored);
+  }
+  else {
+    fprintf(stderr, "[!] '%s' is not a valid key file\n", argv[optind]);
+    exit(EXIT_FAILURE);
+  }
+
+  if (hex_writer_close(&w) == -1) {
+    fprintf(stderr, "[!] Cannot write the keys\n");
+    exit(EXIT_FAILURE);
+  }
+  return 0;
+}